@@ -0,0 +1,1144 @@
+#include "avoidance.h"
+#include "avoidancekernels.h"
+#include "mathutil.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AVOIDANCE_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+static const char* kernelVariantNames[NumKernelVariants] = { "scalar", "sse", "avx2", "avx512" };
+
+static void circleCircleCandidatesScalar(CandidateBatch& batch, const CircleCircleConsts& k)
+{
+    circleCircleCandidates<float>(batch, k);
+}
+
+static void circlePillCandidatesScalar(CandidateBatch& batch, const CirclePillConsts& k)
+{
+    circlePillCandidates<float>(batch, k);
+}
+
+static void chainApproachCandidatesScalar(ChainBatch& batch, const ChainSumConsts& k)
+{
+    chainApproachCandidates<float>(batch, k);
+}
+
+static void chainDistanceCandidatesScalar(ChainBatch& batch, const ChainSumConsts& k)
+{
+    chainDistanceCandidates<float>(batch, k);
+}
+
+#ifdef MATHUTIL_SSE
+static void circleCircleCandidatesSSE(CandidateBatch& batch, const CircleCircleConsts& k)
+{
+    circleCircleCandidates<Floatx4>(batch, k);
+}
+
+static void circlePillCandidatesSSE(CandidateBatch& batch, const CirclePillConsts& k)
+{
+    circlePillCandidates<Floatx4>(batch, k);
+}
+
+static void chainApproachCandidatesSSE(ChainBatch& batch, const ChainSumConsts& k)
+{
+    chainApproachCandidates<Floatx4>(batch, k);
+}
+
+static void chainDistanceCandidatesSSE(ChainBatch& batch, const ChainSumConsts& k)
+{
+    chainDistanceCandidates<Floatx4>(batch, k);
+}
+
+static const CandidateKernels candidateKernelsSSE = { circleCircleCandidatesSSE, circlePillCandidatesSSE,
+                                                      chainApproachCandidatesSSE, chainDistanceCandidatesSSE, 4 };
+#else
+static const CandidateKernels candidateKernelsSSE = { nullptr, nullptr, nullptr, nullptr, 0 };
+#endif
+
+static const CandidateKernels candidateKernelsScalar = { circleCircleCandidatesScalar, circlePillCandidatesScalar,
+                                                         chainApproachCandidatesScalar, chainDistanceCandidatesScalar, 1 };
+
+static const CandidateKernels* kernelVariantKernels(const KernelVariant variant)
+{
+    switch (variant)
+    {
+    case KernelVariant::Scalar: return &candidateKernelsScalar;
+    case KernelVariant::SSE: return &candidateKernelsSSE;
+    case KernelVariant::AVX2: return &candidateKernelsAVX2;
+    case KernelVariant::AVX512: return &candidateKernelsAVX512;
+    }
+    return &candidateKernelsScalar;
+}
+
+#if defined(AVOIDANCE_X86) && defined(_MSC_VER) && !defined(__clang__)
+// The OS has to save the wide registers too, which is what XCR0 tells.
+static bool cpuSupports(const KernelVariant variant)
+{
+    int regs[4];
+    __cpuid(regs, 0);
+    const int maxLeaf = regs[0];
+    __cpuid(regs, 1);
+    const bool sse2 = (regs[3] & (1 << 26)) != 0;
+    const bool fma = (regs[2] & (1 << 12)) != 0;
+    const bool osxsave = (regs[2] & (1 << 27)) != 0;
+    if (variant == KernelVariant::SSE)
+        return sse2;
+    if (!osxsave || maxLeaf < 7)
+        return false;
+    const unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(regs, 7, 0);
+    if (variant == KernelVariant::AVX2)
+        return fma && (regs[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    if (variant == KernelVariant::AVX512)
+        return fma && (regs[1] & (1 << 5)) != 0 && (regs[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+    return false;
+}
+#elif defined(AVOIDANCE_X86)
+// __builtin_cpu_supports() checks that the OS saves the wide registers too.
+static bool cpuSupports(const KernelVariant variant)
+{
+    __builtin_cpu_init();
+    if (variant == KernelVariant::SSE)
+        return __builtin_cpu_supports("sse2");
+    if (variant == KernelVariant::AVX2)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (variant == KernelVariant::AVX512)
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return false;
+}
+#else
+static bool cpuSupports(const KernelVariant)
+{
+    return false;
+}
+#endif
+
+bool kernelVariantSupported(const KernelVariant variant)
+{
+    if (variant == KernelVariant::Scalar)
+        return true;
+    return kernelVariantKernels(variant)->circleCircle != nullptr && cpuSupports(variant);
+}
+
+const char* kernelVariantName(const KernelVariant variant)
+{
+    return kernelVariantNames[(int)variant];
+}
+
+// Picks the widest supported variant, or the one named in CPA_KERNELS if the CPU supports it.
+static KernelVariant selectKernelVariant()
+{
+    KernelVariant best = KernelVariant::Scalar;
+    for (int i = 0; i < NumKernelVariants; i++)
+    {
+        if (kernelVariantSupported((KernelVariant)i))
+            best = (KernelVariant)i;
+    }
+
+    const char* forced = getenv("CPA_KERNELS");
+    if (forced == nullptr || forced[0] == '\0')
+        return best;
+    for (int i = 0; i < NumKernelVariants; i++)
+    {
+        if (strcmp(forced, kernelVariantNames[i]) != 0)
+            continue;
+        if (kernelVariantSupported((KernelVariant)i))
+            return (KernelVariant)i;
+        fprintf(stderr, "CPA_KERNELS=%s is not supported by this CPU, using %s.\n", forced, kernelVariantNames[(int)best]);
+        return best;
+    }
+    fprintf(stderr, "Unknown CPA_KERNELS=%s, expected scalar, sse, avx2 or avx512. Using %s.\n", forced, kernelVariantNames[(int)best]);
+    return best;
+}
+
+// Selected on first use rather than during static initialization, so that CPA_KERNELS is read
+// and reported from main() and not before it.
+static std::atomic<int>& currentVariant()
+{
+    static std::atomic<int> variant((int)selectKernelVariant());
+    return variant;
+}
+
+KernelVariant currentKernelVariant()
+{
+    return (KernelVariant)currentVariant().load(std::memory_order_relaxed);
+}
+
+bool setKernelVariant(const KernelVariant variant)
+{
+    if (!kernelVariantSupported(variant))
+        return false;
+    currentVariant().store((int)variant, std::memory_order_relaxed);
+    return true;
+}
+
+// Counting sort of the candidates in src by the chains both colliders pick for dirs, into out. Each group
+// starts at a multiple of lanes, the padding has index -1. Stores the first slot and the end of each group,
+// padded to whole lanes, and returns the number of groups.
+static int groupChainCandidates(const ChainBatch& src, const Vec2* dirs, const PreparedCollider& agent, const PreparedCollider& other,
+                                const int lanes, ChainBatch& out, int* groupStart, int* groupEnd)
+{
+    int keys[ChainBatchSize];
+    int counts[MaxChainGroups] = {};
+    for (int i = 0; i < src.num; i++)
+    {
+        keys[i] = src.index[i] < 0 ? -1 : chainIndex(agent, dirs[i]) * 4 + chainIndex(other, dirs[i]);
+        if (keys[i] >= 0)
+            counts[keys[i]]++;
+    }
+
+    int next[MaxChainGroups];
+    int numGroups = 0;
+    int end = 0;
+    for (int g = 0; g < MaxChainGroups; g++)
+    {
+        if (counts[g] == 0)
+            continue;
+        next[g] = end;
+        groupStart[numGroups] = end;
+        end = (end + counts[g] + lanes - 1) / lanes * lanes;
+        groupEnd[numGroups] = end;
+        numGroups++;
+    }
+
+    for (int i = 0; i < end; i++)
+    {
+        out.vx[i] = 0.0f;
+        out.vy[i] = 0.0f;
+        out.t[i] = 0.0f;
+        out.cost[i] = 0.0f;
+        out.index[i] = -1;
+    }
+    for (int i = 0; i < src.num; i++)
+    {
+        if (keys[i] < 0)
+            continue;
+        const int slot = next[keys[i]]++;
+        out.vx[slot] = src.vx[i];
+        out.vy[slot] = src.vy[i];
+        out.t[slot] = src.t[i];
+        out.index[slot] = src.index[i];
+    }
+    out.num = end;
+
+    return numGroups;
+}
+
+// Minkowski sum of the chains both colliders pick for dir.
+static void chainSum(const PreparedCollider& agent, const PreparedCollider& other, const Vec2 dir, ChainSumConsts& k)
+{
+    Vec2 chainA[3];
+    Vec2 chainB[3];
+    uint8_t sumColIdx[5];
+    uint8_t sumSegIdx[5];
+    const int numA = makeChain(agent, dir, chainA);
+    const int numB = makeChain(other, dir, chainB);
+    k.numSum = minkowskiChain(chainA, numA, chainB, numB, k.sum, sumColIdx, sumSegIdx, 5);
+}
+
+// The chain pairs in lanes. The chains depend on the direction of the relative velocity for CPA, and on the
+// direction to the other collider at CPA for the distance, so the candidates are grouped twice, and the sum
+// is built once per group instead of once per candidate.
+static void chainCandidates(const CandidateKernels& kernels, CandidateBatch& batch, const PreparedCollider& agent,
+                            const PreparedCollider& other, const Vec2 velB, const float maxTime, const float separation)
+{
+    ChainBatch src;
+    ChainBatch sorted;
+    Vec2 dirs[ChainBatchSize];
+    int groupStart[MaxChainGroups];
+    int groupEnd[MaxChainGroups];
+
+    ChainSumConsts k;
+    k.relPos = agent.pos - other.pos;
+    k.velB = velB;
+    k.totalRad = agent.rad + other.rad;
+    k.maxTime = maxTime;
+    k.separation = separation;
+
+    for (int i = 0; i < batch.num; i++)
+    {
+        src.vx[i] = batch.vx[i];
+        src.vy[i] = batch.vy[i];
+        src.t[i] = 0.0f;
+        src.index[i] = i;
+        dirs[i] = Vec2(batch.vx[i], batch.vy[i]) - velB;
+    }
+    src.num = batch.num;
+
+    int numGroups = groupChainCandidates(src, dirs, agent, other, kernels.lanes, sorted, groupStart, groupEnd);
+    for (int g = 0; g < numGroups; g++)
+    {
+        const int first = groupStart[g];
+        chainSum(agent, other, Vec2(sorted.vx[first], sorted.vy[first]) - velB, k);
+        k.start = first;
+        k.end = groupEnd[g];
+        kernels.chainApproach(sorted, k);
+    }
+
+    for (int i = 0; i < sorted.num; i++)
+    {
+        const Vec2 relVel = Vec2(sorted.vx[i], sorted.vy[i]) - velB;
+        dirs[i] = -(k.relPos + relVel * sorted.t[i]);
+    }
+
+    numGroups = groupChainCandidates(sorted, dirs, agent, other, kernels.lanes, src, groupStart, groupEnd);
+    for (int g = 0; g < numGroups; g++)
+    {
+        const int first = groupStart[g];
+        const Vec2 relVel = Vec2(src.vx[first], src.vy[first]) - velB;
+        chainSum(agent, other, -(k.relPos + relVel * src.t[first]), k);
+        k.start = first;
+        k.end = groupEnd[g];
+        kernels.chainDistance(src, k);
+    }
+
+    for (int i = 0; i < src.num; i++)
+    {
+        if (src.index[i] >= 0)
+            batch.cost[src.index[i]] = maxf(batch.cost[src.index[i]], src.cost[i]);
+    }
+}
+
+void evaluateVelocityCandidates(const PreparedCollider& agent, const Vec2* candidates, const int numCandidates,
+                                const PreparedCollider* neighbours, const Vec2* neighbourVels, const int numNeighbours,
+                                const float maxTime, const float separation, float* costs)
+{
+    TRACE_SCOPE("evaluateVelocityCandidates");
+    ScopedFlushDenormals ftz;
+    const CandidateKernels& kernels = *kernelVariantKernels(currentKernelVariant());
+    CandidateBatch batch;
+
+    for (int base = 0; base < numCandidates; base += CandidateBatchSize)
+    {
+        batch.num = mini(CandidateBatchSize, numCandidates - base);
+        for (int i = 0; i < batch.num; i++)
+        {
+            batch.vx[i] = candidates[base + i].x;
+            batch.vy[i] = candidates[base + i].y;
+            batch.cost[i] = 0.0f;
+        }
+        // The wide kernels run over whole lanes, pad with zero velocities.
+        const int numPadded = mini(CandidateBatchSize, (batch.num + MaxCandidateLanes - 1) & ~(MaxCandidateLanes - 1));
+        for (int i = batch.num; i < numPadded; i++)
+        {
+            batch.vx[i] = 0.0f;
+            batch.vy[i] = 0.0f;
+            batch.cost[i] = 0.0f;
+        }
+
+        for (int j = 0; j < numNeighbours; j++)
+        {
+            const PreparedCollider& other = neighbours[j];
+            const Vec2 relPos = agent.pos - other.pos;
+            const float totalRad = agent.rad + other.rad;
+
+            if (agent.type == ColliderType::Circle && other.type == ColliderType::Circle)
+            {
+                CircleCircleConsts k;
+                k.relPos = relPos;
+                k.velB = neighbourVels[j];
+                k.c = dot(relPos, relPos) - sqrf(totalRad);
+                k.totalRad = totalRad;
+                k.maxTime = maxTime;
+                k.separation = separation;
+                kernels.circleCircle(batch, k);
+            }
+            else if ((agent.type == ColliderType::Circle && other.type == ColliderType::Pill) ||
+                     (agent.type == ColliderType::Pill && other.type == ColliderType::Circle))
+            {
+                const Vec2 stem = agent.type == ColliderType::Pill ? agent.axisY : other.axisY;
+                CirclePillConsts k;
+                k.relPos = relPos;
+                k.velB = neighbourVels[j];
+                k.stem = stem;
+                k.segDir = stem * 2.0f;
+                k.relPosStart = relPos + stem;
+                k.relPosEnd = relPos - stem;
+                k.segDirSq = dot(k.segDir, k.segDir);
+                k.dirRelPos = dot(k.segDir, k.relPosStart);
+                k.c = k.segDirSq*dot(k.relPosStart, k.relPosStart) - k.dirRelPos*k.dirRelPos - sqrf(totalRad)*k.segDirSq;
+                k.stemInvSq = safeinv(dot(stem, stem));
+                k.totalRad = totalRad;
+                k.maxTime = maxTime;
+                k.separation = separation;
+                kernels.circlePill(batch, k);
+            }
+            else
+            {
+                chainCandidates(kernels, batch, agent, other, neighbourVels[j], maxTime, separation);
+            }
+        }
+
+        for (int i = 0; i < batch.num; i++)
+            costs[base + i] = batch.cost[i];
+    }
+}
+
+// How much being too close to a neighbour costs compared to deviating maxSpeed from the preferred velocity.
+static const float SeparationWeight = 4.0f;
+
+static float velocityCost(const PreparedCollider& agent, const Vec2 vel, const Vec2 prefVel, const float maxSpeed,
+                          const PreparedCollider* neighbours, const Vec2* neighbourVels, const int numNeighbours,
+                          const float maxTime, const float separation, Vec2& grad)
+{
+    const float invSpeedSq = 1.0f / sqrf(maxSpeed);
+    const float invSepSq = 1.0f / sqrf(separation);
+
+    float cost = lenSq(vel - prefVel) * invSpeedSq;
+    grad = (vel - prefVel) * (2.0f * invSpeedSq);
+
+    for (int j = 0; j < numNeighbours; j++)
+    {
+        const ApproachGradRes cpa = closestPointOfApproachGrad(agent, vel, neighbours[j], neighbourVels[j], maxTime);
+        const float pen = maxf(0.0f, separation - cpa.dist);
+        cost += SeparationWeight * sqrf(pen) * invSepSq;
+        grad -= cpa.grad * (2.0f * SeparationWeight * pen * invSepSq);
+    }
+
+    return cost;
+}
+
+Vec2 optimizeVelocity(const PreparedCollider& agent, const Vec2 prefVel, const float maxSpeed,
+                      const PreparedCollider* neighbours, const Vec2* neighbourVels, const int numNeighbours,
+                      const float maxTime, const float separation, const int maxIterations)
+{
+    TRACE_SCOPE("optimizeVelocity");
+    ScopedFlushDenormals ftz;
+    Vec2 vel = clamp(prefVel, maxSpeed);
+    Vec2 grad;
+    float cost = velocityCost(agent, vel, prefVel, maxSpeed, neighbours, neighbourVels, numNeighbours, maxTime, separation, grad);
+    float step = maxSpeed * 0.25f;
+
+    for (int i = 0; i < maxIterations && step > maxSpeed * 0.001f; i++)
+    {
+        const float gradLen = len(grad);
+        if (gradLen < 1e-6f)
+            break;
+
+        const Vec2 testVel = clamp(vel - grad * (step / gradLen), maxSpeed);
+        Vec2 testGrad;
+        const float testCost = velocityCost(agent, testVel, prefVel, maxSpeed, neighbours, neighbourVels, numNeighbours, maxTime, separation, testGrad);
+        if (testCost < cost)
+        {
+            vel = testVel;
+            grad = testGrad;
+            cost = testCost;
+        }
+        else
+        {
+            step *= 0.5f;
+        }
+    }
+
+    return vel;
+}
+
+static float searchCost(const PreparedCollider& agent, const Vec2 vel, const Vec2 prefVel, const float maxSpeed,
+                        const PreparedCollider* neighbours, const Vec2* neighbourVels, const int numNeighbours,
+                        const float maxTime, const float separation)
+{
+    float penalty = 0.0f;
+    for (int j = 0; j < numNeighbours; j++)
+    {
+        const ApproachRes cpa = closestPointOfApproach(agent, vel, neighbours[j], neighbourVels[j], maxTime);
+        const DistanceRes dist = nearestDistance(agent, vel * cpa.t, neighbours[j], neighbourVels[j] * cpa.t);
+        if (cpa.hit && cpa.t <= 0.0f)
+        {
+            // Already touching, costs half when sliding along, more when approaching, and less when moving apart,
+            // so that the search pushes the bodies apart instead of settling for any velocity that does not approach.
+            const float approach = -dot(vel - neighbourVels[j], dist.norm) / maxSpeed;
+            penalty = maxf(penalty, 0.5f + 0.5f * clampf(approach, -1.0f, 1.0f));
+            continue;
+        }
+        penalty = maxf(penalty, candidatePenalty(cpa.t, dist.dist, maxTime, separation));
+    }
+    return lenSq(vel - prefVel) / sqrf(maxSpeed) + CandidatePenaltyWeight * penalty;
+}
+
+// Polar cell of the velocity search, the cost is sampled at the center of the cell.
+struct SearchCell
+{
+    float angle;
+    float angleExt;
+    float speed;
+    float speedExt;
+    float cost;
+    float slope;    // largest cost change per velocity change seen around the cell.
+};
+
+static Vec2 searchCellVel(const SearchCell& cell)
+{
+    return Vec2(cosf(cell.angle), sinf(cell.angle)) * cell.speed;
+}
+
+static float searchCellSize(const SearchCell& cell)
+{
+    return sqrtf(sqrf(cell.speedExt) + sqrf(cell.angleExt * (cell.speed + cell.speedExt)));
+}
+
+// Trisects the cell along its longer side. The middle third keeps the sample of the parent, the two outer
+// thirds are evaluated and added at the end of cells.
+static int splitSearchCell(SearchCell* cells, int numCells, const int split,
+                           const PreparedCollider& agent, const Vec2 prefVel, const float maxSpeed,
+                           const PreparedCollider* neighbours, const Vec2* neighbourVels, const int numNeighbours,
+                           const float maxTime, const float separation)
+{
+    SearchCell& parent = cells[split];
+    const Vec2 parentVel = searchCellVel(parent);
+    const bool alongAngle = parent.angleExt * parent.speed > parent.speedExt;
+    if (alongAngle)
+        parent.angleExt /= 3.0f;
+    else
+        parent.speedExt /= 3.0f;
+
+    for (int side = -1; side <= 1; side += 2)
+    {
+        SearchCell& cell = cells[numCells++];
+        cell = parent;
+        if (alongAngle)
+            cell.angle += parent.angleExt * 2.0f * (float)side;
+        else
+            cell.speed += parent.speedExt * 2.0f * (float)side;
+
+        const Vec2 vel = searchCellVel(cell);
+        cell.cost = searchCost(agent, vel, prefVel, maxSpeed, neighbours, neighbourVels, numNeighbours, maxTime, separation);
+
+        const float slope = fabsf(cell.cost - parent.cost) / maxf(1e-6f, len(vel - parentVel));
+        cell.slope = maxf(cell.slope, slope);
+        parent.slope = maxf(parent.slope, slope);
+    }
+    return numCells;
+}
+
+Vec2 searchVelocity(const PreparedCollider& agent, const Vec2 prefVel, const float maxSpeed,
+                    const PreparedCollider* neighbours, const Vec2* neighbourVels, const int numNeighbours,
+                    const float maxTime, const float separation, const int maxEvaluations, int& numEvaluations)
+{
+    TRACE_SCOPE("searchVelocity");
+    ScopedFlushDenormals ftz;
+    SearchCell cells[MaxSearchCells];
+    int numCells = 0;
+
+    Vec2 bestVel = clamp(prefVel, maxSpeed);
+    float bestCost = searchCost(agent, bestVel, prefVel, maxSpeed, neighbours, neighbourVels, numNeighbours, maxTime, separation);
+    numEvaluations = 1;
+
+    // Nothing to avoid.
+    if (bestCost <= lenSq(bestVel - prefVel) / sqrf(maxSpeed))
+        return bestVel;
+
+    // Stopping is often the best way out, and the ring cells never sample it.
+    if (numEvaluations < maxEvaluations)
+    {
+        const float cost = searchCost(agent, Vec2(0,0), prefVel, maxSpeed, neighbours, neighbourVels, numNeighbours, maxTime, separation);
+        numEvaluations++;
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            bestVel = Vec2(0,0);
+        }
+    }
+
+    // The cost of moving away from prefVel alone changes at most this fast.
+    const float minSlope = 2.0f / maxSpeed;
+
+    // Coarse ring of cells around the origin.
+    const float angleExt = (float)M_PI / (float)SearchRingSize;
+    for (int i = 0; i < SearchRingSize && numEvaluations < maxEvaluations; i++)
+    {
+        SearchCell& cell = cells[numCells++];
+        cell.angle = -(float)M_PI + angleExt * (float)(i*2 + 1);
+        cell.angleExt = angleExt;
+        cell.speed = maxSpeed * 0.5f;
+        cell.speedExt = maxSpeed * 0.5f;
+        cell.cost = searchCost(agent, searchCellVel(cell), prefVel, maxSpeed, neighbours, neighbourVels, numNeighbours, maxTime, separation);
+        cell.slope = minSlope;
+        numEvaluations++;
+    }
+
+    for (int i = 0; i < numCells; i++)
+    {
+        const SearchCell& cell = cells[i];
+        const SearchCell& next = cells[(i+1) % numCells];
+        const float slope = fabsf(next.cost - cell.cost) / maxf(1e-6f, len(searchCellVel(next) - searchCellVel(cell)));
+        cells[i].slope = maxf(cells[i].slope, slope);
+        cells[(i+1) % numCells].slope = maxf(cells[(i+1) % numCells].slope, slope);
+    }
+
+    // The preferred velocity is already sampled, a cell around it refines towards the nearest safe velocity.
+    const float prefSpeed = len(bestVel);
+    if (bestVel.x == prefVel.x && bestVel.y == prefVel.y && prefSpeed > 0.0f && numCells < MaxSearchCells)
+    {
+        SearchCell& cell = cells[numCells++];
+        cell.angle = atan2f(bestVel.y, bestVel.x);
+        cell.angleExt = angleExt / 3.0f;
+        cell.speed = prefSpeed;
+        cell.speedExt = minf(prefSpeed, maxSpeed - prefSpeed) / 3.0f;
+        cell.cost = bestCost;
+        cell.slope = minSlope;
+    }
+
+    // Each step trisects three cells: the cell whose cost could be lowest, that is cells near the optimum and
+    // cells where the cost changes sharply, the cell with the lowest cost sampled so far, which keeps refining
+    // the optimum when the slopes elsewhere are high, and the largest cell, so that no part of the ring is left
+    // at the coarse resolution when the slopes near a jump in the cost grow without bound.
+    const float minSize = maxSpeed * 0.01f;
+    while (numEvaluations + 2 <= maxEvaluations && numCells + 2 <= MaxSearchCells)
+    {
+        int picks[3] = { -1, -1, -1 };
+        float lowest = 0.0f;
+        float largest = 0.0f;
+        for (int i = 0; i < numCells; i++)
+        {
+            const float size = searchCellSize(cells[i]);
+            if (size < minSize)
+                continue;
+            const float bound = cells[i].cost - cells[i].slope * size;
+            if (picks[0] == -1 || bound < lowest)
+            {
+                picks[0] = i;
+                lowest = bound;
+            }
+            if (picks[1] == -1 || cells[i].cost < cells[picks[1]].cost)
+                picks[1] = i;
+            if (picks[2] == -1 || size > largest)
+            {
+                picks[2] = i;
+                largest = size;
+            }
+        }
+        if (picks[0] == -1)
+            break;
+
+        for (int k = 0; k < 3; k++)
+        {
+            if ((k > 0 && picks[k] == picks[0]) || (k > 1 && picks[k] == picks[1]))
+                continue;
+            if (numEvaluations + 2 > maxEvaluations || numCells + 2 > MaxSearchCells)
+                break;
+            numCells = splitSearchCell(cells, numCells, picks[k], agent, prefVel, maxSpeed,
+                                       neighbours, neighbourVels, numNeighbours, maxTime, separation);
+            numEvaluations += 2;
+        }
+    }
+
+    for (int i = 0; i < numCells; i++)
+    {
+        if (cells[i].cost < bestCost)
+        {
+            bestCost = cells[i].cost;
+            bestVel = searchCellVel(cells[i]);
+        }
+    }
+
+    return bestVel;
+}
+
+static bool insideObstacle(const VelocityObstacle& vo, const Vec2 vel)
+{
+    if (vo.overlap)
+        return true;
+    const Vec2 w = vel - vo.apex;
+    return perp(vo.right, w) >= 0.0f && perp(w, vo.left) >= 0.0f && lenSq(w) >= sqrf(vo.minSpeed);
+}
+
+// Angles where the circle of radius rad around origin crosses the ray.
+static int circleRayCrossings(const float rad, const Vec2 start, const Vec2 dir, float* angles)
+{
+    const float b = dot(start, dir);
+    const float c = dot(start, start) - sqrf(rad);
+    const float h = b*b - c;
+    if (h < 0.0f)
+        return 0;
+    int num = 0;
+    const float sh = sqrtf(h);
+    const float r0 = -b - sh;
+    const float r1 = -b + sh;
+    if (r0 >= 0.0f)
+    {
+        const Vec2 p = start + dir * r0;
+        angles[num++] = atan2f(p.y, p.x);
+    }
+    if (r1 >= 0.0f && sh > 0.0f)
+    {
+        const Vec2 p = start + dir * r1;
+        angles[num++] = atan2f(p.y, p.x);
+    }
+    return num;
+}
+
+// Angles where the circle of radius rad around origin crosses the circle at center.
+static int circleCircleCrossings(const float rad, const Vec2 center, const float centerRad, float* angles)
+{
+    const float d = len(center);
+    if (d < 1e-6f || d > rad + centerRad || d < fabsf(rad - centerRad))
+        return 0;
+    const float a = atan2f(center.y, center.x);
+    const float half = acosf(clampf((sqrf(rad) + sqrf(d) - sqrf(centerRad)) / (2.0f * rad * d), -1.0f, 1.0f));
+    angles[0] = a - half;
+    angles[1] = a + half;
+    return 2;
+}
+
+static float wrapAngle(float a)
+{
+    while (a < -M_PI) a += M_PI*2;
+    while (a >= M_PI) a -= M_PI*2;
+    return a;
+}
+
+static int obstacleArcs(const VelocityObstacle& vo, const float speed, AngleInterval* arcs)
+{
+    float cuts[MaxObstacleArcs];
+    int numCuts = 0;
+
+    if (!vo.overlap)
+    {
+        numCuts += circleRayCrossings(speed, vo.apex, vo.left, cuts + numCuts);
+        numCuts += circleRayCrossings(speed, vo.apex, vo.right, cuts + numCuts);
+        numCuts += circleCircleCrossings(speed, vo.apex, vo.minSpeed, cuts + numCuts);
+    }
+
+    if (numCuts == 0)
+    {
+        // The whole circle is either inside or outside.
+        if (!insideObstacle(vo, Vec2(speed, 0.0f)))
+            return 0;
+        arcs[0].amin = -M_PI;
+        arcs[0].amax = M_PI;
+        return 1;
+    }
+
+    for (int i = 0; i < numCuts; i++)
+        cuts[i] = wrapAngle(cuts[i]);
+
+    // Insertion sort, there are at most 6 cuts.
+    for (int i = 1; i < numCuts; i++)
+    {
+        const float a = cuts[i];
+        int j = i - 1;
+        for (; j >= 0 && cuts[j] > a; j--)
+            cuts[j+1] = cuts[j];
+        cuts[j+1] = a;
+    }
+
+    int numArcs = 0;
+    for (int i = 0; i < numCuts; i++)
+    {
+        const float a0 = cuts[i];
+        const float a1 = i+1 < numCuts ? cuts[i+1] : cuts[0] + M_PI*2;
+        const float mid = (a0 + a1) * 0.5f;
+        if (!insideObstacle(vo, Vec2(cosf(mid), sinf(mid)) * speed))
+            continue;
+        if (a1 > M_PI)
+        {
+            arcs[numArcs].amin = a0;
+            arcs[numArcs].amax = M_PI;
+            numArcs++;
+            arcs[numArcs].amin = -M_PI;
+            arcs[numArcs].amax = a1 - M_PI*2;
+            numArcs++;
+        }
+        else
+        {
+            arcs[numArcs].amin = a0;
+            arcs[numArcs].amax = a1;
+            numArcs++;
+        }
+    }
+
+    return numArcs;
+}
+
+static int compareIntervalMin(const void* a, const void* b)
+{
+    const AngleInterval* ia = (const AngleInterval*)a;
+    const AngleInterval* ib = (const AngleInterval*)b;
+    if (ia->amin < ib->amin) return -1;
+    if (ia->amin > ib->amin) return 1;
+    return 0;
+}
+
+int freeVelocityIntervals(const VelocityObstacle* obstacles, const int numObstacles, const float speed,
+                          AngleInterval* scratch, AngleInterval* intervals, const int maxIntervals)
+{
+    int numBlocked = 0;
+    for (int i = 0; i < numObstacles; i++)
+        numBlocked += obstacleArcs(obstacles[i], speed, scratch + numBlocked);
+
+    qsort(scratch, numBlocked, sizeof(AngleInterval), compareIntervalMin);
+
+    int numFree = 0;
+    float cur = -M_PI;
+    for (int i = 0; i < numBlocked; i++)
+    {
+        if (scratch[i].amin > cur)
+        {
+            if (numFree < maxIntervals)
+            {
+                intervals[numFree].amin = cur;
+                intervals[numFree].amax = scratch[i].amin;
+            }
+            numFree++;
+        }
+        cur = maxf(cur, scratch[i].amax);
+    }
+    if (cur < M_PI)
+    {
+        if (numFree < maxIntervals)
+        {
+            intervals[numFree].amin = cur;
+            intervals[numFree].amax = M_PI;
+        }
+        numFree++;
+    }
+
+    // Join the interval starting at -pi with the one ending at pi.
+    if (numFree > 1 && numFree <= maxIntervals && intervals[0].amin <= -M_PI && intervals[numFree-1].amax >= M_PI)
+    {
+        intervals[numFree-1].amax = intervals[0].amax + M_PI*2;
+        for (int i = 1; i < numFree; i++)
+            intervals[i-1] = intervals[i];
+        numFree--;
+    }
+
+    return numFree;
+}
+
+HalfPlane orcaHalfPlane(const PreparedCollider& colA, const Vec2 velA, const PreparedCollider& colB, const Vec2 velB,
+                        const float timeHorizon, const float dt)
+{
+    const Vec2 relVel = velA - velB;
+    const DistanceRes nearest = nearestDistance(colA, Vec2(0,0), colB, Vec2(0,0));
+
+    HalfPlane plane;
+    Vec2 u;
+
+    if (nearest.dist <= 0.0f)
+    {
+        // Overlapping, separate along the normal within dt.
+        u = nearest.norm * (-nearest.dist / dt - dot(relVel, nearest.norm));
+        plane.normal = nearest.norm;
+        plane.point = velA + u * 0.5f;
+        return plane;
+    }
+
+    // Legs, starting where they touch the sum at timeHorizon.
+    const VelocityObstacle vo = velocityObstacle(colA, colB, velB, timeHorizon);
+    const Vec2 legs[2] = { vo.left, vo.right };
+    const float legStart[2] = { vo.leftDist / timeHorizon, vo.rightDist / timeHorizon };
+    const Vec2 legNormals[2] = { left(vo.left), -left(vo.right) };
+
+    float bestDistSq = 1e30f;
+    for (int i = 0; i < 2; i++)
+    {
+        const Vec2 legPt = legs[i] * maxf(legStart[i], dot(relVel, legs[i]));
+        const float d = distSq(legPt, relVel);
+        if (d < bestDistSq)
+        {
+            bestDistSq = d;
+            u = legPt - relVel;
+            plane.normal = legNormals[i];
+        }
+    }
+
+    // Cap, the sum scaled by 1/timeHorizon. Only the front between the legs bounds the obstacle.
+    // The chain distance is not signed deep inside the sum, so the cap is skipped if the sign disagrees with CPA.
+    const ApproachRes cpa = closestPointOfApproach(colA, velA, colB, velB, timeHorizon);
+    const bool collides = cpa.hit && cpa.t < timeHorizon;
+    const DistanceRes capNearest = nearestDistance(colA, velA * timeHorizon, colB, velB * timeHorizon);
+    const Vec2 capNorm = capNearest.norm;
+    const bool capFront = perp(legNormals[0], capNorm) >= 0.0f && perp(capNorm, legNormals[1]) >= 0.0f;
+    const bool capSigned = collides == (capNearest.dist < 0.0f);
+    if (capFront && capSigned && sqrf(capNearest.dist / timeHorizon) < bestDistSq)
+    {
+        u = capNorm * (-capNearest.dist / timeHorizon);
+        plane.normal = capNorm;
+    }
+
+    plane.point = velA + u * 0.5f;
+    return plane;
+}
+
+// Optimizes along the boundary of plane, constrained by the previous planes and maxSpeed.
+static bool solveOnPlane(const HalfPlane* planes, const int planeIdx, const float maxSpeed, const Vec2 optVel,
+                         const bool optDirection, Vec2& result)
+{
+    const HalfPlane& plane = planes[planeIdx];
+    const Vec2 dir = left(plane.normal);
+
+    const float dotProduct = dot(plane.point, dir);
+    const float discriminant = sqrf(dotProduct) + sqrf(maxSpeed) - lenSq(plane.point);
+    if (discriminant < 0.0f)
+        return false;
+
+    const float sqrtDisc = sqrtf(discriminant);
+    float tmin = -dotProduct - sqrtDisc;
+    float tmax = -dotProduct + sqrtDisc;
+
+    for (int i = 0; i < planeIdx; i++)
+    {
+        const float denom = dot(dir, planes[i].normal);
+        const float numer = dot(plane.point - planes[i].point, planes[i].normal);
+        if (fabsf(denom) <= 1e-6f)
+        {
+            // Parallel planes.
+            if (numer < 0.0f)
+                return false;
+            continue;
+        }
+
+        const float t = -numer / denom;
+        if (denom > 0.0f)
+            tmin = maxf(tmin, t);
+        else
+            tmax = minf(tmax, t);
+
+        if (tmin > tmax)
+            return false;
+    }
+
+    if (optDirection)
+    {
+        result = plane.point + dir * (dot(optVel, dir) > 0.0f ? tmax : tmin);
+    }
+    else
+    {
+        const float t = clampf(dot(dir, optVel - plane.point), tmin, tmax);
+        result = plane.point + dir * t;
+    }
+
+    return true;
+}
+
+// Returns the number of planes, or the index of the plane that could not be satisfied.
+static int solvePlanes(const HalfPlane* planes, const int numPlanes, const float maxSpeed, const Vec2 optVel,
+                       const bool optDirection, Vec2& result)
+{
+    if (optDirection)
+        result = optVel * maxSpeed;
+    else
+        result = clamp(optVel, maxSpeed);
+
+    for (int i = 0; i < numPlanes; i++)
+    {
+        if (dot(result - planes[i].point, planes[i].normal) < 0.0f)
+        {
+            const Vec2 prevResult = result;
+            if (!solveOnPlane(planes, i, maxSpeed, optVel, optDirection, result))
+            {
+                result = prevResult;
+                return i;
+            }
+        }
+    }
+
+    return numPlanes;
+}
+
+// Minimizes the largest violation of the planes from failedPlane onwards.
+static void solveLeastViolation(const HalfPlane* planes, const int numPlanes, const int failedPlane, const float maxSpeed,
+                                Vec2& result)
+{
+    HalfPlane projPlanes[MaxOrcaNeighbours];
+    float violation = 0.0f;
+
+    for (int i = failedPlane; i < numPlanes; i++)
+    {
+        if (-dot(result - planes[i].point, planes[i].normal) <= violation)
+            continue;
+
+        const HalfPlane& plane = planes[i];
+        const Vec2 dir = left(plane.normal);
+        int numProj = 0;
+
+        for (int j = 0; j < i; j++)
+        {
+            HalfPlane proj;
+            const float denom = dot(dir, planes[j].normal);
+            if (fabsf(denom) <= 1e-6f)
+            {
+                // Parallel planes pointing the same way do not constrain the violation.
+                if (dot(plane.normal, planes[j].normal) > 0.0f)
+                    continue;
+                proj.point = (plane.point + planes[j].point) * 0.5f;
+            }
+            else
+            {
+                proj.point = plane.point + dir * (-dot(plane.point - planes[j].point, planes[j].normal) / denom);
+            }
+            proj.normal = norm(planes[j].normal - plane.normal);
+            projPlanes[numProj++] = proj;
+        }
+
+        const Vec2 prevResult = result;
+        if (solvePlanes(projPlanes, numProj, maxSpeed, plane.normal, true, result) < numProj)
+        {
+            // Can only fail due to numerical precision, keep the previous result.
+            result = prevResult;
+        }
+
+        violation = -dot(result - plane.point, plane.normal);
+    }
+}
+
+Vec2 solveHalfPlanes(const HalfPlane* planes, const int numPlanes, const Vec2 prefVel, const float maxSpeed)
+{
+    const int num = mini(numPlanes, MaxOrcaNeighbours);
+    Vec2 result;
+    const int failedPlane = solvePlanes(planes, num, maxSpeed, prefVel, false, result);
+    if (failedPlane < num)
+        solveLeastViolation(planes, num, failedPlane, maxSpeed, result);
+    return result;
+}
+
+void orcaVelocities(const PreparedCollider* agents, const Vec2* vels, const Vec2* prefVels, const int numAgents,
+                    const int* neighbourStart, const int* neighbourIds, const float maxSpeed,
+                    const float timeHorizon, const float dt, Vec2* newVels)
+{
+    TRACE_SCOPE("orcaVelocities");
+    ScopedFlushDenormals ftz;
+    HalfPlane planes[MaxOrcaNeighbours];
+
+    for (int i = 0; i < numAgents; i++)
+    {
+        const int first = neighbourStart[i];
+        const int numPlanes = mini(neighbourStart[i+1] - first, MaxOrcaNeighbours);
+        for (int j = 0; j < numPlanes; j++)
+        {
+            const int other = neighbourIds[first + j];
+            planes[j] = orcaHalfPlane(agents[i], vels[i], agents[other], vels[other], timeHorizon, dt);
+        }
+        newVels[i] = solveHalfPlanes(planes, numPlanes, prefVels[i], maxSpeed);
+    }
+}
+
+static int compareRiskTime(const void* a, const void* b)
+{
+    const AgentRisk* ra = (const AgentRisk*)a;
+    const AgentRisk* rb = (const AgentRisk*)b;
+    if (ra->t < rb->t) return -1;
+    if (ra->t > rb->t) return 1;
+    return ra->agent - rb->agent;
+}
+
+AnytimeStats anytimeVelocities(const PreparedCollider* agents, const Vec2* vels, const Vec2* prefVels, const int numAgents,
+                               const int* neighbourStart, const int* neighbourIds, const float maxSpeed,
+                               const float maxTime, const float separation, const float dt, const int budget,
+                               const int maxAgentEvaluations, AgentRisk* scratch, Vec2* newVels)
+{
+    TRACE_SCOPE("anytimeVelocities");
+    ScopedFlushDenormals ftz;
+    AnytimeStats stats;
+    stats.budget = budget;
+
+    // Rank the agents by when the bounding circles of the preferred velocity come within separation. The bound is
+    // conservative, searchVelocity() returns after one evaluation if the preferred velocity turns out to be safe.
+    int numRisky = 0;
+    for (int i = 0; i < numAgents; i++)
+    {
+        const int first = neighbourStart[i];
+        const int numNeighbours = mini(neighbourStart[i+1] - first, MaxOrcaNeighbours);
+        const Vec2 prefVel = clamp(prefVels[i], maxSpeed);
+        float risk = maxTime;
+        for (int j = 0; j < numNeighbours; j++)
+        {
+            const int other = neighbourIds[first + j];
+            const Vec2 relPos = agents[i].pos - agents[other].pos;
+            const float rad = agents[i].circumRad + agents[other].circumRad + separation;
+            float t = 0.0f;
+            if (lenSq(relPos) < sqrf(rad))
+            {
+                // Deeper overlaps first.
+                t = (len(relPos) - rad) / maxSpeed;
+            }
+            else
+            {
+                const Vec2 relVel = prefVel - vels[other];
+                if (lenSq(relVel) < 1e-12f || !circleCircleCPA(relPos, relVel, rad, Vec2(0,0), t) || t < 0.0f)
+                    continue;
+            }
+            risk = minf(risk, t);
+        }
+        stats.rankEvaluations += numNeighbours;
+
+        if (risk < maxTime)
+        {
+            scratch[numRisky].t = risk;
+            scratch[numRisky].agent = i;
+            numRisky++;
+        }
+        else
+        {
+            newVels[i] = prefVel;
+            stats.numPreferred++;
+        }
+    }
+
+    qsort(scratch, numRisky, sizeof(AgentRisk), compareRiskTime);
+
+    // The second half of scratch holds the place of each agent in the search order, -1 once its new velocity is known.
+    AgentRisk* order = scratch + numAgents;
+    for (int i = 0; i < numAgents; i++)
+        order[i].agent = -1;
+    for (int k = 0; k < numRisky; k++)
+        order[scratch[k].agent].agent = k;
+
+    // Visit the most urgent agents first, each gets an equal share of the budget that is left. While the share is too
+    // small for a search, the agent takes the ORCA velocity instead, and the share of the rest grows. The most urgent
+    // agents are usually overlapping already, and ORCA pushes them apart within dt, while the search is spent on the
+    // collisions ahead. Searching the most urgent agents until the budget runs out left more overlaps than ORCA.
+    // The searched agents avoid the new velocities already chosen this tick, and take half of the avoidance
+    // against the agents that are still to be searched, like in reciprocal velocity obstacles.
+    PreparedCollider neighbours[MaxOrcaNeighbours];
+    Vec2 neighbourVels[MaxOrcaNeighbours];
+    HalfPlane planes[MaxOrcaNeighbours];
+    for (int k = 0; k < numRisky; k++)
+    {
+        const int i = scratch[k].agent;
+        const int first = neighbourStart[i];
+        const int numNeighbours = mini(neighbourStart[i+1] - first, MaxOrcaNeighbours);
+
+        order[i].agent = -1;
+
+        const int share = (budget - stats.searchEvaluations) / (maxi(1, numNeighbours) * (numRisky - k));
+        const int maxEvaluations = mini(maxAgentEvaluations, share);
+        if (maxEvaluations <= SearchRingSize)
+        {
+            // Same as orcaVelocities(), a query per neighbour.
+            for (int j = 0; j < numNeighbours; j++)
+            {
+                const int other = neighbourIds[first + j];
+                planes[j] = orcaHalfPlane(agents[i], vels[i], agents[other], vels[other], maxTime, dt);
+            }
+            newVels[i] = solveHalfPlanes(planes, numNeighbours, prefVels[i], maxSpeed);
+            stats.fallbackQueries += numNeighbours;
+            stats.numFallback++;
+            continue;
+        }
+
+        for (int j = 0; j < numNeighbours; j++)
+        {
+            const int other = neighbourIds[first + j];
+            neighbours[j] = agents[other];
+            neighbourVels[j] = order[other].agent == -1 ? newVels[other] : (vels[other] + vels[i]) * 0.5f;
+        }
+
+        int numEvaluations = 0;
+        newVels[i] = searchVelocity(agents[i], prefVels[i], maxSpeed, neighbours, neighbourVels, numNeighbours,
+                                    maxTime, separation, maxEvaluations, numEvaluations);
+        stats.searchEvaluations += numEvaluations * numNeighbours;
+        stats.numSearched++;
+    }
+
+    return stats;
+}
+
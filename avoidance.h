@@ -0,0 +1,164 @@
+//
+// Copyright (c) 2021 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef AVOIDANCE_H
+#define AVOIDANCE_H
+
+#include "distance.h"
+
+// Penalty of a single neighbour for a candidate velocity, based on the distance and time at
+// closest point of approach. Zero when further than separation, at least half when touching
+// at any time within maxTime, and one when touching right now.
+// F is float or a wide lane type from mathutil.h.
+template<typename F>
+inline F candidatePenalty(const F t, const F dist, const float maxTime, const float separation)
+{
+    const F proximity = 1.0f - clampf(dist / separation, 0.0f, 1.0f);
+    const F urgency = 1.0f - t / maxTime;
+    return proximity * (proximity + urgency) * 0.5f;
+}
+
+// Weight of candidatePenalty() against the squared deviation from the preferred velocity relative to maxSpeed.
+// Touching costs more than any velocity within maxSpeed deviates, so a distant hit is never cheaper than turning.
+static const float CandidatePenaltyWeight = 8.0f;
+
+// Evaluates candidate velocities of an agent against neighbours, and stores the highest candidatePenalty()
+// of each candidate in costs. The per neighbour invariants are calculated once, and the pairs are evaluated
+// in batches across the candidates. For the pairs that need a Minkowski sum, the candidates are grouped by
+// the chains they face, and the sum is built once per group.
+void evaluateVelocityCandidates(const PreparedCollider& agent, const Vec2* candidates, const int numCandidates,
+                                const PreparedCollider* neighbours, const Vec2* neighbourVels, const int numNeighbours,
+                                const float maxTime, const float separation, float* costs);
+
+// Instruction set variants of the batched kernels in evaluateVelocityCandidates(). The widest one the CPU
+// supports is picked at startup, the CPA_KERNELS environment variable (scalar, sse, avx2 or avx512) forces
+// a variant for testing.
+enum class KernelVariant
+{
+    Scalar,
+    SSE,
+    AVX2,
+    AVX512,
+};
+static const int NumKernelVariants = 4;
+
+const char* kernelVariantName(const KernelVariant variant);
+bool kernelVariantSupported(const KernelVariant variant);
+KernelVariant currentKernelVariant();
+
+// Switches the kernels used by all threads, returns false and keeps the current variant if the CPU does not support it.
+bool setKernelVariant(const KernelVariant variant);
+
+// Finds a velocity close to prefVel that stays separation away from the neighbours within maxTime, by
+// taking gradient steps on the distance at CPA (see closestPointOfApproachGrad()) instead of sampling.
+// The step is halved each time it does not improve, and the best velocity found is returned.
+Vec2 optimizeVelocity(const PreparedCollider& agent, const Vec2 prefVel, const float maxSpeed,
+                      const PreparedCollider* neighbours, const Vec2* neighbourVels, const int numNeighbours,
+                      const float maxTime, const float separation, const int maxIterations);
+
+// Number of cells in the coarse ring of searchVelocity(), and the most cells it can refine to.
+static const int SearchRingSize = 12;
+static const int MaxSearchCells = 256;
+
+// Finds a velocity close to prefVel that avoids the neighbours, using the highest candidatePenalty() at CPA, or for
+// the neighbours that are already touching, half when sliding along, more when approaching, less when moving apart.
+// The preferred and zero velocities and a coarse ring of polar cells are evaluated first. Then each step splits
+// in three the cell where the cost could be lowest, the cell with the lowest cost, and the largest cell, which
+// refines near the optimum and where the cost changes sharply without leaving parts of the ring unexplored.
+// Stops after maxEvaluations velocities, and stores the number used in numEvaluations. Each evaluation is a CPA
+// and distance query per neighbour.
+Vec2 searchVelocity(const PreparedCollider& agent, const Vec2 prefVel, const float maxSpeed,
+                    const PreparedCollider* neighbours, const Vec2* neighbourVels, const int numNeighbours,
+                    const float maxTime, const float separation, const int maxEvaluations, int& numEvaluations);
+
+struct AngleInterval
+{
+    float amin = 0.0f;
+    float amax = 0.0f;
+};
+
+// Maximum number of blocked arcs a single velocity obstacle can produce, see freeVelocityIntervals().
+static const int MaxObstacleArcs = 8;
+
+// Finds the headings of velocities with the given speed that are outside all the velocity obstacles.
+// The angles are atan2 angles, intervals start in [-pi,pi], and the interval wrapping around pi ends past pi.
+// The blocked arcs are collected into scratch, which needs room for MaxObstacleArcs per obstacle, and merged
+// by sorting, O(n log n). Returns number of free intervals, at most maxIntervals are stored.
+int freeVelocityIntervals(const VelocityObstacle* obstacles, const int numObstacles, const float speed,
+                          AngleInterval* scratch, AngleInterval* intervals, const int maxIntervals);
+
+// Velocities v with dot(v - point, normal) >= 0 are allowed.
+struct HalfPlane
+{
+    Vec2 point;
+    Vec2 normal;
+};
+
+// Maximum number of neighbours per agent used by orcaVelocities().
+static const int MaxOrcaNeighbours = 32;
+
+// ORCA half-plane of A against B, where both take half of the responsibility of avoiding the collision.
+// The truncated velocity obstacle is bounded by the edges of velocityObstacle() and by the front of the
+// Minkowski sum scaled to timeHorizon, whose nearest point is found with nearestDistance() at timeHorizon.
+// Overlapping bodies are pushed apart within dt.
+HalfPlane orcaHalfPlane(const PreparedCollider& colA, const Vec2 velA, const PreparedCollider& colB, const Vec2 velB,
+                        const float timeHorizon, const float dt);
+
+// Incremental 2D linear program, returns the velocity closest to prefVel within maxSpeed that satisfies
+// all planes. If there is none, returns the velocity that violates the planes the least.
+// At most MaxOrcaNeighbours planes are used, nothing is allocated.
+Vec2 solveHalfPlanes(const HalfPlane* planes, const int numPlanes, const Vec2 prefVel, const float maxSpeed);
+
+// Calculates new velocity for each agent. The neighbours of agent i are the agents
+// neighbourIds[neighbourStart[i]] .. neighbourIds[neighbourStart[i+1]-1].
+void orcaVelocities(const PreparedCollider* agents, const Vec2* vels, const Vec2* prefVels, const int numAgents,
+                    const int* neighbourStart, const int* neighbourIds, const float maxSpeed,
+                    const float timeHorizon, const float dt, Vec2* newVels);
+
+// Earliest time an agent may come too close to a neighbour, used to order the agents in anytimeVelocities().
+struct AgentRisk
+{
+    float t = 0.0f;
+    int agent = 0;
+};
+
+struct AnytimeStats
+{
+    int budget = 0;
+    int rankEvaluations = 0;    // bounding circle tests used to rank the agents.
+    int searchEvaluations = 0;  // CPA and distance queries used by the searches, at most budget.
+    int numPreferred = 0;       // agents whose preferred velocity was safe.
+    int numSearched = 0;        // agents whose velocity was searched.
+    int numFallback = 0;        // agents that took the ORCA velocity instead of a search.
+    int fallbackQueries = 0;    // half-planes built for the fallback agents, not part of the budget.
+};
+
+// Calculates new velocity for each agent within a budget of CPA and distance queries per tick.
+// All agents are ranked by when the bounding circles come within separation with the preferred velocity,
+// which costs a circle test per neighbour and is not part of the budget. Agents that cannot come close take the
+// preferred velocity. The rest are visited from the most urgent, and each gets an equal share of the budget left,
+// at most maxAgentEvaluations velocities of searchVelocity(). When the share is too small for a search, the agent
+// takes the velocity orcaVelocities() would give it with timeHorizon of maxTime, at one query per neighbour.
+// Each search avoids the new velocities chosen before it, and takes half of the avoidance against the agents
+// visited after it. Scratch needs room for 2*numAgents items. The neighbours are passed like in orcaVelocities().
+AnytimeStats anytimeVelocities(const PreparedCollider* agents, const Vec2* vels, const Vec2* prefVels, const int numAgents,
+                               const int* neighbourStart, const int* neighbourIds, const float maxSpeed,
+                               const float maxTime, const float separation, const float dt, const int budget,
+                               const int maxAgentEvaluations, AgentRisk* scratch, Vec2* newVels);
+
+#endif // AVOIDANCE_H
@@ -0,0 +1,55 @@
+// AVX2 variant of the batched candidate kernels. The file is compiled for AVX2 and FMA whatever the build
+// flags are, and the kernels are only called when the CPU supports them, see selectKernelVariant().
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+// Multiplies and adds are not fused, so that the results match the scalar and SSE kernels.
+// The chain kernels test grazing paths where a rounding difference flips a hit.
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2,fma")
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#define MATHUTIL_TARGET_AVX2
+#include "avoidancekernels.h"
+
+static void circleCircleCandidatesAVX2(CandidateBatch& batch, const CircleCircleConsts& k)
+{
+    circleCircleCandidates<Floatx8>(batch, k);
+}
+
+static void circlePillCandidatesAVX2(CandidateBatch& batch, const CirclePillConsts& k)
+{
+    circlePillCandidates<Floatx8>(batch, k);
+}
+
+static void chainApproachCandidatesAVX2(ChainBatch& batch, const ChainSumConsts& k)
+{
+    chainApproachCandidates<Floatx8>(batch, k);
+}
+
+static void chainDistanceCandidatesAVX2(ChainBatch& batch, const ChainSumConsts& k)
+{
+    chainDistanceCandidates<Floatx8>(batch, k);
+}
+
+extern const CandidateKernels candidateKernelsAVX2 = { circleCircleCandidatesAVX2, circlePillCandidatesAVX2,
+                                                       chainApproachCandidatesAVX2, chainDistanceCandidatesAVX2, 8 };
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#else
+
+#include "avoidancekernels.h"
+
+extern const CandidateKernels candidateKernelsAVX2 = { nullptr, nullptr, nullptr, nullptr, 0 };
+
+#endif
@@ -0,0 +1,57 @@
+// AVX-512 variant of the batched candidate kernels. The file is compiled for AVX-512F whatever the build
+// flags are, and the kernels are only called when the CPU supports them, see selectKernelVariant().
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+// Multiplies and adds are not fused, so that the results match the scalar and SSE kernels.
+// The chain kernels test grazing paths where a rounding difference flips a hit.
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f,avx2,fma"))), apply_to = function)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC target("avx512f,avx2,fma")
+#pragma GCC optimize("fp-contract=off")
+// The AVX-512 intrinsics of some GCC versions warn about their own _mm512_undefined_ps().
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define MATHUTIL_TARGET_AVX512
+#include "avoidancekernels.h"
+
+static void circleCircleCandidatesAVX512(CandidateBatch& batch, const CircleCircleConsts& k)
+{
+    circleCircleCandidates<Floatx16>(batch, k);
+}
+
+static void circlePillCandidatesAVX512(CandidateBatch& batch, const CirclePillConsts& k)
+{
+    circlePillCandidates<Floatx16>(batch, k);
+}
+
+static void chainApproachCandidatesAVX512(ChainBatch& batch, const ChainSumConsts& k)
+{
+    chainApproachCandidates<Floatx16>(batch, k);
+}
+
+static void chainDistanceCandidatesAVX512(ChainBatch& batch, const ChainSumConsts& k)
+{
+    chainDistanceCandidates<Floatx16>(batch, k);
+}
+
+extern const CandidateKernels candidateKernelsAVX512 = { circleCircleCandidatesAVX512, circlePillCandidatesAVX512,
+                                                         chainApproachCandidatesAVX512, chainDistanceCandidatesAVX512, 16 };
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#else
+
+#include "avoidancekernels.h"
+
+extern const CandidateKernels candidateKernelsAVX512 = { nullptr, nullptr, nullptr, nullptr, 0 };
+
+#endif
@@ -0,0 +1,332 @@
+//
+// Copyright (c) 2021 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+
+#ifndef AVOIDANCEKERNELS_H
+#define AVOIDANCEKERNELS_H
+
+#include "avoidance.h"
+
+// Batched candidate kernels of evaluateVelocityCandidates(), shared by avoidance.cpp and the files that
+// compile them for wider instruction sets. The kernels only take the per neighbour constants calculated
+// by the caller, so that no scalar helpers get compiled for an instruction set the CPU may not have.
+
+static const int CandidateBatchSize = 64;
+
+// Widest lanes of any variant, the batches are padded to a multiple of it.
+static const int MaxCandidateLanes = 16;
+
+// Same tolerances as the stationary and parallel motion tests of closestPointOfApproach() and circleSegmentCPA(),
+// and the degenerate segments of circleSegmentBodyTOI().
+static const float CandidateStationarySpeedSq = 1e-12f;
+static const float CandidateParallelSinSq = 1e-6f;
+static const float CandidateDegenerateSegSq = 1e-12f;
+
+// Candidate velocities of one batch in SoA layout.
+struct CandidateBatch
+{
+    float vx[CandidateBatchSize];
+    float vy[CandidateBatchSize];
+    float cost[CandidateBatchSize];
+    int num;
+};
+
+// Candidates of the chain pairs, sorted into groups that face the same chains. Each group starts at
+// a multiple of the lane count, so that the kernels never mix two groups in one register. index is
+// the position of the candidate in the CandidateBatch, -1 for padding.
+static const int MaxChainGroups = 16;
+static const int ChainBatchSize = CandidateBatchSize + MaxChainGroups * MaxCandidateLanes;
+
+struct ChainBatch
+{
+    float vx[ChainBatchSize];
+    float vy[ChainBatchSize];
+    float t[ChainBatchSize];
+    float cost[ChainBatchSize];
+    int index[ChainBatchSize];
+    int num;
+};
+
+// Minkowski sum of the chains of one group, and the candidates start to end it applies to.
+struct ChainSumConsts
+{
+    Vec2 sum[5];
+    int numSum;
+    int start;
+    int end;
+    Vec2 relPos;
+    Vec2 velB;
+    float totalRad;
+    float maxTime;
+    float separation;
+};
+
+struct CircleCircleConsts
+{
+    Vec2 relPos;
+    Vec2 velB;
+    float c;
+    float totalRad;
+    float maxTime;
+    float separation;
+};
+
+struct CirclePillConsts
+{
+    Vec2 relPos;
+    Vec2 velB;
+    Vec2 stem;
+    Vec2 segDir;
+    Vec2 relPosStart;
+    Vec2 relPosEnd;
+    float segDirSq;
+    float dirRelPos;
+    float c;
+    float stemInvSq;
+    float totalRad;
+    float maxTime;
+    float separation;
+};
+
+template<typename F>
+static void circleCircleCandidates(CandidateBatch& batch, const CircleCircleConsts& k)
+{
+    typedef typename LaneTraits<F>::Vec V;
+    const V relPos(k.relPos);
+    const V velB(k.velB);
+
+    for (int i = 0; i < batch.num; i += LaneTraits<F>::Lanes)
+    {
+        V vel;
+        F cost;
+        loadLanes(vel.x, &batch.vx[i]);
+        loadLanes(vel.y, &batch.vy[i]);
+        loadLanes(cost, &batch.cost[i]);
+
+        const V relVel = vel - velB;
+        const F a = dot(relVel, relVel);
+        const F b = dot(relVel, relPos);
+        const F h = maxf(0.0f, b*b - a*k.c);
+        const F inva = select(a >= CandidateStationarySpeedSq, 1.0f / a, F(0.0f));
+        const F t = clampf((-b - sqrtf(h)) * inva, 0.0f, k.maxTime);
+
+        const F dist = len(relPos + relVel * t) - k.totalRad;
+
+        storeLanes(&batch.cost[i], maxf(cost, candidatePenalty(t, dist, k.maxTime, k.separation)));
+    }
+}
+
+// Same as circleSegmentCPA() and circlePillDistance() for a segment from -stem to stem, without branches.
+template<typename F>
+static void circlePillCandidates(CandidateBatch& batch, const CirclePillConsts& k)
+{
+    typedef typename LaneTraits<F>::Vec V;
+    typedef typename LaneTraits<F>::Mask M;
+    const V relPos(k.relPos);
+    const V velB(k.velB);
+    const V stem(k.stem);
+    const V segDir(k.segDir);
+    const V relPosStart(k.relPosStart);
+    const V relPosEnd(k.relPosEnd);
+
+    for (int i = 0; i < batch.num; i += LaneTraits<F>::Lanes)
+    {
+        V vel;
+        F cost;
+        loadLanes(vel.x, &batch.vx[i]);
+        loadLanes(vel.y, &batch.vy[i]);
+        loadLanes(cost, &batch.cost[i]);
+
+        const V relVel = vel - velB;
+        const F velSq = dot(relVel, relVel);
+        const F dirVel = dot(relVel, segDir);
+        const F velRelPos = dot(relVel, relPosStart);
+
+        // body
+        const F a = k.segDirSq*velSq - dirVel*dirVel;
+        const F b = k.segDirSq*velRelPos - k.dirRelPos*dirVel;
+        const F h = maxf(0.0f, b*b - a*k.c);
+        const M parallel = fabsf(a) <= CandidateParallelSinSq * k.segDirSq * velSq;
+        const F inva = select(parallel, F(0.0f), 1.0f / a);
+        const F t0 = (-b - sqrtf(h)) * inva;
+        const F y = k.dirRelPos + t0 * dirVel;
+        const M body = (!parallel) & (y > 0.0f) & (y < k.segDirSq);
+
+        // caps
+        const M startCap = (parallel & (dirVel > 0.0f)) | ((!parallel) & (y <= 0.0f));
+        const V capRelPos = select(startCap, relPosStart, relPosEnd);
+        const F cb = dot(relVel, capRelPos);
+        const F cc = dot(capRelPos, capRelPos) - sqrf(k.totalRad);
+        const F ch = maxf(0.0f, cb*cb - velSq*cc);
+        const F invVelSq = select(velSq >= CandidateStationarySpeedSq, 1.0f / velSq, F(0.0f));
+        const F t1 = (-cb - sqrtf(ch)) * invVelSq;
+
+        const F t = clampf(select(body, t0, t1), 0.0f, k.maxTime);
+
+        // Distance to the stem at CPA.
+        const V p = relPos + relVel * t;
+        const F s = clampf(dot(p, stem) * k.stemInvSq, -1.0f, 1.0f);
+        const F dist = len(p - stem * s) - k.totalRad;
+
+        storeLanes(&batch.cost[i], maxf(cost, candidatePenalty(t, dist, k.maxTime, k.separation)));
+    }
+}
+
+// Same as sumApproach() for a group of candidates, stores t at CPA. Segment bodies are tested in order and
+// the first hit wins, then the nearest cap hit, and a path that passes the sum gets the CPA of its nearer end.
+template<typename F>
+static void chainApproachCandidates(ChainBatch& batch, const ChainSumConsts& k)
+{
+    typedef typename LaneTraits<F>::Vec V;
+    typedef typename LaneTraits<F>::Mask M;
+    const V relPos(k.relPos);
+    const V velB(k.velB);
+    const float radSq = sqrf(k.totalRad);
+    const Vec2 first = k.sum[0];
+    const Vec2 last = k.sum[k.numSum-1];
+
+    for (int i = k.start; i < k.end; i += LaneTraits<F>::Lanes)
+    {
+        V vel;
+        loadLanes(vel.x, &batch.vx[i]);
+        loadLanes(vel.y, &batch.vy[i]);
+
+        const V relVel = vel - velB;
+        const F velSq = dot(relVel, relVel);
+        const M moving = velSq >= CandidateStationarySpeedSq;
+        const F invVelSq = select(moving, 1.0f / velSq, F(0.0f));
+
+        // Paths that pass the sum on one side get the CPA of the end on that side.
+        const V testDir = norm(relVel);
+        const F firstDist = perp(testDir, V(first) - relPos) + k.totalRad;
+        const F lastDist = perp(testDir, V(last) - relPos) - k.totalRad;
+        const M miss = firstDist * lastDist > 0.0f;
+        const V missRelPos = relPos - select(fabsf(firstDist) < fabsf(lastDist), V(first), V(last));
+        const F mb = dot(relVel, missRelPos);
+        const F mh = maxf(0.0f, mb*mb - velSq * (dot(missRelPos, missRelPos) - radSq));
+        const F missT = (-mb - sqrtf(mh)) * invVelSq;
+
+        // Segment bodies, same as circleSegmentBodyTOI().
+        M segHit = F(0.0f) > 0.0f;
+        F segT = 0.0f;
+        for (int j = 0; j < k.numSum-1; j++)
+        {
+            const Vec2 segDir = k.sum[j+1] - k.sum[j];
+            const Vec2 segRelPos = k.relPos - k.sum[j];
+            const float segDirSq = dot(segDir, segDir);
+            if (segDirSq <= CandidateDegenerateSegSq)
+                continue;
+            const float dirRelPos = dot(segDir, segRelPos);
+            const float c = segDirSq*dot(segRelPos, segRelPos) - dirRelPos*dirRelPos - radSq*segDirSq;
+            const F dirVel = dot(relVel, V(segDir));
+            const F velRelPos = dot(relVel, V(segRelPos));
+            const F a = segDirSq*velSq - dirVel*dirVel;
+            const F b = segDirSq*velRelPos - dirRelPos*dirVel;
+            const F h = maxf(0.0f, b*b - a*c);
+            const M valid = fabsf(a) > CandidateParallelSinSq * segDirSq * velSq;
+            const F t0 = (-b - sqrtf(h)) * select(valid, 1.0f / a, F(0.0f));
+            const F y = dirRelPos + t0 * dirVel;
+            const M hit = valid & (y > 0.0f) & (y < segDirSq) & (!segHit);
+            segT = select(hit, t0, segT);
+            segHit = segHit | hit;
+        }
+
+        // Caps, the nearest hit.
+        F capT = 1e6f;
+        for (int j = 0; j < k.numSum; j++)
+        {
+            const V capRelPos = relPos - V(k.sum[j]);
+            const F cb = dot(relVel, capRelPos);
+            const F ch = cb*cb - velSq * (dot(capRelPos, capRelPos) - radSq);
+            const F t1 = (-cb - sqrtf(maxf(0.0f, ch))) * invVelSq;
+            capT = select((ch > 0.0f) & (t1 < capT), t1, capT);
+        }
+
+        const F t = select(miss, missT, select(segHit, segT, capT));
+        storeLanes(&batch.t[i], select(moving, clampf(t, 0.0f, k.maxTime), F(0.0f)));
+    }
+}
+
+// Same as nearestOnChain() at the t stored by chainApproachCandidates(), for a group of candidates facing
+// the same chains at CPA. Stores the candidatePenalty().
+template<typename F>
+static void chainDistanceCandidates(ChainBatch& batch, const ChainSumConsts& k)
+{
+    typedef typename LaneTraits<F>::Vec V;
+    typedef typename LaneTraits<F>::Mask M;
+    const V relPos(k.relPos);
+    const V velB(k.velB);
+
+    for (int i = k.start; i < k.end; i += LaneTraits<F>::Lanes)
+    {
+        V vel;
+        F t;
+        loadLanes(vel.x, &batch.vx[i]);
+        loadLanes(vel.y, &batch.vy[i]);
+        loadLanes(t, &batch.t[i]);
+
+        const V p = relPos + (vel - velB) * t;
+
+        // Nearest vertex, the first one on ties.
+        F distSq = 1e6f;
+        F vertex = -1.0f;
+        for (int j = 0; j < k.numSum; j++)
+        {
+            const F d = lenSq(p - V(k.sum[j]));
+            const M nearer = d < distSq;
+            distSq = select(nearer, d, distSq);
+            vertex = select(nearer, F((float)j), vertex);
+        }
+
+        // The segment bodies on either side of the nearest vertex.
+        for (int j = 0; j < k.numSum-1; j++)
+        {
+            const Vec2 seg = k.sum[j+1] - k.sum[j];
+            const float segSq = dot(seg, seg);
+            if (segSq < 1e-6f)
+                continue;
+            const V rel = p - V(k.sum[j]);
+            const F s = dot(rel, V(seg)) / segSq;
+            const F d = lenSq(rel - V(seg) * s);
+            const M around = (vertex > (float)j - 0.5f) & (vertex < (float)j + 1.5f);
+            const M nearer = around & (s > 0.0f) & (s < 1.0f) & (d < distSq);
+            distSq = select(nearer, d, distSq);
+        }
+
+        F cost;
+        loadLanes(cost, &batch.cost[i]);
+        const F dist = sqrtf(distSq) - k.totalRad;
+        storeLanes(&batch.cost[i], maxf(cost, candidatePenalty(t, dist, k.maxTime, k.separation)));
+    }
+}
+
+// One instruction set variant of the kernels.
+struct CandidateKernels
+{
+    void (*circleCircle)(CandidateBatch& batch, const CircleCircleConsts& k);
+    void (*circlePill)(CandidateBatch& batch, const CirclePillConsts& k);
+    void (*chainApproach)(ChainBatch& batch, const ChainSumConsts& k);
+    void (*chainDistance)(ChainBatch& batch, const ChainSumConsts& k);
+    int lanes;
+};
+
+// Defined in avoidance_avx2.cpp and avoidance_avx512.cpp, the functions are null on targets other than x86.
+extern const CandidateKernels candidateKernelsAVX2;
+extern const CandidateKernels candidateKernelsAVX512;
+
+#endif // AVOIDANCEKERNELS_H
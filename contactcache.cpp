@@ -0,0 +1,86 @@
+#include "contactcache.h"
+
+static const uint64_t EmptyKey = ~0ull;
+
+static inline uint64_t pairKey(const uint32_t idA, const uint32_t idB)
+{
+    return ((uint64_t)idA << 32) | (uint64_t)idB;
+}
+
+// Fibonacci hashing, the top bits are used as the slot.
+static inline int keySlot(const uint64_t key, const int shift)
+{
+    return (int)((key * 0x9E3779B97F4A7C15ull) >> shift);
+}
+
+ContactCache::ContactCache(const int cap)
+{
+    int bits = 4;
+    while ((1 << bits) < cap)
+        bits++;
+    capacity = 1 << bits;
+    shift = 64 - bits;
+    entries = new ContactCacheEntry[capacity];
+    scratch = new ContactCacheEntry[capacity];
+}
+
+ContactCache::~ContactCache()
+{
+    delete [] entries;
+    delete [] scratch;
+}
+
+ContactCacheEntry* ContactCache::get(const uint32_t idA, const uint32_t idB)
+{
+    const uint64_t key = pairKey(idA, idB);
+    const int mask = capacity - 1;
+
+    for (int i = keySlot(key, shift); ; i = (i + 1) & mask)
+    {
+        ContactCacheEntry& entry = entries[i];
+        if (entry.key == key)
+        {
+            entry.lastTick = tick;
+            return &entry;
+        }
+        if (entry.key == EmptyKey)
+        {
+            // Keep load factor below 3/4 so that the probe sequences stay short.
+            if (numEntries >= capacity - capacity / 4)
+                return nullptr;
+            entry = ContactCacheEntry();
+            entry.key = key;
+            entry.lastTick = tick;
+            numEntries++;
+            return &entry;
+        }
+    }
+}
+
+void ContactCache::nextTick()
+{
+    // Rehash the live entries, this removes the aged out entries without leaving tombstones.
+    const int mask = capacity - 1;
+
+    for (int i = 0; i < capacity; i++)
+        scratch[i].key = EmptyKey;
+
+    numEntries = 0;
+    for (int i = 0; i < capacity; i++)
+    {
+        const ContactCacheEntry& entry = entries[i];
+        if (entry.key == EmptyKey || entry.lastTick != tick)
+            continue;
+        int j = keySlot(entry.key, shift);
+        while (scratch[j].key != EmptyKey)
+            j = (j + 1) & mask;
+        scratch[j] = entry;
+        numEntries++;
+    }
+
+    ContactCacheEntry* tmp = entries;
+    entries = scratch;
+    scratch = tmp;
+
+    tick++;
+}
@@ -0,0 +1,60 @@
+//
+// Copyright (c) 2021 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef CONTACTCACHE_H
+#define CONTACTCACHE_H
+
+#include "distance.h"
+#include <stdint.h>
+
+struct ContactCacheEntry
+{
+    uint64_t key = ~0ull;
+    uint32_t lastTick = 0;
+    FeaturePair distance;   // feature pair for nearestDistance()
+    FeaturePair approach;   // feature pair for closestPointOfApproach()
+};
+
+// Per pair feature cache used to warm start the queries between ticks.
+// Flat open addressing hash table with linear probing, keyed by the ordered agent pair.
+// Entries that were not used during a tick are removed by nextTick().
+struct ContactCache
+{
+    // Capacity is rounded up to power of two.
+    ContactCache(const int capacity);
+    ~ContactCache();
+
+    ContactCache(const ContactCache&) = delete;
+    ContactCache& operator=(const ContactCache&) = delete;
+
+    // Returns entry for the pair, a new entry is created if needed.
+    // Returns nullptr if the cache is too full to add a new entry.
+    ContactCacheEntry* get(const uint32_t idA, const uint32_t idB);
+
+    // Ages out the entries not used since the previous call.
+    void nextTick();
+
+    ContactCacheEntry* entries = nullptr;
+    ContactCacheEntry* scratch = nullptr;
+    int capacity = 0;
+    int shift = 0;
+    int numEntries = 0;
+    uint32_t tick = 0;
+};
+
+#endif // CONTACTCACHE_H
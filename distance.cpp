@@ -1,7 +1,133 @@
 #include "distance.h"
 #include "mathutil.h"
+#include "trace.h"
 #include <stdio.h>
 
+#ifdef DISTANCE_COUNTERS
+#include <atomic>
+
+static const int MaxCounterThreads = 64;
+
+struct alignas(64) DistanceCounterBlock
+{
+    uint64_t counts[(int)DistanceCounter::Count];
+};
+
+static DistanceCounterBlock counterBlocks[MaxCounterThreads];
+static std::atomic<uint64_t> sharedCounts[(int)DistanceCounter::Count];    // used by threads beyond MaxCounterThreads.
+static std::atomic<int> numCounterBlocks(0);
+
+// Returns nullptr for the threads beyond MaxCounterThreads, they share the atomic counts.
+static DistanceCounterBlock* threadCounters()
+{
+    static thread_local int idx = -1;
+    if (idx == -1)
+        idx = numCounterBlocks.fetch_add(1);
+    return idx < MaxCounterThreads ? &counterBlocks[idx] : nullptr;
+}
+
+static inline void countPath(const DistanceCounter counter)
+{
+    DistanceCounterBlock* block = threadCounters();
+    if (block)
+        block->counts[(int)counter]++;
+    else
+        sharedCounts[(int)counter].fetch_add(1, std::memory_order_relaxed);
+}
+
+#define COUNT_PATH(name) countPath(DistanceCounter::name)
+#else
+#define COUNT_PATH(name) ((void)0)
+#endif
+
+void getDistanceCounters(uint64_t counts[(int)DistanceCounter::Count])
+{
+    for (int i = 0; i < (int)DistanceCounter::Count; i++)
+        counts[i] = 0;
+#ifdef DISTANCE_COUNTERS
+    const int numBlocks = mini(numCounterBlocks.load(), MaxCounterThreads);
+    for (int j = 0; j < numBlocks; j++)
+        for (int i = 0; i < (int)DistanceCounter::Count; i++)
+            counts[i] += counterBlocks[j].counts[i];
+    for (int i = 0; i < (int)DistanceCounter::Count; i++)
+        counts[i] += sharedCounts[i].load(std::memory_order_relaxed);
+#endif
+}
+
+void resetDistanceCounters()
+{
+#ifdef DISTANCE_COUNTERS
+    for (int j = 0; j < MaxCounterThreads; j++)
+        for (int i = 0; i < (int)DistanceCounter::Count; i++)
+            counterBlocks[j].counts[i] = 0;
+    for (int i = 0; i < (int)DistanceCounter::Count; i++)
+        sharedCounts[i].store(0, std::memory_order_relaxed);
+#endif
+}
+
+void dumpDistanceCounters()
+{
+#ifdef DISTANCE_COUNTERS
+    static const char* names[(int)DistanceCounter::Count] = {
+        "CPA stationary",
+        "CPA circle-circle",
+        "CPA circle-pill",
+        "CPA chain miss",
+        "CPA segment hit",
+        "CPA cap hit",
+        "CPA no hit",
+        "CPA segment tests",
+        "CPA cap tests",
+        "Distance circle-circle",
+        "Distance circle-pill",
+        "Distance chain",
+    };
+
+    uint64_t counts[(int)DistanceCounter::Count];
+    getDistanceCounters(counts);
+
+    const uint64_t numCpa = counts[(int)DistanceCounter::CpaStationary] +
+                            counts[(int)DistanceCounter::CpaCircleCircle] + counts[(int)DistanceCounter::CpaCirclePill] +
+                            counts[(int)DistanceCounter::CpaChainMiss] + counts[(int)DistanceCounter::CpaSegmentHit] +
+                            counts[(int)DistanceCounter::CpaCapHit] + counts[(int)DistanceCounter::CpaNoHit];
+    const uint64_t numDist = counts[(int)DistanceCounter::DistCircleCircle] + counts[(int)DistanceCounter::DistCirclePill] +
+                             counts[(int)DistanceCounter::DistChain];
+
+    const uint64_t numLoops = counts[(int)DistanceCounter::CpaSegmentHit] + counts[(int)DistanceCounter::CpaCapHit] +
+                              counts[(int)DistanceCounter::CpaNoHit];
+
+    printf("Distance Counters (%d threads)\n", numCounterBlocks.load());
+    for (int i = 0; i < (int)DistanceCounter::Count; i++)
+    {
+        if (i == (int)DistanceCounter::CpaSegmentTests || i == (int)DistanceCounter::CpaCapTests)
+        {
+            printf(" - %s: %llu (%.2f per hit test)\n", names[i], (unsigned long long)counts[i], numLoops > 0 ? (double)counts[i] / numLoops : 0.0);
+            continue;
+        }
+        const uint64_t total = i < (int)DistanceCounter::DistCircleCircle ? numCpa : numDist;
+        printf(" - %s: %llu (%.1f%%)\n", names[i], (unsigned long long)counts[i], total > 0 ? counts[i] * 100.0 / total : 0.0);
+    }
+#else
+    printf("Distance Counters: compile with DISTANCE_COUNTERS to enable.\n");
+#endif
+}
+
+
+// Relative speeds below this are treated as no motion, the CPA is at t = 0.
+static const float StationarySpeedSq = 1e-12f;
+// Segments shorter than this are treated as points.
+static const float DegenerateSegSq = 1e-12f;
+// Motion within about 0.06 degrees of a segment is treated as parallel to it.
+static const float ParallelSinSq = 1e-6f;
+// Radii and half extents below this are treated as zero, like the segments shorter than DegenerateSegSq.
+// Smaller values change the result less than the float precision of the positions, but their products
+// with small velocities become denormal, which is slow unless the caller flushes them.
+static const float DegenerateExtent = 1e-5f;
+
+static inline float snapExtent(const float x)
+{
+    return x < DegenerateExtent ? 0.0f : x;
+}
 
 bool circleCircleCPA(const Vec2 pos, const Vec2 vel, const float rad, const Vec2 center, float& t)
 {
@@ -28,7 +154,9 @@ bool circleSegmentBodyTOI(const Vec2 pos, const Vec2 vel, const float rad, const
     const float b = segDirSq*velRelPosSq - dirRelPosSq*dirVelSq;
     const float c = segDirSq*relPosSq - dirRelPosSq*dirRelPosSq - sqrf(rad)*segDirSq;
     const float h = maxf(0.0f, b*b - a*c);
-	if (h >= 0 && fabsf(a) > 1e-6f)
+    // a is segDirSq * velSq * sin^2 of the angle between them. Nearly parallel motion or a degenerate
+    // segment cannot hit the body first, the caps handle those.
+	if (fabsf(a) > ParallelSinSq * segDirSq * velSq && segDirSq > DegenerateSegSq)
     {
         const float t0 = (-b - sqrtf(h)) / a;
         const float y = dirRelPosSq + t0 * dirVelSq;
@@ -57,19 +185,21 @@ bool circleSegmentCPA(const Vec2 pos, const Vec2 vel, const float rad,
     const float b = segDirSq*velRelPosSq - dirRelPosSq*dirVelSq;
     const float c = segDirSq*relPosSq - dirRelPosSq*dirRelPosSq - sqrf(rad)*segDirSq;
     const float h = maxf(0.0f, b*b - a*c);
-    const float inva = fabsf(a) > 1e-6f ? 1.0f / a : 0.0f;
+    const bool parallel = fabsf(a) <= ParallelSinSq * segDirSq * velSq;
+    const float inva = parallel ? 0.0f : 1.0f / a;
     const float t0 = (-b - sqrtf(h)) * inva;
     const float y = dirRelPosSq + t0 * dirVelSq;
 
-    // body
-    if (y > 0.0 && y < segDirSq)
+    // body, motion parallel to the segment can only reach it through a cap.
+    if (!parallel && y > 0.0 && y < segDirSq)
     {
         t = t0;
         return true;
     }
     
-    // caps
-    const Vec2 capRelPos = (y <= 0.0) ? relPos : pos - segEnd;
+    // caps, parallel motion reaches the start cap first when moving towards the end.
+    const bool startCap = parallel ? dirVelSq > 0.0f : y <= 0.0f;
+    const Vec2 capRelPos = startCap ? relPos : pos - segEnd;
     const float cb = dot(vel, capRelPos);
     const float cc = dot(capRelPos, capRelPos) - sqrf(rad);
     const float ch = cb*cb - velSq * cc;
@@ -103,7 +233,7 @@ int makeChain(const Collider& col, const Vec2 dir, Vec2 chain[3])
     {
         // orint pill spine
         const float cy = signf(perp(col.up, -dir));
-        const Vec2 dy = col.up * col.ext.y;
+        const Vec2 dy = col.up * snapExtent(col.ext.y);
 
         chain[n++] = offset + dy*cy;
         chain[n++] = offset - dy*cy;
@@ -113,8 +243,8 @@ int makeChain(const Collider& col, const Vec2 dir, Vec2 chain[3])
         // find corner that is pointing most towards the direction.
         const float cx = signf(perp(col.up, -dir));
         const float cy = signf(dot(col.up, -dir));
-        const Vec2 dx = left(col.up) * col.ext.x;
-        const Vec2 dy = col.up * col.ext.y;
+        const Vec2 dx = left(col.up) * snapExtent(col.ext.x);
+        const Vec2 dy = col.up * snapExtent(col.ext.y);
 
         // 2 Segments around the corner 
         chain[n++] = offset + dx*-cy + dy*cx;
@@ -151,7 +281,7 @@ int minkowskiChain(const Vec2* chainA, const int numA, const Vec2* chainB, const
 		else if (ian >= numA)
 		{
 			// A is empty, keep on adding B.
-			res[n] = res[n-1] + (chainB[ibn] - chainB[ib]);
+			res[n] = chainA[ia] + chainB[ibn];
 			resColIdx[n] = 1;
 			resSegIdx[n] = ibn;
 			ib = ibn;
@@ -159,7 +289,7 @@ int minkowskiChain(const Vec2* chainA, const int numA, const Vec2* chainB, const
 		else if (ibn >= numB)
 		{
 			// B is empty, keep on adding A.
-			res[n] = res[n-1] + (chainA[ian] - chainA[ia]);
+			res[n] = chainA[ian] + chainB[ib];
 			resColIdx[n] = 0;
 			resSegIdx[n] = ian;
 			ia = ian;
@@ -171,14 +301,14 @@ int minkowskiChain(const Vec2* chainA, const int numA, const Vec2* chainB, const
 
 			if (c >= 0.0f)
 			{
-				res[n] = res[n-1] + (chainA[ian] - chainA[ia]);
+				res[n] = chainA[ian] + chainB[ib];
                 resColIdx[n] = 0;
                 resSegIdx[n] = ian;
 				ia = ian;
 			}
 			else
 			{
-				res[n] = res[n-1] + (chainB[ibn] - chainB[ib]);
+				res[n] = chainA[ia] + chainB[ibn];
                 resColIdx[n] = 1;
                 resSegIdx[n] = ibn;
 				ib = ibn;
@@ -191,52 +321,132 @@ int minkowskiChain(const Vec2* chainA, const int numA, const Vec2* chainB, const
 }
 
 
-DistanceRes nearestDistance(const Collider& colA, const Vec2 offsetA, const Collider& colB, const Vec2 offsetB)
+PreparedCollider prepareCollider(const Collider& col, const Vec2 vel, const float maxTime)
 {
-	const Vec2 relPos = (colA.pos + offsetA) - (colB.pos + offsetB);
-	const float totalRad = colA.rad + colB.rad;
+    PreparedCollider prep;
+    prep.pos = col.pos;
+    prep.up = col.up;
+    prep.ext = Vec2(snapExtent(col.ext.x), snapExtent(col.ext.y));
+    prep.rad = snapExtent(col.rad);
+    prep.type = col.type;
 
-    DistanceRes res;
+    prep.axisX = left(col.up) * prep.ext.x;
+    prep.axisY = col.up * prep.ext.y;
 
-    // Handle trivial cases early.
-    if (colA.type == ColliderType::Circle && colB.type == ColliderType::Circle)
+    // The facing chain is selected by quadrant index (see makeChain()).
+    // For rect the table holds the corners in chain order, wrapped around so that the
+    // chain around corner i is entries i..i+2. Pill has 2 orientations of the spine.
+    if (col.type == ColliderType::Rect)
     {
-        const float dist = len(relPos);
-        res.dist = dist - totalRad;
-        res.norm = dist > 1e-6f ? (relPos / dist) : Vec2(1,0);
-
-        return res;
+        const Vec2 c0 = prep.axisX + prep.axisY;
+        const Vec2 c1 = prep.axisX - prep.axisY;
+        const Vec2 c2 = -prep.axisX - prep.axisY;
+        const Vec2 c3 = -prep.axisX + prep.axisY;
+        prep.chainTable[0] = c3;
+        prep.chainTable[1] = c0;
+        prep.chainTable[2] = c1;
+        prep.chainTable[3] = c2;
+        prep.chainTable[4] = c3;
+        prep.chainTable[5] = c0;
+        prep.numChain = 3;
+        prep.quadShift = 0;
+        prep.quadMask = 3;
     }
-    else if ((colA.type == ColliderType::Circle && colB.type == ColliderType::Pill) ||
-             (colA.type == ColliderType::Pill && colB.type == ColliderType::Circle))
+    else if (col.type == ColliderType::Pill)
     {
-        const Vec2 up = colA.type == ColliderType::Pill ? colA.up : colB.up;
-        const float hh = colA.type == ColliderType::Pill ? colA.ext.y : colB.ext.y;
+        prep.chainTable[0] = prep.axisY;
+        prep.chainTable[1] = -prep.axisY;
+        prep.chainTable[2] = prep.axisY;
+        prep.numChain = 2;
+        prep.quadShift = 1;
+        prep.quadMask = 1;
+    }
+    else
+    {
+        prep.numChain = 1;
+        prep.quadShift = 0;
+        prep.quadMask = 0;
+    }
 
-        const float s = clampf(dot(up, relPos), -hh, hh);
-        const Vec2 sp = up * s;
-        const Vec2 diff = relPos - sp;
-        const float dist = len(diff);
+    prep.circumRad = len(prep.ext) + prep.rad;
 
-        res.dist = dist - totalRad;
-        res.norm = dist > 1e-6f ? (diff / dist) : Vec2(1,0);
+    const Vec2 hext(fabsf(prep.axisX.x) + fabsf(prep.axisY.x) + prep.rad,
+                    fabsf(prep.axisX.y) + fabsf(prep.axisY.y) + prep.rad);
+    const Vec2 end = col.pos + vel * maxTime;
+    prep.boundsMin = Vec2(minf(col.pos.x, end.x), minf(col.pos.y, end.y)) - hext;
+    prep.boundsMax = Vec2(maxf(col.pos.x, end.x), maxf(col.pos.y, end.y)) + hext;
 
-        return res;
-    }
+    return prep;
+}
 
-	Vec2 chainA[3];
-	Vec2 chainB[3];
-	Vec2 sum[5];
-	uint8_t sumColIdx[5]; 
-	uint8_t sumSegIdx[5]; 
+bool sweptBoundsOverlap(const PreparedCollider& colA, const PreparedCollider& colB)
+{
+    return colA.boundsMin.x <= colB.boundsMax.x && colA.boundsMax.x >= colB.boundsMin.x
+        && colA.boundsMin.y <= colB.boundsMax.y && colA.boundsMax.y >= colB.boundsMin.y;
+}
 
-	const int numA = makeChain(colA, -relPos, chainA);
-	const int numB = makeChain(colB, -relPos, chainB);
-	const int numSum = minkowskiChain(chainA, numA, chainB, numB, sum, sumColIdx, sumSegIdx, 5);
+// Pack the facing signs into a quadrant index, ordered so that stepping the index
+// walks around the rect: (+x,+y) = 0, (+x,-y) = 1, (-x,-y) = 2, (-x,+y) = 3.
+// Pill uses just the x-sign, which is the high bit, and circle always uses index 0.
+static inline int chainQuadrant(const Vec2 up, const Vec2 dir)
+{
+    const int nx = perp(up, -dir) < 0.0f;
+    const int ny = dot(up, -dir) < 0.0f;
+    return (nx << 1) | (nx ^ ny);
+}
+
+int chainIndex(const PreparedCollider& col, const Vec2 dir)
+{
+    return (chainQuadrant(col.up, dir) >> col.quadShift) & col.quadMask;
+}
 
-	Vec2 nearestNorm;
-	float nearestDist = 1e6f;
-    int nearestPt = -1;
+int makeChain(const PreparedCollider& col, const Vec2 dir, Vec2 chain[3])
+{
+    const int idx = chainIndex(col, dir);
+
+    const Vec2* src = &col.chainTable[idx];
+    chain[0] = src[0];
+    chain[1] = src[1];
+    chain[2] = src[2];
+
+    return col.numChain;
+}
+
+static DistanceRes circleCircleDistance(const Vec2 relPos, const float totalRad)
+{
+    DistanceRes res;
+    const float dist = len(relPos);
+    res.dist = dist - totalRad;
+    res.norm = dist > 1e-6f ? (relPos / dist) : Vec2(1,0);
+    return res;
+}
+
+static DistanceRes circlePillDistance(const Vec2 relPos, const Vec2 up, const float hh, const float totalRad)
+{
+    DistanceRes res;
+    const float s = clampf(dot(up, relPos), -hh, hh);
+    const Vec2 sp = up * s;
+    const Vec2 diff = relPos - sp;
+    const float dist = len(diff);
+
+    res.dist = dist - totalRad;
+    res.norm = dist > 1e-6f ? (diff / dist) : Vec2(1,0);
+    return res;
+}
+
+// Nearest vertex, or nearest point on a segment starting at vertex, of a Minkowski chain.
+struct ChainNearest
+{
+    Vec2 diff;
+    float distSq = 1e6f;
+    int vertex = -1;
+    int segment = -1;
+    float s = 0.0f;
+};
+
+static ChainNearest nearestOnChain(const Vec2 relPos, const Vec2* sum, const int numSum)
+{
+    ChainNearest nearest;
 
     // Test internal vertices.
     // Since the chains are always oriented towards the direction between the bodies,
@@ -246,16 +456,16 @@ DistanceRes nearestDistance(const Collider& colA, const Vec2 offsetA, const Coll
         const Vec2 sp = sum[i];
         const Vec2 diff = relPos - sp;
         const float dist = lenSq(diff);
-        if (dist < nearestDist)
+        if (dist < nearest.distSq)
         {
-            nearestDist = dist;
-            nearestNorm = diff;
-            nearestPt = i;
+            nearest.distSq = dist;
+            nearest.diff = diff;
+            nearest.vertex = i;
         }
     }
 
     // Test the 2 segment bodies around the nearest point.
-    for (int i = maxi(0, nearestPt-1); i < mini(nearestPt+1, numSum); i++)
+    for (int i = maxi(0, nearest.vertex-1); i < mini(nearest.vertex+1, numSum-1); i++)
     {
         const Vec2 p = sum[i];
         const Vec2 q = sum[i+1];
@@ -265,65 +475,141 @@ DistanceRes nearestDistance(const Collider& colA, const Vec2 offsetA, const Coll
             const Vec2 segPos = lerp(p, q, s);
             const Vec2 diff = relPos - segPos;
             const float dist = lenSq(diff);
-            if (dist < nearestDist)
+            if (dist < nearest.distSq)
             {
                 const float sign = perp(q - p, diff) >= 0.0f ? -1 : 1;
-                nearestDist = dist;
-                nearestNorm = diff * sign;
+                nearest.distSq = dist;
+                nearest.diff = diff * sign;
+                nearest.segment = i;
+                nearest.s = s;
             }
         }
     }
 
-    nearestDist = sqrtf(nearestDist);
-    res.norm = nearestDist > 1e-6f ? (nearestNorm / nearestDist) : Vec2(1,0);
+    return nearest;
+}
+
+static DistanceRes chainDistance(const Vec2 relPos, const float totalRad,
+                                 const Vec2* chainA, const int numA, const Vec2* chainB, const int numB)
+{
+	Vec2 sum[5];
+	uint8_t sumColIdx[5];
+	uint8_t sumSegIdx[5];
+	const int numSum = minkowskiChain(chainA, numA, chainB, numB, sum, sumColIdx, sumSegIdx, 5);
+
+    const ChainNearest nearest = nearestOnChain(relPos, sum, numSum);
+
+    DistanceRes res;
+    const float nearestDist = sqrtf(nearest.distSq);
+    res.norm = nearestDist > 1e-6f ? (nearest.diff / nearestDist) : Vec2(1,0);
     res.dist = nearestDist - totalRad;
 
     return res;
 }
 
-ApproachRes closestPointOfApproach(const Collider& colA, const Vec2 velA, const Collider& colB, const Vec2 velB, const float maxTime)
+DistanceRes nearestDistance(const Collider& colA, const Vec2 offsetA, const Collider& colB, const Vec2 offsetB)
 {
-	Vec2 relVel = velA - velB;
-	Vec2 relPos = colA.pos - colB.pos;
-	const float totalRad = colA.rad + colB.rad;
+    TRACE_SCOPE("nearestDistance");
+	const Vec2 relPos = (colA.pos + offsetA) - (colB.pos + offsetB);
+	const float totalRad = snapExtent(colA.rad + colB.rad);
 
-    ApproachRes res;
+    // Handle trivial cases early.
+    if (colA.type == ColliderType::Circle && colB.type == ColliderType::Circle)
+    {
+        COUNT_PATH(DistCircleCircle);
+        return circleCircleDistance(relPos, totalRad);
+    }
+    else if ((colA.type == ColliderType::Circle && colB.type == ColliderType::Pill) ||
+             (colA.type == ColliderType::Pill && colB.type == ColliderType::Circle))
+    {
+        const Vec2 up = colA.type == ColliderType::Pill ? colA.up : colB.up;
+        const float hh = snapExtent(colA.type == ColliderType::Pill ? colA.ext.y : colB.ext.y);
+        COUNT_PATH(DistCirclePill);
+        return circlePillDistance(relPos, up, hh, totalRad);
+    }
+
+	Vec2 chainA[3];
+	Vec2 chainB[3];
+	const int numA = makeChain(colA, -relPos, chainA);
+	const int numB = makeChain(colB, -relPos, chainB);
+
+    COUNT_PATH(DistChain);
+    return chainDistance(relPos, totalRad, chainA, numA, chainB, numB);
+}
+
+DistanceRes nearestDistance(const PreparedCollider& colA, const Vec2 offsetA, const PreparedCollider& colB, const Vec2 offsetB)
+{
+    TRACE_SCOPE("nearestDistance");
+	const Vec2 relPos = (colA.pos + offsetA) - (colB.pos + offsetB);
+	const float totalRad = snapExtent(colA.rad + colB.rad);
 
     // Handle trivial cases early.
     if (colA.type == ColliderType::Circle && colB.type == ColliderType::Circle)
     {
-        res.hit = circleCircleCPA(relPos, relVel, totalRad, Vec2(0,0), res.t);
-        res.t = clampf(res.t, 0.0f, maxTime);
-        return res;
+        COUNT_PATH(DistCircleCircle);
+        return circleCircleDistance(relPos, totalRad);
     }
     else if ((colA.type == ColliderType::Circle && colB.type == ColliderType::Pill) ||
              (colA.type == ColliderType::Pill && colB.type == ColliderType::Circle))
     {
-        const Vec2 stem = colA.type == ColliderType::Pill ? (colA.up * colA.ext.y) : (colB.up * colB.ext.y);
-        res.hit = circleSegmentCPA(relPos, relVel, totalRad, -stem, stem, res.t);
-        res.t = clampf(res.t, 0.0f, maxTime);
-        return res;
+        const Vec2 up = colA.type == ColliderType::Pill ? colA.up : colB.up;
+        const float hh = snapExtent(colA.type == ColliderType::Pill ? colA.ext.y : colB.ext.y);
+        COUNT_PATH(DistCirclePill);
+        return circlePillDistance(relPos, up, hh, totalRad);
     }
 
 	Vec2 chainA[3];
 	Vec2 chainB[3];
-	Vec2 sum[5];
-	uint8_t sumColIdx[5];
-	uint8_t sumSegIdx[5];
+	const int numA = makeChain(colA, -relPos, chainA);
+	const int numB = makeChain(colB, -relPos, chainB);
 
-	const int numA = makeChain(colA, relVel, chainA);
-	const int numB = makeChain(colB, relVel, chainB);
-	const int numSum = minkowskiChain(chainA, numA, chainB, numB, sum, sumColIdx, sumSegIdx, 5);
+    COUNT_PATH(DistChain);
+    return chainDistance(relPos, totalRad, chainA, numA, chainB, numB);
+}
+
+// Distance at t = 0 for the stationary CPA. The same as nearestDistance(), but does not add to its trace scope
+// and path counters.
+template <typename ColliderT>
+static float stationaryDistance(const ColliderT& colA, const ColliderT& colB, const Vec2 relPos, const float totalRad)
+{
+    if (colA.type == ColliderType::Circle && colB.type == ColliderType::Circle)
+        return circleCircleDistance(relPos, totalRad).dist;
+    if ((colA.type == ColliderType::Circle && colB.type == ColliderType::Pill) ||
+        (colA.type == ColliderType::Pill && colB.type == ColliderType::Circle))
+    {
+        const Vec2 up = colA.type == ColliderType::Pill ? colA.up : colB.up;
+        const float hh = snapExtent(colA.type == ColliderType::Pill ? colA.ext.y : colB.ext.y);
+        return circlePillDistance(relPos, up, hh, totalRad).dist;
+    }
+
+	Vec2 chainA[3];
+	Vec2 chainB[3];
+	const int numA = makeChain(colA, -relPos, chainA);
+	const int numB = makeChain(colB, -relPos, chainB);
+    return chainDistance(relPos, totalRad, chainA, numA, chainB, numB).dist;
+}
+
+// CPA against a Minkowski sum. Reports the sum vertex or segment that determined the result,
+// either of them is -1.
+static ApproachRes sumApproach(const Vec2 relPos, const Vec2 relVel, const float totalRad, const float maxTime,
+                               const Vec2* sum, const int numSum, int& resVertex, int& resSegment)
+{
+    ApproachRes res;
 
     // check if the ray can hit the sum at all.
     const Vec2 testDir = norm(relVel);
     const float firstDist = perp(testDir, sum[0] - relPos) + totalRad;
     const float lastDist = perp(testDir, sum[numSum-1] - relPos) - totalRad;
 
+    resVertex = -1;
+    resSegment = -1;
+
     if ((firstDist * lastDist) > 0.0f)
     {
         // Not hit, return closes point of approach.
-		const Vec2 p = fabsf(firstDist) < fabsf(lastDist) ? sum[0] : sum[numSum-1];
+        COUNT_PATH(CpaChainMiss);
+        resVertex = fabsf(firstDist) < fabsf(lastDist) ? 0 : numSum-1;
+		const Vec2 p = sum[resVertex];
 
 		float t;
 		circleCircleCPA(relPos, relVel, totalRad, p, t);
@@ -339,6 +625,7 @@ ApproachRes closestPointOfApproach(const Collider& colA, const Vec2 velA, const
     // Hit test segments
     for (int i = 0; i < numSum-1; i++)
     {
+        COUNT_PATH(CpaSegmentTests);
         const Vec2 p = sum[i];
         const Vec2 q = sum[i+1];
 
@@ -346,8 +633,10 @@ ApproachRes closestPointOfApproach(const Collider& colA, const Vec2 velA, const
         if (circleSegmentBodyTOI(relPos, relVel, totalRad, p, q, t))
         {
             // Segments cannot overlap, we can early out as soon as we find a hit.
+            COUNT_PATH(CpaSegmentHit);
             res.t = t;
             res.hit = true;
+            resSegment = i;
             break;
         }
     }
@@ -357,6 +646,7 @@ ApproachRes closestPointOfApproach(const Collider& colA, const Vec2 velA, const
     {
         for (int i = 0; i < numSum; i++)
         {
+            COUNT_PATH(CpaCapTests);
             const Vec2 p = sum[i];
 
             float t;
@@ -367,12 +657,1450 @@ ApproachRes closestPointOfApproach(const Collider& colA, const Vec2 velA, const
                 {
                     res.t = t;
                     res.hit = true;
+                    resVertex = i;
                 }
             }
         }
+
+        if (res.hit)
+            COUNT_PATH(CpaCapHit);
+        else
+            COUNT_PATH(CpaNoHit);
     }
 
     res.t = clampf(res.t, 0.0f, maxTime);
 
     return res;
-}
\ No newline at end of file
+}
+
+static ApproachRes chainApproach(const Vec2 relPos, const Vec2 relVel, const float totalRad, const float maxTime,
+                                 const Vec2* chainA, const int numA, const Vec2* chainB, const int numB)
+{
+	Vec2 sum[5];
+	uint8_t sumColIdx[5];
+	uint8_t sumSegIdx[5];
+	const int numSum = minkowskiChain(chainA, numA, chainB, numB, sum, sumColIdx, sumSegIdx, 5);
+
+    int vertex, segment;
+    return sumApproach(relPos, relVel, totalRad, maxTime, sum, numSum, vertex, segment);
+}
+
+ApproachRes closestPointOfApproach(const Collider& colA, const Vec2 velA, const Collider& colB, const Vec2 velB, const float maxTime)
+{
+    TRACE_SCOPE("closestPointOfApproach");
+	Vec2 relVel = velA - velB;
+	Vec2 relPos = colA.pos - colB.pos;
+	const float totalRad = snapExtent(colA.rad + colB.rad);
+
+    ApproachRes res;
+
+    // No relative motion, nothing changes over time. The paths below would divide by the speed.
+    // The shapes are in contact the whole time if they overlap now.
+    if (lenSq(relVel) < StationarySpeedSq)
+    {
+        COUNT_PATH(CpaStationary);
+        res.hit = stationaryDistance(colA, colB, relPos, totalRad) <= 0.0f;
+        return res;
+    }
+
+    // Handle trivial cases early.
+    if (colA.type == ColliderType::Circle && colB.type == ColliderType::Circle)
+    {
+        COUNT_PATH(CpaCircleCircle);
+        res.hit = circleCircleCPA(relPos, relVel, totalRad, Vec2(0,0), res.t);
+        res.t = clampf(res.t, 0.0f, maxTime);
+        return res;
+    }
+    else if ((colA.type == ColliderType::Circle && colB.type == ColliderType::Pill) ||
+             (colA.type == ColliderType::Pill && colB.type == ColliderType::Circle))
+    {
+        const Vec2 stem = colA.type == ColliderType::Pill ? (colA.up * snapExtent(colA.ext.y)) : (colB.up * snapExtent(colB.ext.y));
+        COUNT_PATH(CpaCirclePill);
+        res.hit = circleSegmentCPA(relPos, relVel, totalRad, -stem, stem, res.t);
+        res.t = clampf(res.t, 0.0f, maxTime);
+        return res;
+    }
+
+	Vec2 chainA[3];
+	Vec2 chainB[3];
+	const int numA = makeChain(colA, relVel, chainA);
+	const int numB = makeChain(colB, relVel, chainB);
+
+    return chainApproach(relPos, relVel, totalRad, maxTime, chainA, numA, chainB, numB);
+}
+
+ApproachRes closestPointOfApproach(const PreparedCollider& colA, const Vec2 velA, const PreparedCollider& colB, const Vec2 velB, const float maxTime)
+{
+    TRACE_SCOPE("closestPointOfApproach");
+	Vec2 relVel = velA - velB;
+	Vec2 relPos = colA.pos - colB.pos;
+	const float totalRad = snapExtent(colA.rad + colB.rad);
+
+    ApproachRes res;
+
+    // No relative motion, nothing changes over time. The paths below would divide by the speed.
+    // The shapes are in contact the whole time if they overlap now.
+    if (lenSq(relVel) < StationarySpeedSq)
+    {
+        COUNT_PATH(CpaStationary);
+        res.hit = stationaryDistance(colA, colB, relPos, totalRad) <= 0.0f;
+        return res;
+    }
+
+    // Handle trivial cases early.
+    if (colA.type == ColliderType::Circle && colB.type == ColliderType::Circle)
+    {
+        COUNT_PATH(CpaCircleCircle);
+        res.hit = circleCircleCPA(relPos, relVel, totalRad, Vec2(0,0), res.t);
+        res.t = clampf(res.t, 0.0f, maxTime);
+        return res;
+    }
+    else if ((colA.type == ColliderType::Circle && colB.type == ColliderType::Pill) ||
+             (colA.type == ColliderType::Pill && colB.type == ColliderType::Circle))
+    {
+        const Vec2 stem = colA.type == ColliderType::Pill ? colA.axisY : colB.axisY;
+        COUNT_PATH(CpaCirclePill);
+        res.hit = circleSegmentCPA(relPos, relVel, totalRad, -stem, stem, res.t);
+        res.t = clampf(res.t, 0.0f, maxTime);
+        return res;
+    }
+
+	Vec2 chainA[3];
+	Vec2 chainB[3];
+	const int numA = makeChain(colA, relVel, chainA);
+	const int numB = makeChain(colB, relVel, chainB);
+
+    return chainApproach(relPos, relVel, totalRad, maxTime, chainA, numA, chainB, numB);
+}
+
+// Feature IDs of the chain vertices and the edges between them, see makeChain().
+static void chainFeatures(const ColliderType type, const int quad, uint8_t vertIds[3], uint8_t edgeIds[2])
+{
+    if (type == ColliderType::Rect)
+    {
+        for (int i = 0; i < 3; i++)
+            vertIds[i] = (uint8_t)((quad + i + 3) & 3);
+        edgeIds[0] = FeatureEdge | vertIds[0];
+        edgeIds[1] = FeatureEdge | vertIds[1];
+    }
+    else if (type == ColliderType::Pill)
+    {
+        for (int i = 0; i < 3; i++)
+            vertIds[i] = (uint8_t)(((quad >> 1) + i) & 1);
+        edgeIds[0] = FeatureEdge;
+        edgeIds[1] = FeatureEdge;
+    }
+    else
+    {
+        vertIds[0] = vertIds[1] = vertIds[2] = 0;
+        edgeIds[0] = edgeIds[1] = FeatureEdge;
+    }
+}
+
+// Chain vertex of A and B at each vertex of the sum.
+static void sumChainIndices(const uint8_t* sumColIdx, const uint8_t* sumSegIdx, const int numSum, int* ia, int* ib)
+{
+    ia[0] = 0;
+    ib[0] = 0;
+    for (int i = 1; i < numSum; i++)
+    {
+        ia[i] = sumColIdx[i] == 0 ? sumSegIdx[i] : ia[i-1];
+        ib[i] = sumColIdx[i] == 1 ? sumSegIdx[i] : ib[i-1];
+    }
+}
+
+static void setContactPoint(ContactPoint& pt, const Vec2 skelA, const Vec2 skelB, const Vec2 norm,
+                            const float radA, const float radB, const uint8_t featureA, const uint8_t featureB)
+{
+    pt.posA = skelA - norm * radA;
+    pt.posB = skelB + norm * radB;
+    pt.dist = dot(pt.posA - pt.posB, norm);
+    pt.featureA = featureA;
+    pt.featureB = featureB;
+}
+
+static ContactRes circleCircleContact(const Vec2 posA, const float radA, const Vec2 posB, const float radB)
+{
+    const DistanceRes dist = circleCircleDistance(posA - posB, radA + radB);
+
+    ContactRes res;
+    res.norm = dist.norm;
+    res.dist = dist.dist;
+    setContactPoint(res.points[0], posA, posB, res.norm, radA, radB, 0, 0);
+    res.numPoints = 1;
+
+    return res;
+}
+
+static ContactRes chainContact(const Vec2 posA, const float radA, const Vec2 posB, const float radB,
+                               const Vec2* chainA, const int numA, const uint8_t* vertIdsA, const uint8_t* edgeIdsA,
+                               const Vec2* chainB, const int numB, const uint8_t* vertIdsB, const uint8_t* edgeIdsB)
+{
+    const Vec2 relPos = posA - posB;
+
+    Vec2 sum[5];
+    uint8_t sumColIdx[5];
+    uint8_t sumSegIdx[5];
+    const int numSum = minkowskiChain(chainA, numA, chainB, numB, sum, sumColIdx, sumSegIdx, 5);
+
+    const ChainNearest nearest = nearestOnChain(relPos, sum, numSum);
+
+    ContactRes res;
+    const float nearestDist = sqrtf(nearest.distSq);
+    res.norm = nearestDist > 1e-6f ? (nearest.diff / nearestDist) : Vec2(1,0);
+    res.dist = nearestDist - (radA + radB);
+
+    int ia[5];
+    int ib[5];
+    sumChainIndices(sumColIdx, sumSegIdx, numSum, ia, ib);
+
+    // Nearest is vertex-vertex. Note that A is mirrored in the sum.
+    if (nearest.segment == -1)
+    {
+        const int v = nearest.vertex;
+        setContactPoint(res.points[0], posA - chainA[ia[v]], posB + chainB[ib[v]], res.norm, radA, radB,
+                        vertIdsA[ia[v]], vertIdsB[ib[v]]);
+        res.numPoints = 1;
+        return res;
+    }
+
+    // Nearest is vertex-edge, if the neighbour segment is parallel edge of the other collider, it's edge-edge.
+    const int seg = nearest.segment;
+    const Vec2 segDir = sum[seg+1] - sum[seg];
+    int other = -1;
+    for (int i = maxi(0, seg-1); i < mini(seg+2, numSum-1); i++)
+    {
+        if (i == seg || sumColIdx[i+1] == sumColIdx[seg+1])
+            continue;
+        const Vec2 dir = sum[i+1] - sum[i];
+        if (dot(segDir, dir) > 0.0f && fabsf(perp(segDir, dir)) < 0.01f * len(segDir) * len(dir))
+            other = i;
+    }
+
+    const int segA = sumColIdx[seg+1] == 0 ? seg : other;
+    const int segB = sumColIdx[seg+1] == 1 ? seg : other;
+
+    if (other == -1)
+    {
+        if (segA != -1)
+        {
+            const Vec2 skelA = posA - lerp(chainA[ia[seg]], chainA[ia[seg+1]], nearest.s);
+            setContactPoint(res.points[0], skelA, posB + chainB[ib[seg]], res.norm, radA, radB,
+                            edgeIdsA[ia[seg]], vertIdsB[ib[seg]]);
+        }
+        else
+        {
+            const Vec2 skelB = posB + lerp(chainB[ib[seg]], chainB[ib[seg+1]], nearest.s);
+            setContactPoint(res.points[0], posA - chainA[ia[seg]], skelB, res.norm, radA, radB,
+                            vertIdsA[ia[seg]], edgeIdsB[ib[seg]]);
+        }
+        res.numPoints = 1;
+        return res;
+    }
+
+    // Clip the edge of A against the edge of B.
+    const int a0 = ia[segA];
+    const int a1 = ia[segA+1];
+    const int b0 = ib[segB];
+    const int b1 = ib[segB+1];
+    const Vec2 pa0 = posA - chainA[a0];
+    const Vec2 pa1 = posA - chainA[a1];
+    const Vec2 pb0 = posB + chainB[b0];
+    const Vec2 pb1 = posB + chainB[b1];
+
+    const Vec2 edgeA = pa1 - pa0;
+    const Vec2 edgeB = pb1 - pb0;
+    const float edgeASq = maxf(1e-12f, lenSq(edgeA));
+    const float edgeBSq = maxf(1e-12f, lenSq(edgeB));
+    const float t[2] = { dot(pa0 - pb0, edgeB) / edgeBSq, dot(pa1 - pb0, edgeB) / edgeBSq };
+
+    // Use single point if the overlap of the edges is degenerate.
+    res.numPoints = fabsf(clampf(t[1], 0.0f, 1.0f) - clampf(t[0], 0.0f, 1.0f)) > 1e-3f ? 2 : 1;
+    for (int i = 0; i < res.numPoints; i++)
+    {
+        // Vertex of A against the edge of B if it is inside B's edge, else vertex of B against edge of A.
+        const Vec2 skelB = pb0 + edgeB * clampf(t[i], 0.0f, 1.0f);
+        Vec2 skelA;
+        uint8_t featureA = edgeIdsA[a0];
+        uint8_t featureB = edgeIdsB[b0];
+        if (t[i] > 0.0f && t[i] < 1.0f)
+        {
+            skelA = i == 0 ? pa0 : pa1;
+            featureA = vertIdsA[i == 0 ? a0 : a1];
+        }
+        else
+        {
+            skelA = pa0 + edgeA * clampf(dot(skelB - pa0, edgeA) / edgeASq, 0.0f, 1.0f);
+            featureB = vertIdsB[t[i] <= 0.0f ? b0 : b1];
+        }
+        setContactPoint(res.points[i], skelA, skelB, res.norm, radA, radB, featureA, featureB);
+    }
+
+    return res;
+}
+
+ContactRes nearestContact(const Collider& colA, const Vec2 offsetA, const Collider& colB, const Vec2 offsetB)
+{
+    const Vec2 posA = colA.pos + offsetA;
+    const Vec2 posB = colB.pos + offsetB;
+    const Vec2 relPos = posA - posB;
+
+    if (colA.type == ColliderType::Circle && colB.type == ColliderType::Circle)
+        return circleCircleContact(posA, colA.rad, posB, colB.rad);
+
+    Vec2 chainA[3];
+    Vec2 chainB[3];
+    const int numA = makeChain(colA, -relPos, chainA);
+    const int numB = makeChain(colB, -relPos, chainB);
+
+    // A is mirrored in the sum, so its features come from the chain facing the other way.
+    uint8_t vertIdsA[3], edgeIdsA[2];
+    uint8_t vertIdsB[3], edgeIdsB[2];
+    chainFeatures(colA.type, chainQuadrant(colA.up, relPos), vertIdsA, edgeIdsA);
+    chainFeatures(colB.type, chainQuadrant(colB.up, -relPos), vertIdsB, edgeIdsB);
+
+    return chainContact(posA, colA.rad, posB, colB.rad,
+                        chainA, numA, vertIdsA, edgeIdsA, chainB, numB, vertIdsB, edgeIdsB);
+}
+
+ContactRes nearestContact(const PreparedCollider& colA, const Vec2 offsetA, const PreparedCollider& colB, const Vec2 offsetB)
+{
+    const Vec2 posA = colA.pos + offsetA;
+    const Vec2 posB = colB.pos + offsetB;
+    const Vec2 relPos = posA - posB;
+
+    if (colA.type == ColliderType::Circle && colB.type == ColliderType::Circle)
+        return circleCircleContact(posA, colA.rad, posB, colB.rad);
+
+    Vec2 chainA[3];
+    Vec2 chainB[3];
+    const int numA = makeChain(colA, -relPos, chainA);
+    const int numB = makeChain(colB, -relPos, chainB);
+
+    // A is mirrored in the sum, so its features come from the chain facing the other way.
+    uint8_t vertIdsA[3], edgeIdsA[2];
+    uint8_t vertIdsB[3], edgeIdsB[2];
+    chainFeatures(colA.type, chainQuadrant(colA.up, relPos), vertIdsA, edgeIdsA);
+    chainFeatures(colB.type, chainQuadrant(colB.up, -relPos), vertIdsB, edgeIdsB);
+
+    return chainContact(posA, colA.rad, posB, colB.rad,
+                        chainA, numA, vertIdsA, edgeIdsA, chainB, numB, vertIdsB, edgeIdsB);
+}
+
+static int featureVertexCount(const PreparedCollider& col)
+{
+    return col.type == ColliderType::Rect ? 4 : (col.type == ColliderType::Pill ? 2 : 1);
+}
+
+// Skeleton vertex by feature ID, rect corners are chainTable[1..4], pill ends chainTable[0..1].
+static Vec2 featureVertex(const PreparedCollider& col, const int id)
+{
+    if (col.type == ColliderType::Rect)
+        return col.chainTable[1 + id];
+    return col.chainTable[id];
+}
+
+// Sine of the smallest angle between a direction and the boundary of a normal cone for strict tests.
+static const float StrictConeSin = 1e-4f;
+
+// Returns true if dot(dir, edge) is non-negative, when strict the angle from perpendicular has to be
+// at least asin(StrictConeSin) so that nearly parallel edges do not count.
+static bool coneSide(const Vec2 dir, const Vec2 edge, const bool strict)
+{
+    const float d = dot(dir, edge);
+    if (!strict)
+        return d >= 0.0f;
+    return d > 0.0f && d*d > sqrf(StrictConeSin) * lenSq(dir) * lenSq(edge);
+}
+
+// Returns true if the direction lies in the normal cone of the vertex. When strict, the direction may not
+// be close to the boundary of the cone, where the neighbour vertex is as far along the direction.
+static bool inVertexCone(const PreparedCollider& col, const int id, const Vec2 dir, const bool strict)
+{
+    if (col.type == ColliderType::Rect)
+    {
+        const Vec2 v = featureVertex(col, id);
+        return coneSide(dir, v - featureVertex(col, (id + 3) & 3), strict)
+            && coneSide(dir, v - featureVertex(col, (id + 1) & 3), strict);
+    }
+    if (col.type == ColliderType::Pill)
+        return coneSide(dir, featureVertex(col, id), strict);
+    return true;
+}
+
+// Returns true if the direction, perpendicular to the edge, is the edge's outward normal.
+static bool inEdgeCone(const PreparedCollider& col, const int id, const Vec2 dir)
+{
+    if (col.type == ColliderType::Rect)
+        return dot(dir, featureVertex(col, id) + featureVertex(col, (id + 1) & 3)) > 0.0f;
+    return true;
+}
+
+// Geometry of a feature pair in the Minkowski sum space (A is mirrored), 1 point for vertex, 2 for segment.
+// Returns 0 if the feature pair does not fit the colliders.
+static int sumFeature(const PreparedCollider& colA, const PreparedCollider& colB, const FeaturePair feature, Vec2 pts[2])
+{
+    const bool edgeA = (feature.featureA & FeatureEdge) != 0;
+    const bool edgeB = (feature.featureB & FeatureEdge) != 0;
+    const int idA = feature.featureA & ~FeatureEdge;
+    const int idB = feature.featureB & ~FeatureEdge;
+    const int numA = featureVertexCount(colA);
+    const int numB = featureVertexCount(colB);
+
+    if (feature.featureA == FeatureNone || feature.featureB == FeatureNone || idA >= numA || idB >= numB)
+        return 0;
+
+    if (edgeA && !edgeB && numA > 1)
+    {
+        const Vec2 b = featureVertex(colB, idB);
+        pts[0] = b - featureVertex(colA, idA);
+        pts[1] = b - featureVertex(colA, (idA + 1) % numA);
+        return 2;
+    }
+    if (edgeB && !edgeA && numB > 1)
+    {
+        const Vec2 a = featureVertex(colA, idA);
+        pts[0] = featureVertex(colB, idB) - a;
+        pts[1] = featureVertex(colB, (idB + 1) % numB) - a;
+        return 2;
+    }
+    if (!edgeA && !edgeB)
+    {
+        pts[0] = featureVertex(colB, idB) - featureVertex(colA, idA);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Returns true if the direction is in the normal cone of the sum feature, see inVertexCone() for strict.
+static bool inSumFeatureCone(const PreparedCollider& colA, const PreparedCollider& colB, const FeaturePair feature, const Vec2 dir,
+                             const bool strict)
+{
+    const int idA = feature.featureA & ~FeatureEdge;
+    const int idB = feature.featureB & ~FeatureEdge;
+    const bool okA = (feature.featureA & FeatureEdge) ? inEdgeCone(colA, idA, -dir) : inVertexCone(colA, idA, -dir, strict);
+    const bool okB = (feature.featureB & FeatureEdge) ? inEdgeCone(colB, idB, dir) : inVertexCone(colB, idB, dir, strict);
+    return okA && okB;
+}
+
+static FeaturePair sumFeaturePair(const int vertex, const int segment, const uint8_t* sumColIdx, const int* ia, const int* ib,
+                                  const uint8_t* vertIdsA, const uint8_t* edgeIdsA, const uint8_t* vertIdsB, const uint8_t* edgeIdsB)
+{
+    FeaturePair feature;
+    if (segment != -1)
+    {
+        const bool edgeA = sumColIdx[segment+1] == 0;
+        feature.featureA = edgeA ? edgeIdsA[ia[segment]] : vertIdsA[ia[segment]];
+        feature.featureB = edgeA ? vertIdsB[ib[segment]] : edgeIdsB[ib[segment]];
+    }
+    else if (vertex != -1)
+    {
+        feature.featureA = vertIdsA[ia[vertex]];
+        feature.featureB = vertIdsB[ib[vertex]];
+    }
+    return feature;
+}
+
+static bool warmDistance(const PreparedCollider& colA, const PreparedCollider& colB, const Vec2 relPos, const float totalRad,
+                         const FeaturePair feature, DistanceRes& res)
+{
+    Vec2 pts[2];
+    const int n = sumFeature(colA, colB, feature, pts);
+    if (n == 0)
+        return false;
+
+    Vec2 diff;
+    if (n == 1)
+    {
+        diff = relPos - pts[0];
+    }
+    else
+    {
+        const bool flip = perp(-relPos, pts[1] - pts[0]) > 0.0f;
+        const Vec2 p = flip ? pts[1] : pts[0];
+        const Vec2 q = flip ? pts[0] : pts[1];
+        const float s = projectPtSeg(relPos, p, q);
+        if (s <= 0.0f || s >= 1.0f)
+            return false;
+        const Vec2 segPos = lerp(p, q, s);
+        diff = relPos - segPos;
+        // The sum is centered at origin, outward normal points away from it.
+        if (dot(diff, segPos) <= 0.0f)
+            return false;
+    }
+
+    // Overlaps go to the full scan, which measures them from the chain facing the other body and
+    // can pick a different feature than the nearest one.
+    const float dist = len(diff);
+    if (dist < 1e-6f || dist <= totalRad || !inSumFeatureCone(colA, colB, feature, diff, false))
+        return false;
+
+    res.norm = diff / dist;
+    res.dist = dist - totalRad;
+    return true;
+}
+
+DistanceRes nearestDistance(const PreparedCollider& colA, const Vec2 offsetA, const PreparedCollider& colB, const Vec2 offsetB,
+                            FeaturePair& feature)
+{
+    TRACE_SCOPE("nearestDistance");
+    const Vec2 relPos = (colA.pos + offsetA) - (colB.pos + offsetB);
+    const float totalRad = snapExtent(colA.rad + colB.rad);
+
+    if (!hasWarmStartFeatures(colA, colB))
+    {
+        // Analytic cases, nothing to cache.
+        feature = FeaturePair();
+        return nearestDistance(colA, offsetA, colB, offsetB);
+    }
+
+    DistanceRes res;
+    if (warmDistance(colA, colB, relPos, totalRad, feature, res))
+        return res;
+
+    Vec2 chainA[3];
+    Vec2 chainB[3];
+    const int numA = makeChain(colA, -relPos, chainA);
+    const int numB = makeChain(colB, -relPos, chainB);
+
+    Vec2 sum[5];
+    uint8_t sumColIdx[5];
+    uint8_t sumSegIdx[5];
+    const int numSum = minkowskiChain(chainA, numA, chainB, numB, sum, sumColIdx, sumSegIdx, 5);
+
+    COUNT_PATH(DistChain);
+    const ChainNearest nearest = nearestOnChain(relPos, sum, numSum);
+
+    const float nearestDist = sqrtf(nearest.distSq);
+    res.norm = nearestDist > 1e-6f ? (nearest.diff / nearestDist) : Vec2(1,0);
+    res.dist = nearestDist - totalRad;
+
+    // A is mirrored in the sum, so its features come from the chain facing the other way.
+    uint8_t vertIdsA[3], edgeIdsA[2];
+    uint8_t vertIdsB[3], edgeIdsB[2];
+    chainFeatures(colA.type, chainQuadrant(colA.up, relPos), vertIdsA, edgeIdsA);
+    chainFeatures(colB.type, chainQuadrant(colB.up, -relPos), vertIdsB, edgeIdsB);
+
+    int ia[5];
+    int ib[5];
+    sumChainIndices(sumColIdx, sumSegIdx, numSum, ia, ib);
+    feature = sumFeaturePair(nearest.segment == -1 ? nearest.vertex : -1, nearest.segment, sumColIdx, ia, ib,
+                             vertIdsA, edgeIdsA, vertIdsB, edgeIdsB);
+
+    return res;
+}
+
+// How far inside the feature the path has to pass for a warm hit, closer calls go to the full scan.
+static const float WarmHitMargin = 1e-4f;
+
+// The warm result has to be the same as the full scan in sumApproach(). The scan misses when the path
+// passes outside the extreme vertices of the sum across it, and otherwise returns the first segment body
+// or the nearest cap the path hits. The side of the path is measured the same way here.
+static bool warmApproach(const PreparedCollider& colA, const PreparedCollider& colB, const Vec2 relPos, const Vec2 relVel,
+                         const float totalRad, const float maxTime, const FeaturePair feature, ApproachRes& res)
+{
+    Vec2 pts[2];
+    const int n = sumFeature(colA, colB, feature, pts);
+    if (n == 0)
+        return false;
+
+    const Vec2 testDir = norm(relVel);
+
+    float t;
+    if (n == 1)
+    {
+        const Vec2 p = pts[0];
+        const Vec2 diff = relPos - p;
+        const float side = perp(testDir, p - relPos);
+        if (side + totalRad < 0.0f || side - totalRad > 0.0f)
+        {
+            // Miss, valid if the vertex is strictly the extreme point of the sum towards the path,
+            // which makes it the first or last vertex of the scanned sum. Ties go to the full scan.
+            if (!inSumFeatureCone(colA, colB, feature, diff - testDir * dot(diff, testDir), true))
+                return false;
+            circleCircleCPA(relPos, relVel, totalRad, p, t);
+            res.hit = false;
+        }
+        else
+        {
+            // Cap hit, valid if the hit normal is in the vertex cone.
+            if (fabsf(side) > totalRad - WarmHitMargin)
+                return false;
+            if (!circleCircleCPA(relPos, relVel, totalRad, p, t) ||
+                !inSumFeatureCone(colA, colB, feature, relPos + relVel * t - p, false))
+                return false;
+            res.hit = true;
+        }
+    }
+    else
+    {
+        // Body hit, valid if the segment is front facing and it is an edge of the sum. The sum is ordered
+        // across the path, keep the same order so that the TOI is computed the same way.
+        const bool flip = perp(relVel, pts[1] - pts[0]) > 0.0f;
+        const Vec2 p = flip ? pts[1] : pts[0];
+        const Vec2 q = flip ? pts[0] : pts[1];
+        Vec2 segNorm = left(q - p);
+        if (dot(segNorm, p + q) < 0.0f)
+            segNorm = -segNorm;
+        if (dot(segNorm, relVel) >= 0.0f || !inSumFeatureCone(colA, colB, feature, segNorm, false))
+            return false;
+        // The path has to pass between the ends, so that the extremes of the sum are on both sides too.
+        if (perp(testDir, p - relPos) + totalRad < WarmHitMargin || perp(testDir, q - relPos) - totalRad > -WarmHitMargin)
+            return false;
+        if (!circleSegmentBodyTOI(relPos, relVel, totalRad, p, q, t))
+            return false;
+        res.hit = true;
+    }
+
+    res.t = clampf(t, 0.0f, maxTime);
+    return true;
+}
+
+ApproachRes closestPointOfApproach(const PreparedCollider& colA, const Vec2 velA, const PreparedCollider& colB, const Vec2 velB,
+                                   const float maxTime, FeaturePair& feature)
+{
+    TRACE_SCOPE("closestPointOfApproach");
+    const Vec2 relVel = velA - velB;
+    const Vec2 relPos = colA.pos - colB.pos;
+    const float totalRad = snapExtent(colA.rad + colB.rad);
+
+    if (lenSq(relVel) < StationarySpeedSq)
+    {
+        COUNT_PATH(CpaStationary);
+        feature = FeaturePair();
+        ApproachRes res;
+        res.hit = stationaryDistance(colA, colB, relPos, totalRad) <= 0.0f;
+        return res;
+    }
+
+    if (!hasWarmStartFeatures(colA, colB))
+    {
+        // Analytic cases, nothing to cache.
+        feature = FeaturePair();
+        return closestPointOfApproach(colA, velA, colB, velB, maxTime);
+    }
+
+    ApproachRes res;
+    if (warmApproach(colA, colB, relPos, relVel, totalRad, maxTime, feature, res))
+        return res;
+
+    Vec2 chainA[3];
+    Vec2 chainB[3];
+    const int numA = makeChain(colA, relVel, chainA);
+    const int numB = makeChain(colB, relVel, chainB);
+
+    Vec2 sum[5];
+    uint8_t sumColIdx[5];
+    uint8_t sumSegIdx[5];
+    const int numSum = minkowskiChain(chainA, numA, chainB, numB, sum, sumColIdx, sumSegIdx, 5);
+
+    int vertex, segment;
+    res = sumApproach(relPos, relVel, totalRad, maxTime, sum, numSum, vertex, segment);
+
+    // A is mirrored in the sum, so its features come from the chain facing the other way.
+    uint8_t vertIdsA[3], edgeIdsA[2];
+    uint8_t vertIdsB[3], edgeIdsB[2];
+    chainFeatures(colA.type, chainQuadrant(colA.up, -relVel), vertIdsA, edgeIdsA);
+    chainFeatures(colB.type, chainQuadrant(colB.up, relVel), vertIdsB, edgeIdsB);
+
+    int ia[5];
+    int ib[5];
+    sumChainIndices(sumColIdx, sumSegIdx, numSum, ia, ib);
+    feature = sumFeaturePair(vertex, segment, sumColIdx, ia, ib, vertIdsA, edgeIdsA, vertIdsB, edgeIdsB);
+
+    return res;
+}
+
+// Minkowski sum facing the relative velocity, the analytic cases are returned as the skeleton of the sum.
+static int approachSum(const Collider& colA, const Collider& colB, const Vec2 relVel, Vec2 sum[5])
+{
+    if (colA.type == ColliderType::Circle && colB.type == ColliderType::Circle)
+    {
+        sum[0] = Vec2(0,0);
+        return 1;
+    }
+    else if ((colA.type == ColliderType::Circle && colB.type == ColliderType::Pill) ||
+             (colA.type == ColliderType::Pill && colB.type == ColliderType::Circle))
+    {
+        // Ordered across the relative velocity like the chains, sumApproach() relies on it.
+        const Vec2 axis = colA.type == ColliderType::Pill ? (colA.up * snapExtent(colA.ext.y)) : (colB.up * snapExtent(colB.ext.y));
+        const Vec2 stem = axis * signf(perp(axis, relVel));
+        sum[0] = -stem;
+        sum[1] = stem;
+        return 2;
+    }
+
+    Vec2 chainA[3];
+    Vec2 chainB[3];
+    const int numA = makeChain(colA, relVel, chainA);
+    const int numB = makeChain(colB, relVel, chainB);
+    uint8_t sumColIdx[5];
+    uint8_t sumSegIdx[5];
+    return minkowskiChain(chainA, numA, chainB, numB, sum, sumColIdx, sumSegIdx, 5);
+}
+
+static int approachSum(const PreparedCollider& colA, const PreparedCollider& colB, const Vec2 relVel, Vec2 sum[5])
+{
+    if (colA.type == ColliderType::Circle && colB.type == ColliderType::Circle)
+    {
+        sum[0] = Vec2(0,0);
+        return 1;
+    }
+    else if ((colA.type == ColliderType::Circle && colB.type == ColliderType::Pill) ||
+             (colA.type == ColliderType::Pill && colB.type == ColliderType::Circle))
+    {
+        // Ordered across the relative velocity like the chains, sumApproach() relies on it.
+        const Vec2 axis = colA.type == ColliderType::Pill ? colA.axisY : colB.axisY;
+        const Vec2 stem = axis * signf(perp(axis, relVel));
+        sum[0] = -stem;
+        sum[1] = stem;
+        return 2;
+    }
+
+    Vec2 chainA[3];
+    Vec2 chainB[3];
+    const int numA = makeChain(colA, relVel, chainA);
+    const int numB = makeChain(colB, relVel, chainB);
+    uint8_t sumColIdx[5];
+    uint8_t sumSegIdx[5];
+    return minkowskiChain(chainA, numA, chainB, numB, sum, sumColIdx, sumSegIdx, 5);
+}
+
+// Signed distance from the relative path to the nearer side of the sum, negative when the path crosses the sum.
+// The sides are the same extrema that are used to test for a hit in sumApproach().
+static void pathClearance(const Vec2 relPos, const Vec2 relVel, const float totalRad, const Vec2* sum, const int numSum,
+                          float& dist, Vec2& grad)
+{
+    const float speed = len(relVel);
+    const Vec2 dir = relVel / speed;
+
+    int imin = 0;
+    int imax = 0;
+    float pmin = perp(dir, sum[0] - relPos);
+    float pmax = pmin;
+    for (int i = 1; i < numSum; i++)
+    {
+        const float p = perp(dir, sum[i] - relPos);
+        if (p < pmin) { pmin = p; imin = i; }
+        if (p > pmax) { pmax = p; imax = i; }
+    }
+
+    const float hi = pmax + totalRad;
+    const float lo = pmin - totalRad;
+    const bool clearLeft = hi < -lo;
+
+    // d perp(dir, w) / d relVel, where dir = relVel / |relVel|.
+    const Vec2 w = (clearLeft ? sum[imax] : sum[imin]) - relPos;
+    const Vec2 dperp = Vec2(-w.y, w.x);
+    const Vec2 dpdv = (dperp - dir * dot(dir, dperp)) / speed;
+
+    dist = clearLeft ? -hi : lo;
+    grad = clearLeft ? -dpdv : dpdv;
+}
+
+// When CPA is not a collision, t minimizes the distance along the path, so the gradient is the distance
+// normal scaled by t.
+static ApproachGradRes approachGrad(const ApproachRes cpa, const DistanceRes nearest)
+{
+    ApproachGradRes res;
+    res.t = cpa.t;
+    res.hit = cpa.hit;
+    res.dist = nearest.dist;
+    res.grad = nearest.norm * cpa.t;
+    return res;
+}
+
+// Colliding within the horizon switches to the path clearance.
+static bool collidesBeforeMaxTime(const Vec2 relVel, const float maxTime, const ApproachRes cpa, const DistanceRes nearest)
+{
+    const bool approaching = dot(relVel, nearest.norm) < 0.0f;
+    return cpa.hit && approaching && cpa.t < maxTime && lenSq(relVel) >= StationarySpeedSq;
+}
+
+ApproachGradRes closestPointOfApproachGrad(const Collider& colA, const Vec2 velA, const Collider& colB, const Vec2 velB, const float maxTime)
+{
+    const Vec2 relVel = velA - velB;
+    const Vec2 relPos = colA.pos - colB.pos;
+    const float totalRad = snapExtent(colA.rad + colB.rad);
+
+    const ApproachRes cpa = closestPointOfApproach(colA, velA, colB, velB, maxTime);
+    const DistanceRes nearest = nearestDistance(colA, velA * cpa.t, colB, velB * cpa.t);
+
+    ApproachGradRes res = approachGrad(cpa, nearest);
+
+    if (collidesBeforeMaxTime(relVel, maxTime, cpa, nearest))
+    {
+        Vec2 sum[5];
+        const int numSum = approachSum(colA, colB, relVel, sum);
+        pathClearance(relPos, relVel, totalRad, sum, numSum, res.dist, res.grad);
+    }
+
+    return res;
+}
+
+ApproachGradRes closestPointOfApproachGrad(const PreparedCollider& colA, const Vec2 velA, const PreparedCollider& colB, const Vec2 velB, const float maxTime)
+{
+    const Vec2 relVel = velA - velB;
+    const Vec2 relPos = colA.pos - colB.pos;
+    const float totalRad = snapExtent(colA.rad + colB.rad);
+
+    const ApproachRes cpa = closestPointOfApproach(colA, velA, colB, velB, maxTime);
+    const DistanceRes nearest = nearestDistance(colA, velA * cpa.t, colB, velB * cpa.t);
+
+    ApproachGradRes res = approachGrad(cpa, nearest);
+
+    if (collidesBeforeMaxTime(relVel, maxTime, cpa, nearest))
+    {
+        Vec2 sum[5];
+        const int numSum = approachSum(colA, colB, relVel, sum);
+        pathClearance(relPos, relVel, totalRad, sum, numSum, res.dist, res.grad);
+    }
+
+    return res;
+}
+
+// All vertices of the collider skeleton, relative to its position.
+static int skeletonVertices(const Collider& col, Vec2 verts[4])
+{
+    const Vec2 axisX = left(col.up) * col.ext.x;
+    const Vec2 axisY = col.up * col.ext.y;
+    if (col.type == ColliderType::Circle)
+    {
+        verts[0] = Vec2(0,0);
+        return 1;
+    }
+    else if (col.type == ColliderType::Pill)
+    {
+        verts[0] = -axisY;
+        verts[1] = axisY;
+        return 2;
+    }
+    verts[0] = axisX + axisY;
+    verts[1] = axisX - axisY;
+    verts[2] = -axisX - axisY;
+    verts[3] = -axisX + axisY;
+    return 4;
+}
+
+static int skeletonVertices(const PreparedCollider& col, Vec2 verts[4])
+{
+    if (col.type == ColliderType::Circle)
+    {
+        verts[0] = Vec2(0,0);
+        return 1;
+    }
+    else if (col.type == ColliderType::Pill)
+    {
+        verts[0] = -col.axisY;
+        verts[1] = col.axisY;
+        return 2;
+    }
+    verts[0] = col.axisX + col.axisY;
+    verts[1] = col.axisX - col.axisY;
+    verts[2] = -col.axisX - col.axisY;
+    verts[3] = -col.axisX + col.axisY;
+    return 4;
+}
+
+// The cone edges are the outermost tangents from relPos to the rounded vertices of the sum. The partial chains
+// only hold the extrema as seen from infinity, from a finite distance the tangent can be at any vertex,
+// so all vertex pairs are tested.
+static VelocityObstacle sumObstacle(const Vec2 relPos, const float totalRad, const float dist,
+                                    const Vec2* vertsA, const int numA, const Vec2* vertsB, const int numB,
+                                    const Vec2 velB, const float maxTime)
+{
+    VelocityObstacle vo;
+    vo.apex = velB;
+    vo.minSpeed = maxf(0.0f, dist) / maxTime;
+
+    const Vec2 center = lenSq(relPos) > 1e-12f ? norm(-relPos) : Vec2(1,0);
+    const Vec2 side = left(center);
+
+    if (dist <= 0.0f)
+    {
+        vo.overlap = true;
+        vo.left = center;
+        vo.right = center;
+        return vo;
+    }
+
+    float amin = 1e6f;
+    float amax = -1e6f;
+    for (int i = 0; i < numA; i++)
+    {
+        for (int j = 0; j < numB; j++)
+        {
+            const Vec2 w = vertsA[i] + vertsB[j] - relPos;
+            const float a = atan2f(dot(side, w), dot(center, w));
+            const float d = maxf(len(w), 1e-6f);
+            const float half = asinf(minf(1.0f, totalRad / d));
+            const float tangentDist = sqrtf(maxf(0.0f, sqrf(d) - sqrf(totalRad)));
+            if (a - half < amin)
+            {
+                amin = a - half;
+                vo.rightDist = tangentDist;
+            }
+            if (a + half > amax)
+            {
+                amax = a + half;
+                vo.leftDist = tangentDist;
+            }
+        }
+    }
+
+    vo.left = center * cosf(amax) + side * sinf(amax);
+    vo.right = center * cosf(amin) + side * sinf(amin);
+
+    return vo;
+}
+
+VelocityObstacle velocityObstacle(const Collider& colA, const Collider& colB, const Vec2 velB, const float maxTime)
+{
+    const Vec2 relPos = colA.pos - colB.pos;
+    const float totalRad = snapExtent(colA.rad + colB.rad);
+    const DistanceRes nearest = nearestDistance(colA, Vec2(0,0), colB, Vec2(0,0));
+
+    Vec2 vertsA[4];
+    Vec2 vertsB[4];
+    const int numA = skeletonVertices(colA, vertsA);
+    const int numB = skeletonVertices(colB, vertsB);
+
+    return sumObstacle(relPos, totalRad, nearest.dist, vertsA, numA, vertsB, numB, velB, maxTime);
+}
+
+VelocityObstacle velocityObstacle(const PreparedCollider& colA, const PreparedCollider& colB, const Vec2 velB, const float maxTime)
+{
+    const Vec2 relPos = colA.pos - colB.pos;
+    const float totalRad = snapExtent(colA.rad + colB.rad);
+    const DistanceRes nearest = nearestDistance(colA, Vec2(0,0), colB, Vec2(0,0));
+
+    Vec2 vertsA[4];
+    Vec2 vertsB[4];
+    const int numA = skeletonVertices(colA, vertsA);
+    const int numB = skeletonVertices(colB, vertsB);
+
+    return sumObstacle(relPos, totalRad, nearest.dist, vertsA, numA, vertsB, numB, velB, maxTime);
+}
+
+enum class ContourFeature : uint8_t
+{
+    Now,        // CPA is clamped to zero, A is moving away.
+    Horizon,    // CPA is clamped to maxTime.
+    HitVertex,
+    HitSegment,
+    MissVertex,
+};
+
+// Which feature of the sum determines CPA for a heading, and the position of A relative to B at CPA.
+struct ContourSample
+{
+    Vec2 pos;
+    Vec2 p;     // sum vertex, or segment start.
+    Vec2 q;     // segment end.
+    ContourFeature feature = ContourFeature::Now;
+};
+
+static bool sameContourFeature(const ContourSample& a, const ContourSample& b)
+{
+    if (a.feature != b.feature)
+        return false;
+    if (a.feature == ContourFeature::Now || a.feature == ContourFeature::Horizon)
+        return true;
+    return a.p.x == b.p.x && a.p.y == b.p.y && a.q.x == b.q.x && a.q.y == b.q.y;
+}
+
+static ContourSample contourSample(const Collider& colA, const Collider& colB, const Vec2 relPos, const Vec2 velB,
+                                   const float totalRad, const float speed, const float maxTime, const float heading)
+{
+    ContourSample res;
+    const Vec2 relVel = Vec2(cosf(heading), sinf(heading)) * speed - velB;
+    if (lenSq(relVel) < 1e-12f)
+    {
+        res.pos = relPos;
+        return res;
+    }
+
+    Vec2 sum[5];
+    const int numSum = approachSum(colA, colB, relVel, sum);
+
+    int vertex, segment;
+    const ApproachRes cpa = sumApproach(relPos, relVel, totalRad, maxTime, sum, numSum, vertex, segment);
+
+    res.pos = relPos + relVel * cpa.t;
+    if (cpa.t >= maxTime)
+    {
+        res.feature = ContourFeature::Horizon;
+    }
+    else if (cpa.t <= 0.0f)
+    {
+        res.feature = ContourFeature::Now;
+    }
+    else if (segment != -1)
+    {
+        res.feature = ContourFeature::HitSegment;
+        res.p = sum[segment];
+        res.q = sum[segment+1];
+    }
+    else
+    {
+        res.feature = cpa.hit ? ContourFeature::HitVertex : ContourFeature::MissVertex;
+        res.p = sum[vertex];
+    }
+
+    return res;
+}
+
+// Geometry of the piece for a feature, the position along the piece is measured by contourParam().
+struct ContourShape
+{
+    Vec2 center;
+    Vec2 dir;
+    float rad = 0.0f;
+    ContourPieceType type = ContourPieceType::Segment;
+};
+
+static ContourShape contourShape(const ContourSample& sample, const Vec2 relPos, const Vec2 velB,
+                                 const float totalRad, const float speed, const float maxTime)
+{
+    ContourShape shape;
+    switch (sample.feature)
+    {
+    case ContourFeature::Now:
+        shape.center = relPos;
+        break;
+    case ContourFeature::HitSegment:
+        shape.center = sample.p;
+        shape.dir = sample.q - sample.p;
+        break;
+    case ContourFeature::Horizon:
+        shape.type = ContourPieceType::Arc;
+        shape.center = relPos - velB * maxTime;
+        shape.rad = speed * maxTime;
+        break;
+    case ContourFeature::HitVertex:
+        shape.type = ContourPieceType::Arc;
+        shape.center = sample.p;
+        shape.rad = totalRad;
+        break;
+    case ContourFeature::MissVertex:
+        // The nearest point on each path is where it is perpendicular to the vertex, which is a circle through both.
+        shape.type = ContourPieceType::Arc;
+        shape.center = (relPos + sample.p) * 0.5f;
+        shape.rad = len(relPos - sample.p) * 0.5f;
+        break;
+    }
+    return shape;
+}
+
+// Angle around the arc, unwrapped close to ref, or distance along the segment.
+static float contourParam(const ContourShape& shape, const Vec2 pos, const float ref)
+{
+    if (shape.type == ContourPieceType::Segment)
+        return dot(pos - shape.center, shape.dir);
+    float a = atan2f(pos.y - shape.center.y, pos.x - shape.center.x);
+    while (a - ref > M_PI) a -= M_PI*2;
+    while (a - ref < -M_PI) a += M_PI*2;
+    return a;
+}
+
+static void addContourPiece(ContourPiece* pieces, int& numPieces, const int maxPieces, const ContourShape& shape,
+                            const Vec2 start, const Vec2 end, const float a0, const float a1,
+                            const float heading0, const float heading1)
+{
+    if (numPieces < maxPieces)
+    {
+        ContourPiece& piece = pieces[numPieces];
+        piece.type = shape.type;
+        piece.start = start;
+        piece.end = end;
+        piece.center = shape.center;
+        piece.rad = shape.rad;
+        piece.a0 = shape.type == ContourPieceType::Arc ? a0 : 0.0f;
+        piece.a1 = shape.type == ContourPieceType::Arc ? a1 : 0.0f;
+        piece.heading0 = heading0;
+        piece.heading1 = heading1;
+    }
+    numPieces++;
+}
+
+// Position of A relative to B at CPA for a heading, following the feature of the sample instead of searching
+// the sum, so that the pieces end exactly at the breakpoints.
+static Vec2 contourPos(const ContourSample& sample, const Vec2 relPos, const Vec2 velB, const float totalRad,
+                       const float speed, const float maxTime, const float heading)
+{
+    const Vec2 relVel = Vec2(cosf(heading), sinf(heading)) * speed - velB;
+    const float velSq = lenSq(relVel);
+    if (velSq < 1e-12f)
+        return relPos;
+
+    float t = 0.0f;
+    switch (sample.feature)
+    {
+    case ContourFeature::Now:
+        break;
+    case ContourFeature::Horizon:
+        t = maxTime;
+        break;
+    case ContourFeature::HitVertex:
+        circleCircleCPA(relPos, relVel, totalRad, sample.p, t);
+        break;
+    case ContourFeature::HitSegment:
+    {
+        // Where the path crosses the edge offset by totalRad towards A.
+        Vec2 n = norm(left(sample.q - sample.p));
+        if (dot(n, relPos - sample.p) < 0.0f)
+            n = -n;
+        const float vn = dot(relVel, n);
+        t = vn < -1e-9f ? (totalRad - dot(relPos - sample.p, n)) / vn : 0.0f;
+        break;
+    }
+    case ContourFeature::MissVertex:
+        t = dot(sample.p - relPos, relVel) / velSq;
+        break;
+    }
+
+    return relPos + relVel * clampf(t, 0.0f, maxTime);
+}
+
+// Convex hull of the Minkowski sum of the skeletons, sorted around the hull. Returns number of vertices.
+static int skeletonSumHull(const Vec2* vertsA, const int numA, const Vec2* vertsB, const int numB, Vec2 hull[16])
+{
+    Vec2 pts[16];
+    int numPts = 0;
+    for (int i = 0; i < numA; i++)
+    {
+        for (int j = 0; j < numB; j++)
+        {
+            // Insertion sort by x, then y.
+            const Vec2 v = vertsA[i] + vertsB[j];
+            int k = numPts++;
+            while (k > 0 && (pts[k-1].x > v.x || (pts[k-1].x == v.x && pts[k-1].y > v.y)))
+            {
+                pts[k] = pts[k-1];
+                k--;
+            }
+            pts[k] = v;
+        }
+    }
+
+    // Monotone chain, collinear and duplicate points are dropped.
+    static const float collinearEps = 1e-9f;
+    Vec2 tmp[33];
+    int n = 0;
+    for (int i = 0; i < numPts; i++)
+    {
+        while (n >= 2 && perp(tmp[n-1] - tmp[n-2], pts[i] - tmp[n-2]) <= collinearEps)
+            n--;
+        tmp[n++] = pts[i];
+    }
+    for (int i = numPts-2, lower = n+1; i >= 0; i--)
+    {
+        while (n >= lower && perp(tmp[n-1] - tmp[n-2], pts[i] - tmp[n-2]) <= collinearEps)
+            n--;
+        tmp[n++] = pts[i];
+    }
+    // The last point closes the loop.
+    n = maxi(1, n-1);
+    if (n == 2 && lenSq(tmp[1] - tmp[0]) < 1e-12f)
+        n = 1;
+
+    for (int i = 0; i < n; i++)
+        hull[i] = tmp[i];
+    return n;
+}
+
+// Headings of A where the relative velocity points along dir, at most two.
+static int directionHeadings(const Vec2 dir, const Vec2 velB, const float speed, float headings[2])
+{
+    // |velB + dir * s| = speed, for s > 0.
+    const float b = dot(dir, velB);
+    const float h = sqrf(b) - lenSq(velB) + sqrf(speed);
+    if (h < 0.0f)
+        return 0;
+    const float r = sqrtf(h);
+    int n = 0;
+    if (r - b > 0.0f)
+    {
+        const Vec2 v = velB + dir * (r - b);
+        headings[n++] = atan2f(v.y, v.x);
+    }
+    if (-r - b > 0.0f && r > 0.0f)
+    {
+        const Vec2 v = velB + dir * (-r - b);
+        headings[n++] = atan2f(v.y, v.x);
+    }
+    return n;
+}
+
+static int circleCircleIntersections(const Vec2 c0, const float r0, const Vec2 c1, const float r1, Vec2 pts[2])
+{
+    const Vec2 d = c1 - c0;
+    const float dist = len(d);
+    if (dist < 1e-6f || dist > r0 + r1 || dist < fabsf(r0 - r1))
+        return 0;
+    const Vec2 u = d / dist;
+    const float a = (sqrf(r0) - sqrf(r1) + sqrf(dist)) / (2.0f * dist);
+    const float h = sqrtf(maxf(0.0f, sqrf(r0) - sqrf(a)));
+    pts[0] = c0 + u * a + left(u) * h;
+    pts[1] = c0 + u * a - left(u) * h;
+    return 2;
+}
+
+static int segmentCircleIntersections(const Vec2 p, const Vec2 q, const Vec2 center, const float rad, Vec2 pts[2])
+{
+    const Vec2 d = q - p;
+    const Vec2 f = p - center;
+    const float a = lenSq(d);
+    if (a < 1e-12f)
+        return 0;
+    const float b = dot(f, d);
+    const float h = sqrf(b) - a * (lenSq(f) - sqrf(rad));
+    if (h < 0.0f)
+        return 0;
+    const float r = sqrtf(h);
+    int n = 0;
+    const float t0 = (-b - r) / a;
+    const float t1 = (-b + r) / a;
+    if (t0 >= 0.0f && t0 <= 1.0f)
+        pts[n++] = p + d * t0;
+    if (t1 >= 0.0f && t1 <= 1.0f && r > 0.0f)
+        pts[n++] = p + d * t1;
+    return n;
+}
+
+struct ContourBreak
+{
+    float heading = 0.0f;
+    bool turn = false;  // the direction of the relative velocity turns back.
+};
+
+static const int MaxContourBreaks = 256;
+
+static void addContourBreak(ContourBreak* breaks, int& numBreaks, const float heading, const bool turn)
+{
+    if (numBreaks < MaxContourBreaks)
+    {
+        breaks[numBreaks].heading = heading;
+        breaks[numBreaks].turn = turn;
+        numBreaks++;
+    }
+}
+
+static void addDirectionBreaks(ContourBreak* breaks, int& numBreaks, const Vec2 dir, const Vec2 velB, const float speed)
+{
+    if (lenSq(dir) < 1e-12f)
+        return;
+    float headings[2];
+    const int n = directionHeadings(norm(dir), velB, speed, headings);
+    for (int i = 0; i < n; i++)
+        addContourBreak(breaks, numBreaks, headings[i], false);
+}
+
+// Headings where a point on the horizon circle is reached at maxTime.
+static void addHorizonBreaks(ContourBreak* breaks, int& numBreaks, const Vec2* pts, const int numPts, const Vec2 horizonCenter)
+{
+    for (int i = 0; i < numPts; i++)
+        addContourBreak(breaks, numBreaks, atan2f(pts[i].y - horizonCenter.y, pts[i].x - horizonCenter.x), false);
+}
+
+static bool startsContourPiece(const ContourSample* features, const bool* turns, const int num, const int i)
+{
+    const int prev = (i + num - 1) % num;
+    return turns[i] || !sameContourFeature(features[prev], features[i]);
+}
+
+int cpaContour(const Collider& colA, const Collider& colB, const Vec2 velB, const float speed, const float maxTime,
+               ContourPiece* pieces, const int maxPieces)
+{
+    const Vec2 relPos = colA.pos - colB.pos;
+    const float totalRad = snapExtent(colA.rad + colB.rad);
+    const float pi = (float)M_PI;
+
+    Vec2 vertsA[4];
+    Vec2 vertsB[4];
+    const int numA = skeletonVertices(colA, vertsA);
+    const int numB = skeletonVertices(colB, vertsB);
+    Vec2 hull[16];
+    const int numHull = skeletonSumHull(vertsA, numA, vertsB, numB, hull);
+    Vec2 hullCenter(0,0);
+    for (int i = 0; i < numHull; i++)
+        hullCenter += hull[i] / (float)numHull;
+
+    const Vec2 horizonCenter = relPos - velB * maxTime;
+    const float horizonRad = speed * maxTime;
+
+    // The feature that determines CPA changes only at the headings below, a superset is fine.
+    ContourBreak breaks[MaxContourBreaks];
+    int numBreaks = 0;
+
+    for (int i = 0; i < numHull; i++)
+    {
+        const Vec2 w = hull[i] - relPos;
+        const float d = len(w);
+        const float a = atan2f(w.y, w.x);
+
+        // Tangents to the rounded vertex, where the path starts to miss it.
+        if (d > totalRad)
+        {
+            const float half = asinf(totalRad / d);
+            addDirectionBreaks(breaks, numBreaks, Vec2(cosf(a - half), sinf(a - half)), velB, speed);
+            addDirectionBreaks(breaks, numBreaks, Vec2(cosf(a + half), sinf(a + half)), velB, speed);
+        }
+        // Passing the vertex at t = 0.
+        addDirectionBreaks(breaks, numBreaks, left(w), velB, speed);
+        addDirectionBreaks(breaks, numBreaks, -left(w), velB, speed);
+
+        // Reaching the rounded vertex, or passing it, at maxTime.
+        Vec2 pts[2];
+        int n = circleCircleIntersections(horizonCenter, horizonRad, hull[i], totalRad, pts);
+        addHorizonBreaks(breaks, numBreaks, pts, n, horizonCenter);
+        n = circleCircleIntersections(horizonCenter, horizonRad, (relPos + hull[i]) * 0.5f, d * 0.5f, pts);
+        addHorizonBreaks(breaks, numBreaks, pts, n, horizonCenter);
+    }
+
+    for (int i = 0; numHull > 1 && i < numHull; i++)
+    {
+        const Vec2 p = hull[i];
+        const Vec2 q = hull[(i+1) % numHull];
+        const Vec2 n = norm(left(q - p));
+        const float side = dot(n, hullCenter - p);
+
+        // Ends of the offset edge, where the hit moves between the edge and the rounded vertex.
+        // A flat hull has both sides.
+        for (int s = -1; s <= 1; s += 2)
+        {
+            if (s * side > 1e-6f)
+                continue;
+            const Vec2 offset = n * (totalRad * (float)s);
+            addDirectionBreaks(breaks, numBreaks, p + offset - relPos, velB, speed);
+            addDirectionBreaks(breaks, numBreaks, q + offset - relPos, velB, speed);
+
+            Vec2 pts[2];
+            const int num = segmentCircleIntersections(p + offset, q + offset, horizonCenter, horizonRad, pts);
+            addHorizonBreaks(breaks, numBreaks, pts, num, horizonCenter);
+        }
+    }
+
+    // The chains change where the velocity is parallel to the skeleton axes.
+    const Collider* cols[2] = { &colA, &colB };
+    for (int i = 0; i < 2; i++)
+    {
+        if (cols[i]->type == ColliderType::Circle)
+            continue;
+        addDirectionBreaks(breaks, numBreaks, cols[i]->up, velB, speed);
+        addDirectionBreaks(breaks, numBreaks, -cols[i]->up, velB, speed);
+        if (cols[i]->type == ColliderType::Rect)
+        {
+            addDirectionBreaks(breaks, numBreaks, left(cols[i]->up), velB, speed);
+            addDirectionBreaks(breaks, numBreaks, -left(cols[i]->up), velB, speed);
+        }
+    }
+
+    // When B is faster than A, the relative velocity sweeps back and forth within a cone, and the pieces turn back
+    // at its edges. The relative velocity vanishes at the heading of B.
+    const float speedB = len(velB);
+    if (speedB > 0.0f)
+    {
+        const float headingB = atan2f(velB.y, velB.x);
+        if (speedB > speed)
+        {
+            const float half = acosf(speed / speedB);
+            addContourBreak(breaks, numBreaks, headingB - half, true);
+            addContourBreak(breaks, numBreaks, headingB + half, true);
+        }
+        addContourBreak(breaks, numBreaks, headingB, false);
+    }
+
+    // Sort to [-pi,pi) and drop duplicates.
+    for (int i = 0; i < numBreaks; i++)
+    {
+        ContourBreak b = breaks[i];
+        while (b.heading >= pi) b.heading -= pi*2;
+        while (b.heading < -pi) b.heading += pi*2;
+        int k = i;
+        while (k > 0 && breaks[k-1].heading > b.heading)
+        {
+            breaks[k] = breaks[k-1];
+            k--;
+        }
+        breaks[k] = b;
+    }
+    int numUnique = 0;
+    for (int i = 0; i < numBreaks; i++)
+    {
+        if (numUnique > 0 && breaks[i].heading - breaks[numUnique-1].heading < 1e-6f)
+        {
+            breaks[numUnique-1].turn |= breaks[i].turn;
+            continue;
+        }
+        breaks[numUnique++] = breaks[i];
+    }
+    numBreaks = numUnique;
+    if (numBreaks == 0)
+        addContourBreak(breaks, numBreaks, -pi, false);
+
+    // Each interval between the breaks has a single feature, found at its middle. Long intervals are split,
+    // so that the arc angles can be unwrapped between the ends.
+    static const float maxInterval = (float)M_PI * 0.5f;
+    float intervalStart[MaxContourBreaks];
+    ContourSample intervalFeature[MaxContourBreaks];
+    bool intervalTurn[MaxContourBreaks];
+    int numIntervals = 0;
+    for (int i = 0; i < numBreaks && numIntervals < MaxContourBreaks; i++)
+    {
+        const float h0 = breaks[i].heading;
+        const float h1 = i+1 < numBreaks ? breaks[i+1].heading : breaks[0].heading + pi*2;
+        const int numSplits = mini((int)ceilf((h1 - h0) / maxInterval), MaxContourBreaks - numIntervals);
+        const ContourSample feature = contourSample(colA, colB, relPos, velB, totalRad, speed, maxTime, (h0 + h1) * 0.5f);
+        for (int j = 0; j < numSplits; j++)
+        {
+            intervalStart[numIntervals] = h0 + (h1 - h0) * (float)j / (float)numSplits;
+            intervalFeature[numIntervals] = feature;
+            intervalTurn[numIntervals] = j == 0 && breaks[i].turn;
+            numIntervals++;
+        }
+    }
+
+    // Runs of intervals with the same feature form the pieces, starting from a change so that no run wraps around.
+    int first = 0;
+    while (first < numIntervals && !startsContourPiece(intervalFeature, intervalTurn, numIntervals, first))
+        first++;
+    if (first == numIntervals)
+        first = 0;
+
+    int numPieces = 0;
+    int i = 0;
+    while (i < numIntervals)
+    {
+        const int runStart = (first + i) % numIntervals;
+        const ContourSample& feature = intervalFeature[runStart];
+        const ContourShape shape = contourShape(feature, relPos, velB, totalRad, speed, maxTime);
+
+        const float h0 = intervalStart[runStart];
+        const Vec2 start = contourPos(feature, relPos, velB, totalRad, speed, maxTime, h0);
+        const float a0 = contourParam(shape, start, 0.0f);
+        float a1 = a0;
+        float h = h0;
+        Vec2 end = start;
+
+        do
+        {
+            const int k = (first + i) % numIntervals;
+            const int next = (k + 1) % numIntervals;
+            float h1 = intervalStart[next];
+            while (h1 <= h) h1 += pi*2;
+            const Vec2 mid = contourPos(feature, relPos, velB, totalRad, speed, maxTime, (h + h1) * 0.5f);
+            end = contourPos(feature, relPos, velB, totalRad, speed, maxTime, h1);
+            a1 = contourParam(shape, mid, a1);
+            a1 = contourParam(shape, end, a1);
+            h = h1;
+            i++;
+        }
+        while (i < numIntervals && !startsContourPiece(intervalFeature, intervalTurn, numIntervals, (first + i) % numIntervals));
+
+        addContourPiece(pieces, numPieces, maxPieces, shape, start, end, a0, a1, h0, h);
+    }
+
+    return numPieces;
+}
@@ -16,6 +16,9 @@
 // 3. This notice may not be removed or altered from any source distribution.
 //
 
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
 #include "mathutil.h"
 #include <stdint.h>
 
@@ -69,6 +72,30 @@ struct Collider
     ColliderType type = ColliderType::Circle;
 };
 
+// Collider with the per-tick invariants precomputed, so that testing one agent against
+// many neighbours only needs to select the facing features and sum them.
+struct PreparedCollider
+{
+    Vec2 pos;
+    Vec2 up;
+    Vec2 ext;
+    Vec2 axisX;         // left(up) * ext.x
+    Vec2 axisY;         // up * ext.y
+    Vec2 chainTable[6]; // facing chains, any 3 consecutive entries starting at the quadrant index form a chain.
+    Vec2 boundsMin;     // bounds swept along the velocity over the prepared time.
+    Vec2 boundsMax;
+    float rad = 0.0f;
+    float circumRad = 0.0f;
+    ColliderType type = ColliderType::Circle;
+    uint8_t numChain = 1;
+    uint8_t quadShift = 0;
+    uint8_t quadMask = 0;
+};
+
+PreparedCollider prepareCollider(const Collider& col, const Vec2 vel, const float maxTime);
+
+bool sweptBoundsOverlap(const PreparedCollider& colA, const PreparedCollider& colB);
+
 bool circleSegmentBodyCPA(const Vec2 pos, const Vec2 vel, const float rad,
 							const Vec2 segStart, const Vec2 segEnd, float& s, float& t);
 
@@ -81,6 +108,13 @@ float projectPtSeg(const Vec2 pt, const Vec2 start, const Vec2 end);
 
 int makeChain(const Collider& col, const Vec2 dir, Vec2 chain[3]);
 
+int makeChain(const PreparedCollider& col, const Vec2 dir, Vec2 chain[3]);
+
+// Index of the chain makeChain() picks for dir, 0-3. Directions with the same index get the same chain.
+int chainIndex(const PreparedCollider& col, const Vec2 dir);
+
+// Each vertex of the sum is added from the chain vertices instead of accumulating the edges, so that
+// the warm started queries get the bitwise same points from a feature pair.
 int minkowskiChain(const Vec2* chainA, const int numA, const Vec2* chainB, const int numB,
 					Vec2* res, uint8_t* resColIdx, uint8_t* resSegIdx, const int maxRes);
 
@@ -93,10 +127,160 @@ struct DistanceRes
 
 DistanceRes nearestDistance(const Collider& colA, const Vec2 offsetA, const Collider& colB, const Vec2 offsetB);
 
+DistanceRes nearestDistance(const PreparedCollider& colA, const Vec2 offsetA, const PreparedCollider& colB, const Vec2 offsetB);
+
+// Contact feature IDs are vertex indices of the collider (rect corners in chain order, pill spine ends),
+// edges have FeatureEdge set and are identified by their first vertex, the pill spine is always edge 0.
+constexpr uint8_t FeatureEdge = 0x80;
+
+constexpr uint8_t FeatureNone = 0xff;
+
+// Features that determined the result of a query, used to warm start the same query next tick.
+struct FeaturePair
+{
+    uint8_t featureA = FeatureNone;
+    uint8_t featureB = FeatureNone;
+};
+
+struct ContactPoint
+{
+    Vec2 posA;          // point on the surface of A.
+    Vec2 posB;          // point on the surface of B.
+    float dist = 0.0f;  // separation along the normal, negative when overlapping.
+    uint8_t featureA = 0;
+    uint8_t featureB = 0;
+};
+
+struct ContactRes
+{
+    Vec2 norm;
+    float dist = 0.0f;
+    ContactPoint points[2];
+    int numPoints = 0;
+};
+
+// Nearest distance, plus 1-2 contact points from the nearest vertex or segment of the Minkowski chain.
+ContactRes nearestContact(const Collider& colA, const Vec2 offsetA, const Collider& colB, const Vec2 offsetB);
+
+ContactRes nearestContact(const PreparedCollider& colA, const Vec2 offsetA, const PreparedCollider& colB, const Vec2 offsetB);
+
 struct ApproachRes
 {
     float t = 0.0f;
     bool hit = false;
 };
 
-ApproachRes closestPointOfApproach(const Collider& colA, const Vec2 velA, const Collider& colB, const Vec2 velB, const float maxTime);
\ No newline at end of file
+// Without relative motion the result is t = 0, and a hit if nearestDistance() at t = 0 is not positive.
+// Very small shapes can make denormal intermediates, callers running many queries should flush them to zero,
+// see ScopedFlushDenormals.
+ApproachRes closestPointOfApproach(const Collider& colA, const Vec2 velA, const Collider& colB, const Vec2 velB, const float maxTime);
+
+ApproachRes closestPointOfApproach(const PreparedCollider& colA, const Vec2 velA, const PreparedCollider& colB, const Vec2 velB, const float maxTime);
+
+// Warm started queries. The cached feature pair is tested first, and the full chain scan is only done
+// when it is not valid anymore. The feature pair is updated with the features of the result.
+// Circle-circle and circle-pill pairs are solved analytically and have no features, see hasWarmStartFeatures().
+DistanceRes nearestDistance(const PreparedCollider& colA, const Vec2 offsetA, const PreparedCollider& colB, const Vec2 offsetB,
+                            FeaturePair& feature);
+
+ApproachRes closestPointOfApproach(const PreparedCollider& colA, const Vec2 velA, const PreparedCollider& colB, const Vec2 velB,
+                                   const float maxTime, FeaturePair& feature);
+
+// False for the pairs that the warm started queries solve without features, callers can skip the
+// contact cache lookup for them.
+inline bool hasWarmStartFeatures(const PreparedCollider& colA, const PreparedCollider& colB)
+{
+    return !((colA.type == ColliderType::Circle && colB.type != ColliderType::Rect) ||
+             (colB.type == ColliderType::Circle && colA.type != ColliderType::Rect));
+}
+
+struct ApproachGradRes
+{
+    Vec2 grad;          // derivative of dist with respect to velA.
+    float t = 0.0f;
+    float dist = 0.0f;
+    bool hit = false;
+};
+
+// Closest point of approach, plus the distance at CPA and its gradient with respect to the velocity of A.
+// When the bodies collide within maxTime, the distance at first contact is always zero, and dist is instead
+// the negative distance the relative path needs to move sideways to clear the other body.
+ApproachGradRes closestPointOfApproachGrad(const Collider& colA, const Vec2 velA, const Collider& colB, const Vec2 velB, const float maxTime);
+
+ApproachGradRes closestPointOfApproachGrad(const PreparedCollider& colA, const Vec2 velA, const PreparedCollider& colB, const Vec2 velB, const float maxTime);
+
+// Velocity obstacle of B in the velocity space of A. Velocities of A between the left and right edges
+// collide with B, unless the relative speed is below minSpeed, in which case they cannot reach B within maxTime.
+// Left is on the left() side of the direction towards B.
+struct VelocityObstacle
+{
+    Vec2 apex;              // velocity of B.
+    Vec2 left;              // unit direction of the left edge.
+    Vec2 right;             // unit direction of the right edge.
+    float leftDist = 0.0f;  // distance from A to where the left edge touches B.
+    float rightDist = 0.0f; // distance from A to where the right edge touches B.
+    float minSpeed = 0.0f;
+    bool overlap = false;   // bodies overlap, every velocity collides.
+};
+
+VelocityObstacle velocityObstacle(const Collider& colA, const Collider& colB, const Vec2 velB, const float maxTime);
+
+VelocityObstacle velocityObstacle(const PreparedCollider& colA, const PreparedCollider& colB, const Vec2 velB, const float maxTime);
+
+enum class ContourPieceType : uint8_t
+{
+    Arc,
+    Segment,
+};
+
+// Piece of the CPA contour, positions are relative to B.
+struct ContourPiece
+{
+    Vec2 start;
+    Vec2 end;
+    Vec2 center;            // arc center.
+    float rad = 0.0f;       // arc radius.
+    float a0 = 0.0f;        // arc angle at start.
+    float a1 = 0.0f;        // arc angle at end, less than a0 if the arc runs clockwise.
+    float heading0 = 0.0f;  // heading of A at start.
+    float heading1 = 0.0f;  // heading of A at end.
+    ContourPieceType type = ContourPieceType::Arc;
+};
+
+// Contour of the position of A relative to B at CPA, when A moves at the given speed in every heading.
+// It is made of the rounded corners and offset edges of the Minkowski sum where A hits B, circles through
+// the sum vertices where A passes by, and a circle of the horizon when CPA is clamped to maxTime.
+// The headings where the piece can change are solved from the sum: the tangents to the rounded vertices, the ends
+// of the offset edges, the skeleton axes where the facing chain changes, and where the features are reached at zero
+// time or at maxTime. Each interval between them is classified with a single CPA query. A piece is also split where
+// the relative velocity turns back, so that each piece is swept monotonically. Returns number of pieces, at most
+// maxPieces are stored.
+int cpaContour(const Collider& colA, const Collider& colB, const Vec2 velB, const float speed, const float maxTime,
+               ContourPiece* pieces, const int maxPieces);
+
+// Paths taken in closestPointOfApproach() and nearestDistance(). Counted only when compiled with DISTANCE_COUNTERS
+// defined, otherwise the counting compiles away and the functions below do nothing.
+enum class DistanceCounter : uint8_t
+{
+    CpaStationary,      // no relative motion, early return.
+    CpaCircleCircle,    // circle-circle early return.
+    CpaCirclePill,      // circle-pill early return.
+    CpaChainMiss,       // chain sum cannot be hit, firstDist * lastDist > 0.
+    CpaSegmentHit,      // hit the body of a sum segment.
+    CpaCapHit,          // hit a rounded sum vertex.
+    CpaNoHit,           // passed between the extremes without hitting anything.
+    CpaSegmentTests,    // iterations of the segment loop.
+    CpaCapTests,        // iterations of the cap loop.
+    DistCircleCircle,
+    DistCirclePill,
+    DistChain,
+    Count,
+};
+
+// Each thread counts into its own cache line aligned block, the totals are summed over all threads.
+// Reading or resetting while other threads are counting gives approximate results.
+void getDistanceCounters(uint64_t counts[(int)DistanceCounter::Count]);
+void resetDistanceCounters();
+void dumpDistanceCounters();
+
+#endif // DISTANCE_H
@@ -38,10 +38,12 @@ solution "cpa"
 		files { "*.cpp", "*.c" }
 		includedirs { "nanovg" }
 		targetdir("Build")
+		-- defines { "DISTANCE_COUNTERS" } Uncomment to count the paths taken in the distance queries
+		-- defines { "TRACE_MARKERS" } Uncomment to record trace markers, see trace.h
 	 
 		configuration { "linux" }
 			 linkoptions { "`pkg-config --libs glfw3`" }
-			 links { "GL", "GLU", "m", "GLEW" }
+			 links { "GL", "GLU", "m", "GLEW", "pthread" }
 			 defines { "NANOVG_GLEW" }
 
 		configuration { "windows" }
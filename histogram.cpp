@@ -0,0 +1,115 @@
+#include "histogram.h"
+#include <stdio.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static int highestBit(const uint64_t x)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long idx;
+    _BitScanReverse64(&idx, x);
+    return (int)idx;
+#elif defined(_MSC_VER)
+    // No 64-bit scan on 32-bit targets, scan the high half first.
+    unsigned long idx;
+    if (_BitScanReverse(&idx, (unsigned long)(x >> 32)))
+        return (int)idx + 32;
+    _BitScanReverse(&idx, (unsigned long)x);
+    return (int)idx;
+#else
+    return 63 - __builtin_clzll(x);
+#endif
+}
+
+static int histogramIndex(const uint64_t value)
+{
+    if (value < (uint64_t)HistogramSubBuckets*2)
+        return (int)value;
+    // Values in [2^(shift+6), 2^(shift+7)) go into 64 buckets of width 2^shift.
+    const int shift = highestBit(value) - 6;
+    return HistogramSubBuckets*2 + (shift-1)*HistogramSubBuckets + (int)((value >> shift) - HistogramSubBuckets);
+}
+
+static uint64_t histogramBucketStart(const int idx)
+{
+    if (idx < HistogramSubBuckets*2)
+        return (uint64_t)idx;
+    const int shift = (idx - HistogramSubBuckets*2) / HistogramSubBuckets + 1;
+    const uint64_t sub = (uint64_t)((idx - HistogramSubBuckets*2) % HistogramSubBuckets + HistogramSubBuckets);
+    return sub << shift;
+}
+
+static uint64_t histogramBucketWidth(const int idx)
+{
+    if (idx < HistogramSubBuckets*2)
+        return 1;
+    const int shift = (idx - HistogramSubBuckets*2) / HistogramSubBuckets + 1;
+    return (uint64_t)1 << shift;
+}
+
+void resetHistogram(Histogram& hist)
+{
+    memset(hist.counts, 0, sizeof(hist.counts));
+    hist.total = 0;
+    hist.minValue = ~0ull;
+    hist.maxValue = 0;
+    hist.sum = 0.0;
+}
+
+void recordHistogram(Histogram& hist, const uint64_t value)
+{
+    hist.counts[histogramIndex(value)]++;
+    hist.total++;
+    hist.minValue = value < hist.minValue ? value : hist.minValue;
+    hist.maxValue = value > hist.maxValue ? value : hist.maxValue;
+    hist.sum += (double)value;
+}
+
+void mergeHistogram(Histogram& dst, const Histogram& src)
+{
+    for (int i = 0; i < HistogramBuckets; i++)
+        dst.counts[i] += src.counts[i];
+    dst.total += src.total;
+    dst.minValue = src.minValue < dst.minValue ? src.minValue : dst.minValue;
+    dst.maxValue = src.maxValue > dst.maxValue ? src.maxValue : dst.maxValue;
+    dst.sum += src.sum;
+}
+
+uint64_t histogramPercentile(const Histogram& hist, const double percentile)
+{
+    if (hist.total == 0)
+        return 0;
+
+    // Rank of the value, 1 based.
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)hist.total + 0.5);
+    rank = rank < 1 ? 1 : (rank > hist.total ? hist.total : rank);
+    if (rank == hist.total)
+        return hist.maxValue;
+
+    uint64_t count = 0;
+    for (int i = 0; i < HistogramBuckets; i++)
+    {
+        count += hist.counts[i];
+        if (count >= rank)
+        {
+            const uint64_t value = histogramBucketStart(i) + histogramBucketWidth(i) / 2;
+            return value < hist.minValue ? hist.minValue : (value > hist.maxValue ? hist.maxValue : value);
+        }
+    }
+    return hist.maxValue;
+}
+
+double histogramMean(const Histogram& hist)
+{
+    return hist.total > 0 ? hist.sum / (double)hist.total : 0.0;
+}
+
+void printHistogram(const Histogram& hist, const char* name, const char* unit, const double scale)
+{
+    printf(" - %s: p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f %s (mean %.3f, %llu samples)\n", name,
+           histogramPercentile(hist, 50.0) / scale, histogramPercentile(hist, 90.0) / scale,
+           histogramPercentile(hist, 99.0) / scale, histogramPercentile(hist, 99.9) / scale,
+           hist.maxValue / scale, unit, histogramMean(hist) / scale, (unsigned long long)hist.total);
+}
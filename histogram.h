@@ -0,0 +1,55 @@
+//
+// Copyright (c) 2021 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear buckets like HdrHistogram: values below 128 are exact, and each power of two above it is
+// split into 64 buckets, so a recorded value is off by less than 1/64 of it. Covers the whole uint64_t range.
+static const int HistogramSubBuckets = 64;
+static const int HistogramBuckets = HistogramSubBuckets*2 + 57*HistogramSubBuckets;
+
+// Fixed size, nothing is allocated. Record into a histogram per thread, and merge them when the threads
+// are done, so that recording needs no locks or atomics.
+struct Histogram
+{
+    uint64_t counts[HistogramBuckets];
+    uint64_t total;
+    uint64_t minValue;
+    uint64_t maxValue;
+    double sum;
+};
+
+void resetHistogram(Histogram& hist);
+
+void recordHistogram(Histogram& hist, const uint64_t value);
+
+// Adds the counts of src to dst.
+void mergeHistogram(Histogram& dst, const Histogram& src);
+
+// Value at percentile (0-100), the middle of the bucket it falls in, clamped to the recorded range.
+uint64_t histogramPercentile(const Histogram& hist, const double percentile);
+
+double histogramMean(const Histogram& hist);
+
+// Prints p50, p90, p99, p99.9 and max, with values divided by scale, e.g. 1000 to print nanoseconds as microseconds.
+void printHistogram(const Histogram& hist, const char* name, const char* unit, const double scale);
+
+#endif // HISTOGRAM_H
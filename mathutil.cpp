@@ -1,10 +1,11 @@
 #include <math.h>
 #include <stdlib.h>
+#include <atomic>
 #include "mathutil.h"
 
 float randf()
 {
-    return (float)rand() / (float)(RAND_MAX);
+    return (rngNext(threadRng()) >> 8) * (1.0f / 16777215.0f);
 }
 
 float symrandf()
@@ -30,3 +31,165 @@ float projectPtSegSq(const Vec2 pt, const Vec2 start, const Vec2 end)
     if (t > d) return 1;
     return d > 0.0f ? (t / d) : 0.0f;
 }
+
+
+static uint64_t splitMix64(uint64_t& x)
+{
+	uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+void jumpRng(Rng& rng)
+{
+	static const uint32_t jump[] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+	uint32_t s[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 4; i++)
+	{
+		for (int b = 0; b < 32; b++)
+		{
+			if (jump[i] & (1u << b))
+			{
+				s[0] ^= rng.s[0];
+				s[1] ^= rng.s[1];
+				s[2] ^= rng.s[2];
+				s[3] ^= rng.s[3];
+			}
+			rngNext(rng);
+		}
+	}
+	for (int i = 0; i < 4; i++)
+		rng.s[i] = s[i];
+}
+
+void seedRng(Rng& rng, const uint64_t seed, const uint32_t stream)
+{
+	uint64_t x = seed;
+	const uint64_t a = splitMix64(x);
+	const uint64_t b = splitMix64(x);
+	rng.s[0] = (uint32_t)a;
+	rng.s[1] = (uint32_t)(a >> 32);
+	rng.s[2] = (uint32_t)b;
+	rng.s[3] = (uint32_t)(b >> 32);
+	// All zero state is the one fixed point of the generator.
+	if ((rng.s[0] | rng.s[1] | rng.s[2] | rng.s[3]) == 0)
+		rng.s[0] = 1;
+	for (uint32_t i = 0; i < stream; i++)
+		jumpRng(rng);
+}
+
+static std::atomic<uint64_t> threadRngSeed{0};
+static std::atomic<uint32_t> threadRngStream{0};
+static thread_local Rng threadRngState;
+static thread_local bool threadRngSeeded = false;
+
+Rng& threadRng()
+{
+	if (!threadRngSeeded)
+	{
+		seedRng(threadRngState, threadRngSeed.load(), threadRngStream++);
+		threadRngSeeded = true;
+	}
+	return threadRngState;
+}
+
+void setRngSeed(const uint64_t seed, const uint32_t stream)
+{
+	threadRngSeed = seed;
+	threadRngStream = stream + 1;
+	seedRng(threadRngState, seed, stream);
+	threadRngSeeded = true;
+}
+
+void seedRngBatch(RngBatch& rng, const uint64_t seed, const uint32_t stream)
+{
+	Rng lane;
+	seedRng(lane, seed, stream);
+	for (int l = 0; l < RngLanes; l++)
+	{
+		for (int i = 0; i < 4; i++)
+			rng.s[i][l] = lane.s[i];
+		jumpRng(lane);
+	}
+}
+
+// Steps all lanes once, same as rngNext() per lane.
+static inline void rngBatchNext(RngBatch& rng, uint32_t* res)
+{
+	uint32_t* s0 = rng.s[0];
+	uint32_t* s1 = rng.s[1];
+	uint32_t* s2 = rng.s[2];
+	uint32_t* s3 = rng.s[3];
+	for (int l = 0; l < RngLanes; l++)
+	{
+		res[l] = s0[l] + s3[l];
+		const uint32_t t = s1[l] << 9;
+		s2[l] ^= s0[l];
+		s3[l] ^= s1[l];
+		s1[l] ^= s2[l];
+		s0[l] ^= s3[l];
+		s2[l] ^= t;
+		s3[l] = (s3[l] << 11) | (s3[l] >> 21);
+	}
+}
+
+static inline void rngBatchFloats(RngBatch& rng, float* res, const float rmin, const float rmax)
+{
+	uint32_t bits[RngLanes];
+	rngBatchNext(rng, bits);
+	const float scale = (rmax - rmin) * (1.0f / 16777216.0f);
+	for (int l = 0; l < RngLanes; l++)
+		res[l] = rmin + (float)(bits[l] >> 8) * scale;
+}
+
+void rngFillFloats(RngBatch& rng, float* res, const int num, const float rmin, const float rmax)
+{
+	float vals[RngLanes];
+	for (int i = 0; i < num; i += RngLanes)
+	{
+		rngBatchFloats(rng, vals, rmin, rmax);
+		const int n = mini(RngLanes, num - i);
+		for (int l = 0; l < n; l++)
+			res[i + l] = vals[l];
+	}
+}
+
+void rngFillDirs(RngBatch& rng, Vec2* res, const int num)
+{
+	// Sine and cosine of the half angle in [-pi/2,pi/2) from Taylor series, accurate to about 1e-7,
+	// then doubled. Keeps the loop free of libm calls so that it vectorizes.
+	float ha[RngLanes];
+	float dx[RngLanes];
+	float dy[RngLanes];
+	for (int i = 0; i < num; i += RngLanes)
+	{
+		rngBatchFloats(rng, ha, -M_PI * 0.5f, M_PI * 0.5f);
+		for (int l = 0; l < RngLanes; l++)
+		{
+			const float a = ha[l];
+			const float a2 = a * a;
+			const float s = a * (1.0f + a2 * (-1.0f/6.0f + a2 * (1.0f/120.0f + a2 * (-1.0f/5040.0f + a2 * (1.0f/362880.0f + a2 * (-1.0f/39916800.0f))))));
+			const float c = 1.0f + a2 * (-0.5f + a2 * (1.0f/24.0f + a2 * (-1.0f/720.0f + a2 * (1.0f/40320.0f + a2 * (-1.0f/3628800.0f + a2 * (1.0f/479001600.0f))))));
+			dx[l] = c * c - s * s;
+			dy[l] = 2.0f * s * c;
+		}
+		const int n = mini(RngLanes, num - i);
+		for (int l = 0; l < n; l++)
+			res[i + l] = Vec2(dx[l], dy[l]);
+	}
+}
+
+void rngFillPositions(RngBatch& rng, Vec2* res, const int num, const Vec2 pmin, const Vec2 pmax)
+{
+	float px[RngLanes];
+	float py[RngLanes];
+	for (int i = 0; i < num; i += RngLanes)
+	{
+		rngBatchFloats(rng, px, pmin.x, pmax.x);
+		rngBatchFloats(rng, py, pmin.y, pmax.y);
+		const int n = mini(RngLanes, num - i);
+		for (int l = 0; l < n; l++)
+			res[i + l] = Vec2(px[l], py[l]);
+	}
+}
@@ -17,10 +17,26 @@
 //
 
 #include <math.h>
+#include <stdint.h>
 
 #ifndef MATHUTIL_H
 #define MATHUTIL_H
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MATHUTIL_SSE
+#endif
+
+// Files compiled for a wider instruction set than the build flags, see avoidance_avx2.cpp, define
+// MATHUTIL_TARGET_AVX2 or MATHUTIL_TARGET_AVX512 before including this.
+#if defined(__AVX512F__) || defined(MATHUTIL_TARGET_AVX512)
+#define MATHUTIL_AVX512
+#endif
+#if defined(__AVX__) || defined(MATHUTIL_TARGET_AVX2) || defined(MATHUTIL_AVX512)
+#include <immintrin.h>
+#define MATHUTIL_AVX
+#endif
+
 static inline int mini(int a, int b) {
 	return a < b ? a : b;
 }
@@ -203,7 +219,376 @@ Vec2 slerp(const Vec2 a, const Vec2 b, const float t);
 float projectPtSegSq(const Vec2 pt, const Vec2 start, const Vec2 end);
 
 
+// Uniform random float in [0,1] and [-1,1] from the calling thread's stream.
 float randf();
 float symrandf();
 
+
+// xoshiro128+ generator. Cheap, 2^128-1 period, and jumpable into 2^64 non-overlapping streams,
+// so that parallel dataset generation is reproducible regardless of how the work is scheduled.
+struct Rng
+{
+	uint32_t s[4];
+};
+
+// Seeds the generator from 'seed' and advances it to stream 'stream'. Same seed and stream, same sequence.
+void seedRng(Rng& rng, const uint64_t seed, const uint32_t stream = 0);
+
+// Advances the generator by 2^64 steps, the start of the next stream.
+void jumpRng(Rng& rng);
+
+inline uint32_t rngNext(Rng& rng)
+{
+	uint32_t* s = rng.s;
+	const uint32_t res = s[0] + s[3];
+	const uint32_t t = s[1] << 9;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = (s[3] << 11) | (s[3] >> 21);
+	return res;
+}
+
+// Uniform float in [0,1), from the top 24 bits, the low bits of xoshiro128+ are weak.
+inline float rngFloat(Rng& rng)
+{
+	return (rngNext(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+inline float rngRange(Rng& rng, const float rmin, const float rmax)
+{
+	return rmin + rngFloat(rng) * (rmax - rmin);
+}
+
+// Uniform integer in [0,n).
+inline int rngInt(Rng& rng, const int n)
+{
+	return (int)(((uint64_t)rngNext(rng) * (uint64_t)n) >> 32);
+}
+
+// The calling thread's generator. Threads get consecutive streams of the seed set with setRngSeed(), in the order they first ask.
+Rng& threadRng();
+
+// Sets the seed of the thread streams and reseeds the calling thread's generator to 'stream'.
+void setRngSeed(const uint64_t seed, const uint32_t stream = 0);
+
+// Batch fills. RngLanes independent streams are stepped side by side so that the compiler can vectorize the loops.
+static const int RngLanes = 8;
+
+struct RngBatch
+{
+	uint32_t s[4][RngLanes];
+};
+
+// Seeds lane i to stream 'stream' + i of 'seed'.
+void seedRngBatch(RngBatch& rng, const uint64_t seed, const uint32_t stream = 0);
+
+void rngFillFloats(RngBatch& rng, float* res, const int num, const float rmin, const float rmax);
+void rngFillDirs(RngBatch& rng, Vec2* res, const int num);
+void rngFillPositions(RngBatch& rng, Vec2* res, const int num, const Vec2 pmin, const Vec2 pmax);
+
+// Flushes denormal results and inputs to zero on the calling thread while in scope. Tiny radii and nearly
+// degenerate directions in the queries can produce denormals, which are many times slower to compute with.
+// Does nothing on targets without SSE.
+struct ScopedFlushDenormals
+{
+#ifdef MATHUTIL_SSE
+	ScopedFlushDenormals() : saved(_mm_getcsr()) { _mm_setcsr(saved | 0x8040); }	// FTZ and DAZ
+	~ScopedFlushDenormals() { _mm_setcsr(saved); }
+	unsigned int saved;
+#endif
+};
+
+
+// Wide SoA lanes for writing the query math once as a template over float/Vec2/bool and the wide types.
+// The wide types mirror the scalar names: arithmetic operators, minf, maxf, clampf, sqrf, sqrtf, fabsf,
+// signf, dot, perp, left, len, lenSq, norm, lerp. Comparisons give a lane mask, and select(mask, a, b)
+// stands in for branches, which is the plain ternary in the scalar case. Floats and Vec2s convert to all
+// lanes implicitly, so per pair constants can be mixed in as is.
+//
+// The types live in an inline namespace named after the instruction set the file is compiled for,
+// so that files compiled for different instruction sets do not share the out of line copies.
+
+static inline float select(const bool mask, const float a, const float b) {
+	return mask ? a : b;
+}
+
+static inline Vec2 select(const bool mask, const Vec2 a, const Vec2 b) {
+	return mask ? a : b;
+}
+
+static inline bool anyLane(const bool mask) {
+	return mask;
+}
+
+static inline bool allLanes(const bool mask) {
+	return mask;
+}
+
+static inline void loadLanes(float& v, const float* p) {
+	v = *p;
+}
+
+static inline void storeLanes(float* p, const float v) {
+	*p = v;
+}
+
+#if defined(MATHUTIL_AVX512)
+#define MATHUTIL_SIMD_NAMESPACE simd_avx512
+#elif defined(__AVX2__) || defined(MATHUTIL_TARGET_AVX2)
+#define MATHUTIL_SIMD_NAMESPACE simd_avx2
+#elif defined(__AVX__)
+#define MATHUTIL_SIMD_NAMESPACE simd_avx
+#else
+#define MATHUTIL_SIMD_NAMESPACE simd_sse
+#endif
+
+inline namespace MATHUTIL_SIMD_NAMESPACE {
+
+// Lane count and the matching mask and vector type of a lane type.
+template<typename F> struct LaneTraits;
+
+template<> struct LaneTraits<float>
+{
+	typedef bool Mask;
+	typedef Vec2 Vec;
+	static const int Lanes = 1;
+};
+
+#ifdef MATHUTIL_SSE
+
+struct Maskx4
+{
+	Maskx4() {}
+	Maskx4(const __m128 _v) : v(_v) {}
+	__m128 v;
+};
+
+struct Floatx4
+{
+	Floatx4() {}
+	Floatx4(const __m128 _v) : v(_v) {}
+	Floatx4(const float f) : v(_mm_set1_ps(f)) {}
+	__m128 v;
+};
+
+static inline Maskx4 operator&(const Maskx4 a, const Maskx4 b) { return _mm_and_ps(a.v, b.v); }
+static inline Maskx4 operator|(const Maskx4 a, const Maskx4 b) { return _mm_or_ps(a.v, b.v); }
+static inline Maskx4 operator!(const Maskx4 a) { return _mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1))); }
+static inline bool anyLane(const Maskx4 mask) { return _mm_movemask_ps(mask.v) != 0; }
+static inline bool allLanes(const Maskx4 mask) { return _mm_movemask_ps(mask.v) == 0xf; }
+
+static inline Floatx4 operator+(const Floatx4 a, const Floatx4 b) { return _mm_add_ps(a.v, b.v); }
+static inline Floatx4 operator-(const Floatx4 a, const Floatx4 b) { return _mm_sub_ps(a.v, b.v); }
+static inline Floatx4 operator*(const Floatx4 a, const Floatx4 b) { return _mm_mul_ps(a.v, b.v); }
+static inline Floatx4 operator/(const Floatx4 a, const Floatx4 b) { return _mm_div_ps(a.v, b.v); }
+static inline Floatx4 operator-(const Floatx4 a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+
+static inline Maskx4 operator<(const Floatx4 a, const Floatx4 b) { return _mm_cmplt_ps(a.v, b.v); }
+static inline Maskx4 operator<=(const Floatx4 a, const Floatx4 b) { return _mm_cmple_ps(a.v, b.v); }
+static inline Maskx4 operator>(const Floatx4 a, const Floatx4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+static inline Maskx4 operator>=(const Floatx4 a, const Floatx4 b) { return _mm_cmpge_ps(a.v, b.v); }
+
+static inline Floatx4 select(const Maskx4 mask, const Floatx4 a, const Floatx4 b) {
+	return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+
+static inline Floatx4 minf(const Floatx4 a, const Floatx4 b) { return _mm_min_ps(a.v, b.v); }
+static inline Floatx4 maxf(const Floatx4 a, const Floatx4 b) { return _mm_max_ps(a.v, b.v); }
+static inline Floatx4 clampf(const Floatx4 x, const Floatx4 bmin, const Floatx4 bmax) { return minf(maxf(x, bmin), bmax); }
+static inline Floatx4 sqrf(const Floatx4 x) { return x * x; }
+static inline Floatx4 sqrtf(const Floatx4 x) { return _mm_sqrt_ps(x.v); }
+static inline Floatx4 fabsf(const Floatx4 x) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), x.v); }
+static inline Floatx4 signf(const Floatx4 x) { return select(x < 0.0f, Floatx4(-1.0f), Floatx4(1.0f)); }
+
+static inline void loadLanes(Floatx4& v, const float* p) { v = _mm_loadu_ps(p); }
+static inline void storeLanes(float* p, const Floatx4 v) { _mm_storeu_ps(p, v.v); }
+
+struct Vec2x4
+{
+	Vec2x4() {}
+	Vec2x4(const Floatx4 _x, const Floatx4 _y) : x(_x), y(_y) {}
+	Vec2x4(const Vec2 v) : x(v.x), y(v.y) {}
+	Floatx4 x;
+	Floatx4 y;
+};
+
+template<> struct LaneTraits<Floatx4>
+{
+	typedef Maskx4 Mask;
+	typedef Vec2x4 Vec;
+	static const int Lanes = 4;
+};
+
+#endif // MATHUTIL_SSE
+
+#ifdef MATHUTIL_AVX
+
+struct Maskx8
+{
+	Maskx8() {}
+	Maskx8(const __m256 _v) : v(_v) {}
+	__m256 v;
+};
+
+struct Floatx8
+{
+	Floatx8() {}
+	Floatx8(const __m256 _v) : v(_v) {}
+	Floatx8(const float f) : v(_mm256_set1_ps(f)) {}
+	__m256 v;
+};
+
+static inline Maskx8 operator&(const Maskx8 a, const Maskx8 b) { return _mm256_and_ps(a.v, b.v); }
+static inline Maskx8 operator|(const Maskx8 a, const Maskx8 b) { return _mm256_or_ps(a.v, b.v); }
+static inline Maskx8 operator!(const Maskx8 a) { return _mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+static inline bool anyLane(const Maskx8 mask) { return _mm256_movemask_ps(mask.v) != 0; }
+static inline bool allLanes(const Maskx8 mask) { return _mm256_movemask_ps(mask.v) == 0xff; }
+
+static inline Floatx8 operator+(const Floatx8 a, const Floatx8 b) { return _mm256_add_ps(a.v, b.v); }
+static inline Floatx8 operator-(const Floatx8 a, const Floatx8 b) { return _mm256_sub_ps(a.v, b.v); }
+static inline Floatx8 operator*(const Floatx8 a, const Floatx8 b) { return _mm256_mul_ps(a.v, b.v); }
+static inline Floatx8 operator/(const Floatx8 a, const Floatx8 b) { return _mm256_div_ps(a.v, b.v); }
+static inline Floatx8 operator-(const Floatx8 a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+
+static inline Maskx8 operator<(const Floatx8 a, const Floatx8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+static inline Maskx8 operator<=(const Floatx8 a, const Floatx8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+static inline Maskx8 operator>(const Floatx8 a, const Floatx8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+static inline Maskx8 operator>=(const Floatx8 a, const Floatx8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+
+static inline Floatx8 select(const Maskx8 mask, const Floatx8 a, const Floatx8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+
+static inline Floatx8 minf(const Floatx8 a, const Floatx8 b) { return _mm256_min_ps(a.v, b.v); }
+static inline Floatx8 maxf(const Floatx8 a, const Floatx8 b) { return _mm256_max_ps(a.v, b.v); }
+static inline Floatx8 clampf(const Floatx8 x, const Floatx8 bmin, const Floatx8 bmax) { return minf(maxf(x, bmin), bmax); }
+static inline Floatx8 sqrf(const Floatx8 x) { return x * x; }
+static inline Floatx8 sqrtf(const Floatx8 x) { return _mm256_sqrt_ps(x.v); }
+static inline Floatx8 fabsf(const Floatx8 x) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x.v); }
+static inline Floatx8 signf(const Floatx8 x) { return select(x < 0.0f, Floatx8(-1.0f), Floatx8(1.0f)); }
+
+static inline void loadLanes(Floatx8& v, const float* p) { v = _mm256_loadu_ps(p); }
+static inline void storeLanes(float* p, const Floatx8 v) { _mm256_storeu_ps(p, v.v); }
+
+struct Vec2x8
+{
+	Vec2x8() {}
+	Vec2x8(const Floatx8 _x, const Floatx8 _y) : x(_x), y(_y) {}
+	Vec2x8(const Vec2 v) : x(v.x), y(v.y) {}
+	Floatx8 x;
+	Floatx8 y;
+};
+
+template<> struct LaneTraits<Floatx8>
+{
+	typedef Maskx8 Mask;
+	typedef Vec2x8 Vec;
+	static const int Lanes = 8;
+};
+
+#endif // MATHUTIL_AVX
+
+#ifdef MATHUTIL_AVX512
+
+struct Maskx16
+{
+	Maskx16() {}
+	Maskx16(const __mmask16 _m) : m(_m) {}
+	__mmask16 m;
+};
+
+struct Floatx16
+{
+	Floatx16() {}
+	Floatx16(const __m512 _v) : v(_v) {}
+	Floatx16(const float f) : v(_mm512_set1_ps(f)) {}
+	__m512 v;
+};
+
+static inline Maskx16 operator&(const Maskx16 a, const Maskx16 b) { return (__mmask16)(a.m & b.m); }
+static inline Maskx16 operator|(const Maskx16 a, const Maskx16 b) { return (__mmask16)(a.m | b.m); }
+static inline Maskx16 operator!(const Maskx16 a) { return (__mmask16)~a.m; }
+static inline bool anyLane(const Maskx16 mask) { return mask.m != 0; }
+static inline bool allLanes(const Maskx16 mask) { return mask.m == 0xffff; }
+
+static inline Floatx16 operator+(const Floatx16 a, const Floatx16 b) { return _mm512_add_ps(a.v, b.v); }
+static inline Floatx16 operator-(const Floatx16 a, const Floatx16 b) { return _mm512_sub_ps(a.v, b.v); }
+static inline Floatx16 operator*(const Floatx16 a, const Floatx16 b) { return _mm512_mul_ps(a.v, b.v); }
+static inline Floatx16 operator/(const Floatx16 a, const Floatx16 b) { return _mm512_div_ps(a.v, b.v); }
+static inline Floatx16 operator-(const Floatx16 a) {
+	return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(INT32_MIN)));
+}
+
+static inline Maskx16 operator<(const Floatx16 a, const Floatx16 b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ); }
+static inline Maskx16 operator<=(const Floatx16 a, const Floatx16 b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ); }
+static inline Maskx16 operator>(const Floatx16 a, const Floatx16 b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ); }
+static inline Maskx16 operator>=(const Floatx16 a, const Floatx16 b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ); }
+
+static inline Floatx16 select(const Maskx16 mask, const Floatx16 a, const Floatx16 b) { return _mm512_mask_blend_ps(mask.m, b.v, a.v); }
+
+static inline Floatx16 minf(const Floatx16 a, const Floatx16 b) { return _mm512_min_ps(a.v, b.v); }
+static inline Floatx16 maxf(const Floatx16 a, const Floatx16 b) { return _mm512_max_ps(a.v, b.v); }
+static inline Floatx16 clampf(const Floatx16 x, const Floatx16 bmin, const Floatx16 bmax) { return minf(maxf(x, bmin), bmax); }
+static inline Floatx16 sqrf(const Floatx16 x) { return x * x; }
+static inline Floatx16 sqrtf(const Floatx16 x) { return _mm512_sqrt_ps(x.v); }
+static inline Floatx16 fabsf(const Floatx16 x) { return _mm512_abs_ps(x.v); }
+static inline Floatx16 signf(const Floatx16 x) { return select(x < 0.0f, Floatx16(-1.0f), Floatx16(1.0f)); }
+
+static inline void loadLanes(Floatx16& v, const float* p) { v = _mm512_loadu_ps(p); }
+static inline void storeLanes(float* p, const Floatx16 v) { _mm512_storeu_ps(p, v.v); }
+
+struct Vec2x16
+{
+	Vec2x16() {}
+	Vec2x16(const Floatx16 _x, const Floatx16 _y) : x(_x), y(_y) {}
+	Vec2x16(const Vec2 v) : x(v.x), y(v.y) {}
+	Floatx16 x;
+	Floatx16 y;
+};
+
+template<> struct LaneTraits<Floatx16>
+{
+	typedef Maskx16 Mask;
+	typedef Vec2x16 Vec;
+	static const int Lanes = 16;
+};
+
+#endif // MATHUTIL_AVX512
+
+// Vec2 functions for the wide types, V is Vec2x4, Vec2x8 or Vec2x16 and F its lane type.
+#define MATHUTIL_WIDE_VEC2(V, F, M) \
+static inline V operator+(const V a, const V b) { return V(a.x + b.x, a.y + b.y); } \
+static inline V operator-(const V a, const V b) { return V(a.x - b.x, a.y - b.y); } \
+static inline V operator-(const V a) { return V(-a.x, -a.y); } \
+static inline V operator*(const V a, const F b) { return V(a.x * b, a.y * b); } \
+static inline V operator*(const F a, const V b) { return V(a * b.x, a * b.y); } \
+static inline V operator/(const V a, const F b) { return V(a.x / b, a.y / b); } \
+static inline F lenSq(const V a) { return a.x*a.x + a.y*a.y; } \
+static inline F len(const V a) { return sqrtf(a.x*a.x + a.y*a.y); } \
+static inline F dot(const V a, const V b) { return a.x*b.x + a.y*b.y; } \
+static inline F perp(const V a, const V b) { return a.y*b.x - a.x*b.y; } \
+static inline V left(const V a) { return V(a.y, -a.x); } \
+static inline V lerp(const V a, const V b, const F t) { return V(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t); } \
+static inline V norm(const V a) { \
+	const F s = sqrtf(a.x*a.x + a.y*a.y); \
+	const F inv = select(s > 1e-6f, 1.0f / s, F(0.0f)); \
+	return V(a.x * inv, a.y * inv); \
+} \
+static inline V select(const M mask, const V a, const V b) { return V(select(mask, a.x, b.x), select(mask, a.y, b.y)); }
+
+#ifdef MATHUTIL_SSE
+MATHUTIL_WIDE_VEC2(Vec2x4, Floatx4, Maskx4)
+#endif
+#ifdef MATHUTIL_AVX
+MATHUTIL_WIDE_VEC2(Vec2x8, Floatx8, Maskx8)
+#endif
+#ifdef MATHUTIL_AVX512
+MATHUTIL_WIDE_VEC2(Vec2x16, Floatx16, Maskx16)
+#endif
+
+#undef MATHUTIL_WIDE_VEC2
+
+} // inline namespace MATHUTIL_SIMD_NAMESPACE
+
 #endif // MATHUTIL_H
@@ -0,0 +1,141 @@
+#include "perfcounters.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int openPerfEvent(const uint32_t type, const uint64_t config)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // Calling thread, any CPU.
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Value, time enabled and time running.
+static bool readPerfEvent(const int fd, uint64_t res[3])
+{
+    return read(fd, res, sizeof(uint64_t) * 3) == sizeof(uint64_t) * 3;
+}
+
+bool openPerfCounters(PerfCounters& perf)
+{
+    static const uint64_t cacheReadMiss = ((uint64_t)PERF_COUNT_HW_CACHE_OP_READ << 8) | ((uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    memset(&perf, 0, sizeof(perf));
+    perf.fds[(int)PerfCounter::Cycles] = openPerfEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    perf.fds[(int)PerfCounter::Instructions] = openPerfEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    perf.fds[(int)PerfCounter::BranchMisses] = openPerfEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    perf.fds[(int)PerfCounter::L1DMisses] = openPerfEvent(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | cacheReadMiss);
+    perf.fds[(int)PerfCounter::LLCMisses] = openPerfEvent(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | cacheReadMiss);
+
+    bool any = false;
+    for (int i = 0; i < (int)PerfCounter::Count; i++)
+    {
+        perf.available[i] = perf.fds[i] >= 0;
+        any |= perf.available[i];
+    }
+    return any;
+}
+
+void closePerfCounters(PerfCounters& perf)
+{
+    for (int i = 0; i < (int)PerfCounter::Count; i++)
+    {
+        if (perf.available[i])
+            close(perf.fds[i]);
+        perf.fds[i] = -1;
+        perf.available[i] = false;
+    }
+}
+
+void startPerfCounters(PerfCounters& perf)
+{
+    for (int i = 0; i < (int)PerfCounter::Count; i++)
+    {
+        uint64_t res[3];
+        if (perf.available[i] && readPerfEvent(perf.fds[i], res))
+        {
+            perf.startValues[i] = res[0];
+            perf.startEnabled[i] = res[1];
+            perf.startRunning[i] = res[2];
+        }
+    }
+}
+
+void stopPerfCounters(PerfCounters& perf)
+{
+    for (int i = 0; i < (int)PerfCounter::Count; i++)
+    {
+        uint64_t res[3];
+        perf.values[i] = 0;
+        if (perf.available[i] && readPerfEvent(perf.fds[i], res))
+        {
+            const uint64_t value = res[0] - perf.startValues[i];
+            const uint64_t enabled = res[1] - perf.startEnabled[i];
+            const uint64_t running = res[2] - perf.startRunning[i];
+            // The counter was multiplexed with others for part of the time, extrapolate.
+            perf.values[i] = (running > 0 && running < enabled) ? (uint64_t)((double)value * enabled / running) : value;
+        }
+    }
+}
+
+#else
+
+bool openPerfCounters(PerfCounters& perf)
+{
+    memset(&perf, 0, sizeof(perf));
+    for (int i = 0; i < (int)PerfCounter::Count; i++)
+        perf.fds[i] = -1;
+    return false;
+}
+
+void closePerfCounters(PerfCounters&)
+{
+}
+
+void startPerfCounters(PerfCounters&)
+{
+}
+
+void stopPerfCounters(PerfCounters&)
+{
+}
+
+#endif
+
+void printPerfCounters(const PerfCounters& perf, const int numPairs)
+{
+    static const char* names[(int)PerfCounter::Count] = { "cycles", "instr", "br-miss", "L1D-miss", "LLC-miss" };
+
+    bool any = false;
+    for (int i = 0; i < (int)PerfCounter::Count; i++)
+        any |= perf.available[i];
+    if (!any || numPairs <= 0)
+        return;
+
+    printf("   ");
+    for (int i = 0; i < (int)PerfCounter::Count; i++)
+    {
+        if (perf.available[i])
+            printf(" %s %.2f", names[i], (double)perf.values[i] / numPairs);
+        else
+            printf(" %s n/a", names[i]);
+    }
+
+    const int cycles = (int)PerfCounter::Cycles;
+    const int instr = (int)PerfCounter::Instructions;
+    if (perf.available[cycles] && perf.available[instr] && perf.values[cycles] > 0)
+        printf(" IPC %.2f", (double)perf.values[instr] / perf.values[cycles]);
+    printf(" per pair\n");
+}
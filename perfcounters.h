@@ -0,0 +1,57 @@
+//
+// Copyright (c) 2021 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdint.h>
+
+enum class PerfCounter : uint8_t
+{
+    Cycles,
+    Instructions,
+    BranchMisses,
+    L1DMisses,
+    LLCMisses,
+    Count,
+};
+
+// Hardware counters of the calling thread, read with perf_event_open on Linux.
+// Counters that cannot be opened, e.g. in containers or on other platforms, are marked unavailable
+// and the rest keep working.
+struct PerfCounters
+{
+    int fds[(int)PerfCounter::Count];
+    bool available[(int)PerfCounter::Count];
+    uint64_t values[(int)PerfCounter::Count];   // counts between the last start and stop, scaled if multiplexed.
+    uint64_t startValues[(int)PerfCounter::Count];
+    uint64_t startEnabled[(int)PerfCounter::Count];
+    uint64_t startRunning[(int)PerfCounter::Count];
+};
+
+// Returns false if none of the counters are available.
+bool openPerfCounters(PerfCounters& perf);
+void closePerfCounters(PerfCounters& perf);
+
+void startPerfCounters(PerfCounters& perf);
+void stopPerfCounters(PerfCounters& perf);
+
+// Prints the counters per pair, and IPC. Prints nothing if none of the counters are available.
+void printPerfCounters(const PerfCounters& perf, const int numPairs);
+
+#endif // PERFCOUNTERS_H
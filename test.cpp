@@ -3,6 +3,10 @@
 #include <string.h>
 #include <math.h>
 #include <stdint.h>
+#include <float.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #define GLFW_INCLUDE_GLEXT
 #define GLFW_INCLUDE_GLCOREARB
 #include <GLFW/glfw3.h>
@@ -11,6 +15,11 @@
 #include "nanovg_gl.h"
 #include "mathutil.h"
 #include "distance.h"
+#include "contactcache.h"
+#include "avoidance.h"
+#include "perfcounters.h"
+#include "trace.h"
+#include "histogram.h"
 
 #define CUTE_C2_IMPLEMENTATION
 #include "cute_c2.h"
@@ -422,6 +431,16 @@ void drawSketch_Distance(NVGcontext* vg, const Vec2 agentPos, const Vec2 agentVe
 	snprintf(msg, 64, "D = %.1f", res.dist);
 	nvgText(vg, dpos.x, dpos.y, msg, NULL);
 
+	// Contact points
+	const ContactRes contact = nearestContact(colA, Vec2(), colB, Vec2());
+	for (int i = 0; i < contact.numPoints; i++)
+	{
+		const ContactPoint& pt = contact.points[i];
+		drawLine(vg, pt.posA, pt.posB, nvgRGBA(255,255,255,128));
+		drawTick(vg, pt.posA, 6, nvgRGBA(0,128,255,255));
+		drawTick(vg, pt.posB, 6, nvgRGBA(255,128,0,255));
+	}
+
 	nvgStrokeWidth(vg,1.0);
 }
 
@@ -576,28 +595,36 @@ void drawSketch_CPARing(NVGcontext* vg, const Vec2 agentPos, const Vec2 agentVel
 	ApproachRes cpa = closestPointOfApproach(colA, velA, colB, velB, 3.0f);
 	DistanceRes res = nearestDistance(colA, velA * cpa.t, colB, velB * cpa.t);
 
-	const int numSamples = 400;
-	Vec2 samplePos[numSamples];
-
-	const float speedA = len(velA);
-
-	for (int i = 0; i < numSamples; i++)
-	{
-		const float a = (float)i / (float)numSamples * M_PI * 2.0f;
-		const Vec2 velA2(cosf(a) * speedA, sinf(a) * speedA);
-		const ApproachRes cpa2 = closestPointOfApproach(colA, velA2, colB, velB, 3.0f);
-		samplePos[i] = colA.pos + velA2 * cpa2.t;
-	}
+	// Position of A at CPA relative to B, for every heading.
+	const int maxPieces = 64;
+	ContourPiece pieces[maxPieces];
+	const int numPieces = mini(maxPieces, cpaContour(colA, colB, velB, len(velA), 3.0f, pieces, maxPieces));
 
 	nvgStrokeWidth(vg,2.0);
 
 	nvgBeginPath(vg);
-	nvgMoveTo(vg, samplePos[numSamples-1].x, samplePos[numSamples-1].y);
-	for (int i = 0; i < numSamples; i++)
-		nvgLineTo(vg, samplePos[i].x, samplePos[i].y);
+	for (int i = 0; i < numPieces; i++)
+	{
+		const ContourPiece& piece = pieces[i];
+		const Vec2 start = colB.pos + piece.start;
+		const Vec2 end = colB.pos + piece.end;
+		nvgMoveTo(vg, start.x, start.y);
+		if (piece.type == ContourPieceType::Arc && piece.rad > 0.0f)
+		{
+			const Vec2 center = colB.pos + piece.center;
+			nvgArc(vg, center.x, center.y, piece.rad, piece.a0, piece.a1, piece.a1 > piece.a0 ? NVG_CW : NVG_CCW);
+		}
+		else
+		{
+			nvgLineTo(vg, end.x, end.y);
+		}
+	}
 	nvgStrokeColor(vg, nvgRGBA(0,0,0,128));
 	nvgStroke(vg);
 
+	snprintf(msg, 64, "%d pieces", numPieces);
+	nvgText(vg, colB.pos.x, colB.pos.y - otherRadW*3.0f, msg, NULL);
+
 	nvgStrokeWidth(vg,2.0);
 	drawCollider(vg, Vec2(), colA, nvgRGBA(255,255,255,128));
 	drawCollider(vg, Vec2(), colB, nvgRGBA(255,255,255,128));
@@ -674,6 +701,41 @@ void drawSketch_CPAField(NVGcontext* vg, const Vec2 agentPos, const Vec2 agentVe
 		}
 	}
 
+	// Gradient steps from the center of the field.
+	const PreparedCollider prepA = prepareCollider(colA, velA, 3.0f);
+	const PreparedCollider prepB = prepareCollider(colB, velB, 3.0f);
+	const Vec2 optVel = optimizeVelocity(prepA, velA*2, speedA*6, &prepB, &velB, 1, 3.0f, agentRadW, 16);
+	drawArrow(vg, colA.pos, colA.pos + optVel, 8, nvgRGBA(0,192,255,220));
+
+	// Adaptive search over the same area, with a fraction of the evaluations of the grid above.
+	int numEvaluations = 0;
+	const Vec2 searchVel = searchVelocity(prepA, velA*2, speedA*6, &prepB, &velB, 1, 3.0f, agentRadW, 48, numEvaluations);
+	drawArrow(vg, colA.pos, colA.pos + searchVel, 8, nvgRGBA(255,255,0,220));
+
+	// Velocity obstacle, and the free headings at the speed of the optimized velocity.
+	const VelocityObstacle vo = velocityObstacle(colA, colB, velB, 3.0f);
+	if (!vo.overlap)
+	{
+		const Vec2 apex = colA.pos + vo.apex;
+		drawLine(vg, apex, apex + vo.left * speedA * 8, nvgRGBA(255,255,255,192));
+		drawLine(vg, apex, apex + vo.right * speedA * 8, nvgRGBA(255,255,255,192));
+		drawCircle(vg, apex, vo.minSpeed, nvgRGBA(255,255,255,64));
+	}
+
+	AngleInterval blockedDirs[MaxObstacleArcs];
+	AngleInterval freeDirs[MaxObstacleArcs];
+	const float freeSpeed = maxf(len(optVel), 1.0f);
+	const int numFree = freeVelocityIntervals(&vo, 1, freeSpeed, blockedDirs, freeDirs, MaxObstacleArcs);
+	nvgStrokeWidth(vg,3.0);
+	for (int i = 0; i < mini(numFree, MaxObstacleArcs); i++)
+	{
+		nvgBeginPath(vg);
+		nvgArc(vg, colA.pos.x, colA.pos.y, freeSpeed, freeDirs[i].amin, freeDirs[i].amax, NVG_CW);
+		nvgStrokeColor(vg, nvgRGBA(0,192,255,160));
+		nvgStroke(vg);
+	}
+	nvgStrokeWidth(vg,1.0);
+
 	nvgStrokeWidth(vg,2.0);
 
 	nvgStrokeWidth(vg,2.0);
@@ -707,18 +769,10 @@ static Sketch sketches[] = {
 static const int numSketches = sizeof(sketches) / sizeof(sketches[0]);
 
 
-constexpr int RandMax = (1 << 23) - 1;
-int rseed = 0;
-
-inline int rand()
-{
-	return rseed = (rseed * 1103515245 + 12345) & RandMax;
-}
-
+// Test data comes from the thread RNG of mathutil, runTests() seeds it so that the datasets are the same on each run.
 inline float randf(const float rmin, const float rmax)
 {
-	rseed = (rseed * 1103515245 + 12345) & RandMax;
-	return rmin + (rseed / (float)RandMax) * (rmax - rmin);
+	return rngRange(threadRng(), rmin, rmax);
 }
 
 
@@ -730,47 +784,216 @@ struct TestPair
 	Vec2 velB;
 };
 
-Vec2 randomDir()
+// The helpers below draw from the thread RNG, or from rng when a stream of its own is needed.
+Vec2 randomDir(Rng& rng = threadRng())
 {
-	float a = randf(-M_PI, M_PI);
+	float a = rngRange(rng, -M_PI, M_PI);
 	return Vec2(cosf(a), sinf(a));
 }
 
-Vec2 randomPos(const Vec2 pmin, const Vec2 pmax)
+Vec2 randomPos(const Vec2 pmin, const Vec2 pmax, Rng& rng = threadRng())
 {
-	return Vec2(randf(pmin.x, pmax.x), randf(pmin.y, pmax.y));
+	return Vec2(rngRange(rng, pmin.x, pmax.x), rngRange(rng, pmin.y, pmax.y));
 }
 
 
-Collider randomCircleCollider()
+Collider randomCircleCollider(Rng& rng = threadRng())
 {	
-	const Vec2 pos = randomPos(Vec2(0, 0), Vec2(4, 4));
-	return Collider::MakeCircle(pos, randf(0.1f, 1.0f));
+	const Vec2 pos = randomPos(Vec2(0, 0), Vec2(4, 4), rng);
+	return Collider::MakeCircle(pos, rngRange(rng, 0.1f, 1.0f));
 }
 
-Collider randomPillCollider()
+Collider randomPillCollider(Rng& rng = threadRng())
 {	
-	const Vec2 pos = randomPos(Vec2(0, 0), Vec2(4, 4));
-	const Vec2 dir = randomDir();
-	return Collider::MakePill(pos, dir, randf(0.1f, 1.0f), randf(0.1f, 1.0f));
+	const Vec2 pos = randomPos(Vec2(0, 0), Vec2(4, 4), rng);
+	const Vec2 dir = randomDir(rng);
+	return Collider::MakePill(pos, dir, rngRange(rng, 0.1f, 1.0f), rngRange(rng, 0.1f, 1.0f));
 }
 
-Collider randomRectCollider()
+Collider randomRectCollider(Rng& rng = threadRng())
 {	
-	const Vec2 pos = randomPos(Vec2(0, 0), Vec2(4, 4));
-	const Vec2 dir = randomDir();
-	return Collider::MakeRect(pos, dir, randf(0.1f, 1.0f), randf(0.1f, 1.0f), randf(0.1f, 0.5f));
+	const Vec2 pos = randomPos(Vec2(0, 0), Vec2(4, 4), rng);
+	const Vec2 dir = randomDir(rng);
+	return Collider::MakeRect(pos, dir, rngRange(rng, 0.1f, 1.0f), rngRange(rng, 0.1f, 1.0f), rngRange(rng, 0.1f, 0.5f));
 }
 
-Collider randomCollider()
+Collider randomCollider(Rng& rng = threadRng())
 {
-	const float type = randf(0,3);
+	const float type = rngRange(rng, 0, 3);
 	if (type < 1)
-		return randomCircleCollider();
+		return randomCircleCollider(rng);
 	else if (type < 2)
-		return randomPillCollider();
+		return randomPillCollider(rng);
 	else
-		return randomRectCollider();
+		return randomRectCollider(rng);
+}
+
+enum class SpeedDistribution
+{
+	Uniform,
+	LogUniform,	// Many slow pairs and a long tail of fast ones, like a crowd.
+	Constant,
+};
+
+// Knobs for the generated pairs. The fractions are the requested counts of the generated pairs,
+// the rest are pairs that stay apart within WorkloadMaxTime. The pairs that could not be placed
+// as requested are counted by generateWorkload().
+struct WorkloadParams
+{
+	const char* name;
+	float hitFraction;		// Pairs that come into contact within WorkloadMaxTime.
+	float overlapFraction;	// Pairs that overlap at t = 0.
+	SpeedDistribution speedDist;
+	float minSpeed, maxSpeed;	// Relative speed of the pair.
+	float circleWeight, pillWeight, rectWeight;
+	float minSize, maxSize;		// Half of the longest extent of a shape.
+	float minAspect, maxAspect;	// Longest to shortest extent of pills and rects.
+};
+
+static WorkloadParams workloadPresets[] = {
+	{ "Crowd", 0.1f, 0.02f, SpeedDistribution::LogUniform, 0.05f, 3.0f, 0.5f, 0.35f, 0.15f, 0.2f, 0.6f, 1.0f, 3.0f },
+	{ "Head-on", 0.9f, 0.0f, SpeedDistribution::Uniform, 0.5f, 2.5f, 1.0f, 1.0f, 1.0f, 0.1f, 1.0f, 1.0f, 4.0f },
+	{ "Misses", 0.0f, 0.0f, SpeedDistribution::Uniform, 0.1f, 2.5f, 1.0f, 1.0f, 1.0f, 0.1f, 1.0f, 1.0f, 4.0f },
+	{ "Piled-up", 0.2f, 0.6f, SpeedDistribution::Constant, 1.0f, 1.0f, 0.2f, 0.4f, 0.4f, 0.2f, 1.0f, 2.0f, 8.0f },
+};
+static const int numWorkloadPresets = sizeof(workloadPresets) / sizeof(workloadPresets[0]);
+
+// Same query horizon as testPairsCPA().
+static const float WorkloadMaxTime = 10.0f;
+
+enum class WorkloadCase
+{
+	Miss,
+	Hit,
+	Overlap,
+};
+
+// The distance is not signed for deep overlap, so overlap is found from the contact along the path instead.
+// A hit at t = 0 enters the shapes at or before t = 0, and they overlap if the reversed motion enters them at
+// or before t = 0 too, otherwise the contact is in the past.
+WorkloadCase classifyPair(const TestPair& p)
+{
+	const ApproachRes cpa = closestPointOfApproach(p.colA, p.velA, p.colB, p.velB, WorkloadMaxTime);
+	if (cpa.hit && cpa.t <= 0.0f)
+	{
+		const ApproachRes back = closestPointOfApproach(p.colA, -p.velA, p.colB, -p.velB, WorkloadMaxTime);
+		return (back.hit && back.t <= 0.0f) ? WorkloadCase::Overlap : WorkloadCase::Miss;
+	}
+	return (cpa.hit && cpa.t < WorkloadMaxTime) ? WorkloadCase::Hit : WorkloadCase::Miss;
+}
+
+float workloadSpeed(const WorkloadParams& params)
+{
+	switch (params.speedDist)
+	{
+	case SpeedDistribution::LogUniform:
+		return params.minSpeed * powf(params.maxSpeed / params.minSpeed, randf(0, 1));
+	case SpeedDistribution::Constant:
+		return params.minSpeed;
+	default:
+		return randf(params.minSpeed, params.maxSpeed);
+	}
+}
+
+// Returns a shape whose extents fit within 'size' of its position.
+Collider workloadCollider(const WorkloadParams& params, const Vec2 pos, float& size)
+{
+	size = randf(params.minSize, params.maxSize);
+	const float aspect = randf(params.minAspect, params.maxAspect);
+	const float type = randf(0, params.circleWeight + params.pillWeight + params.rectWeight);
+	if (type < params.circleWeight)
+		return Collider::MakeCircle(pos, size);
+	if (type < params.circleWeight + params.pillWeight)
+	{
+		const float rad = size / aspect;
+		return Collider::MakePill(pos, randomDir(), size - rad, rad);
+	}
+	// Keep the corners within size.
+	const float hh = size / sqrtf(2.0f);
+	const float hw = hh / aspect;
+	const float rad = randf(0.0f, 0.25f) * hw;
+	return Collider::MakeRect(pos, randomDir(), hw - rad, hh - rad, rad);
+}
+
+static const int WorkloadMaxTries = 1000;
+
+// Places a pair of the requested case, retrying until the queries agree with the construction.
+// Returns false if none of WorkloadMaxTries pairs did, p is then the last one tried.
+bool workloadPair(const WorkloadParams& params, const WorkloadCase wanted, TestPair& p)
+{
+	for (int i = 0; i < WorkloadMaxTries; i++)
+	{
+		float sizeA, sizeB;
+		p.colA = workloadCollider(params, randomPos(Vec2(0, 0), Vec2(4, 4)), sizeA);
+		p.colB = workloadCollider(params, Vec2(0, 0), sizeB);
+
+		const float relSpeed = workloadSpeed(params);
+		const float reach = relSpeed * WorkloadMaxTime;
+		const Vec2 dir = randomDir();
+		float sep = 0.0f;
+		Vec2 relDir = randomDir();
+		if (wanted == WorkloadCase::Overlap)
+		{
+			sep = randf(0.0f, 1.0f) * (sizeA + sizeB);
+		}
+		else if (wanted == WorkloadCase::Hit)
+		{
+			sep = sizeA + sizeB + randf(0.05f, 0.9f) * reach;
+			// Aim A at a point across B, well inside the swept width of the pair.
+			const Vec2 aim = dir * sep + left(dir) * randf(-0.8f, 0.8f) * (sizeA + sizeB);
+			relDir = norm(aim);
+		}
+		else
+		{
+			sep = sizeA + sizeB + randf(0.05f, 1.5f) * reach;
+		}
+
+		// B sits at 'sep' along 'dir' from A, A moves with relDir relative to B.
+		p.colB.pos = p.colA.pos + dir * sep;
+		p.velB = randomDir() * workloadSpeed(params);
+		p.velA = p.velB + relDir * relSpeed;
+
+		if (classifyPair(p) == wanted)
+			return true;
+	}
+	return false;
+}
+
+// Returns the number of pairs that are not of the requested case.
+int generateWorkload(const WorkloadParams& params, TestPair* pairs, const int numPairs)
+{
+	const int numOverlap = (int)(params.overlapFraction * numPairs + 0.5f);
+	const int numHit = mini(numPairs - numOverlap, (int)(params.hitFraction * numPairs + 0.5f));
+	int numFailed = 0;
+	for (int i = 0; i < numPairs; i++)
+	{
+		const WorkloadCase wanted = i < numOverlap ? WorkloadCase::Overlap : (i < numOverlap + numHit ? WorkloadCase::Hit : WorkloadCase::Miss);
+		if (!workloadPair(params, wanted, pairs[i]))
+			numFailed++;
+	}
+	// Shuffle so that the cases do not run in long predictable streaks.
+	for (int i = numPairs - 1; i > 0; i--)
+	{
+		const int j = rngInt(threadRng(), i + 1);
+		const TestPair tmp = pairs[i];
+		pairs[i] = pairs[j];
+		pairs[j] = tmp;
+	}
+	return numFailed;
+}
+
+void printWorkloadParams(const WorkloadParams& params, const TestPair* pairs, const int numPairs, const int numFailed)
+{
+	static const char* speedNames[] = { "uniform", "log-uniform", "constant" };
+	int counts[3] = {};
+	for (int i = 0; i < numPairs; i++)
+		counts[(int)classifyPair(pairs[i])]++;
+	printf("%s workload: hit %.2f, overlap %.2f, %s speed %.2f-%.2f, circle:pill:rect %.2f:%.2f:%.2f, size %.2f-%.2f, aspect %.1f-%.1f\n",
+		params.name, params.hitFraction, params.overlapFraction, speedNames[(int)params.speedDist], params.minSpeed, params.maxSpeed,
+		params.circleWeight, params.pillWeight, params.rectWeight, params.minSize, params.maxSize, params.minAspect, params.maxAspect);
+	printf(" - measured: hit %.3f, overlap %.3f, miss %.3f, %d pairs not placed in %d tries\n",
+		counts[(int)WorkloadCase::Hit] / (float)numPairs, counts[(int)WorkloadCase::Overlap] / (float)numPairs,
+		counts[(int)WorkloadCase::Miss] / (float)numPairs, numFailed, WorkloadMaxTries);
 }
 
 void testPairsCPA(TestPair* pairs, const int numPairs)
@@ -785,12 +1008,77 @@ void testPairsCPA(TestPair* pairs, const int numPairs)
 	}
 }
 
+// Keeps the compiler from optimizing away the benchmarked queries.
+volatile float benchSink = 0.0f;
+
+struct PreparedPair
+{
+	PreparedCollider colA;
+	PreparedCollider colB;
+	Vec2 velA;
+	Vec2 velB;
+};
+
+void preparePairs(const TestPair* pairs, PreparedPair* prepared, const int numPairs)
+{
+	for (int i = 0; i < numPairs; i++)
+	{
+		const TestPair& p = pairs[i];
+		PreparedPair& pp = prepared[i];
+		pp.colA = prepareCollider(p.colA, p.velA, 10.0f);
+		pp.colB = prepareCollider(p.colB, p.velB, 10.0f);
+		pp.velA = p.velA;
+		pp.velB = p.velB;
+	}
+}
+
+void testPairsCPAPrepared(PreparedPair* pairs, const int numPairs)
+{
+	float acc = 0.0f;
+	for (int i = 0; i < numPairs; i++)
+	{
+		const PreparedPair& p = pairs[i];
+		ApproachRes cpa = closestPointOfApproach(p.colA, p.velA, p.colB, p.velB, 10.0f);
+		DistanceRes dist = nearestDistance(p.colA, p.velA * cpa.t, p.colB, p.velB * cpa.t);
+		acc += dist.dist;
+	}
+	benchSink = acc;
+}
+
+// Same as testPairsCPAPrepared(), warm started from the cache. Pair i is cached with the ids i and i + numPairs,
+// pairs without features skip the cache.
+void testPairsCPAWarm(PreparedPair* pairs, const int numPairs, ContactCache& cache)
+{
+	float acc = 0.0f;
+	for (int i = 0; i < numPairs; i++)
+	{
+		const PreparedPair& p = pairs[i];
+		ContactCacheEntry* entry = hasWarmStartFeatures(p.colA, p.colB) ? cache.get(i, i + numPairs) : nullptr;
+		if (entry)
+		{
+			ApproachRes cpa = closestPointOfApproach(p.colA, p.velA, p.colB, p.velB, 10.0f, entry->approach);
+			DistanceRes dist = nearestDistance(p.colA, p.velA * cpa.t, p.colB, p.velB * cpa.t, entry->distance);
+			acc += dist.dist;
+		}
+		else
+		{
+			// Analytic pair, or the cache is full, query without warm start.
+			ApproachRes cpa = closestPointOfApproach(p.colA, p.velA, p.colB, p.velB, 10.0f);
+			DistanceRes dist = nearestDistance(p.colA, p.velA * cpa.t, p.colB, p.velB * cpa.t);
+			acc += dist.dist;
+		}
+	}
+	cache.nextTick();
+	benchSink = acc;
+}
+
 struct c2Col
 {
 	union {
 		c2Circle circle;
 		c2AABB aabb;
 		c2Capsule capsule;
+		c2Poly poly;
 	};
 	C2_TYPE type;
 };
@@ -875,139 +1163,2606 @@ void testPairsCPACute(TestPair* pairs, const int numPairs)
 	}
 }
 
-
-void runTests()
+// Result of one kernel for a pair, compared against the reference of the variant by the accuracy harness.
+struct AccuracyResult
 {
-	// Ballpark test against a GJK/CA
+	float t = 0.0f;
+	float dist = 0.0f;
+	float cost = 0.0f;
+	bool hit = false;
+	bool validT = true;
+	bool validDist = true;
+	bool validCost = false;
+};
 
-	const int numPairs = 1000;
-	TestPair circlePairs[numPairs];
-	TestPair circlePillPairs[numPairs];
-	TestPair pillPairs[numPairs];
-	TestPair rectPairs[numPairs];
-	TestPair mixedPairs[numPairs];
+typedef void (*AccuracyFunc)(const TestPair& p, const float maxTime, AccuracyResult& res);
 
-	for (int i = 0; i < numPairs; i++)
+static const float AccuracyMaxTime = 10.0f;
+
+// Separation of the candidatePenalty() compared by the batched kernel variants.
+static const float AccuracySeparation = 1.0f;
+
+void accuracyScalar(const TestPair& p, const float maxTime, AccuracyResult& res)
+{
+	const ApproachRes cpa = closestPointOfApproach(p.colA, p.velA, p.colB, p.velB, maxTime);
+	res.t = cpa.t;
+	res.hit = cpa.hit;
+	res.dist = nearestDistance(p.colA, Vec2(0,0), p.colB, Vec2(0,0)).dist;
+	const float cpaDist = nearestDistance(p.colA, p.velA * cpa.t, p.colB, p.velB * cpa.t).dist;
+	res.cost = candidatePenalty(cpa.t, cpaDist, maxTime, AccuracySeparation);
+	res.validCost = true;
+}
+
+// cute_c2 only reports contacts within maxTime, but cpa.hit is set for any contact along the path, and t is clamped.
+// A hit at t = 0 is within maxTime only when the shapes overlap, then the reversed motion hits at t = 0 too.
+void accuracyScalarHorizon(const TestPair& p, const float maxTime, AccuracyResult& res)
+{
+	accuracyScalar(p, maxTime, res);
+	if (res.hit && res.t <= 0.0f)
 	{
-		TestPair& p = circlePairs[i];
-		p.colA = randomCircleCollider();
-		p.colB = randomCircleCollider();
-		p.velA = randomDir() * randf(0.1f, 2.5f);
-		p.velB = randomDir() * randf(0.1f, 2.5f);
+		const ApproachRes back = closestPointOfApproach(p.colA, -p.velA, p.colB, -p.velB, maxTime);
+		res.hit = back.hit && back.t <= 0.0f;
 	}
+	res.hit = res.hit && res.t < maxTime;
+}
 
-	for (int i = 0; i < numPairs; i++)
+void accuracyPrepared(const TestPair& p, const float maxTime, AccuracyResult& res)
+{
+	const PreparedCollider colA = prepareCollider(p.colA, p.velA, maxTime);
+	const PreparedCollider colB = prepareCollider(p.colB, p.velB, maxTime);
+	const ApproachRes cpa = closestPointOfApproach(colA, p.velA, colB, p.velB, maxTime);
+	res.t = cpa.t;
+	res.hit = cpa.hit;
+	res.dist = nearestDistance(colA, Vec2(0,0), colB, Vec2(0,0)).dist;
+}
+
+// Second query with the feature pair cached by the first one.
+void accuracyWarm(const TestPair& p, const float maxTime, AccuracyResult& res)
+{
+	const PreparedCollider colA = prepareCollider(p.colA, p.velA, maxTime);
+	const PreparedCollider colB = prepareCollider(p.colB, p.velB, maxTime);
+	FeaturePair approach;
+	FeaturePair distance;
+	closestPointOfApproach(colA, p.velA, colB, p.velB, maxTime, approach);
+	nearestDistance(colA, Vec2(0,0), colB, Vec2(0,0), distance);
+	const ApproachRes cpa = closestPointOfApproach(colA, p.velA, colB, p.velB, maxTime, approach);
+	res.t = cpa.t;
+	res.hit = cpa.hit;
+	res.dist = nearestDistance(colA, Vec2(0,0), colB, Vec2(0,0), distance).dist;
+}
+
+// Earliest t where pos + vel*t comes within rad of the points or the segments between them, in double precision.
+// Returns false when the line passes further away. The entry can be before t = 0.
+bool accuracyChainEntry(const Vec2 pos, const Vec2 vel, const double rad, const Vec2* pts, const int numPts, double& t)
+{
+	const double velSq = (double)vel.x*vel.x + (double)vel.y*vel.y;
+	bool hit = false;
+	t = DBL_MAX;
+
+	for (int i = 0; i < numPts; i++)
 	{
-		TestPair& p = circlePillPairs[i];
-		if (rand() > RandMax/2) {
-			p.colA = randomCircleCollider();
-			p.colB = randomPillCollider();
-		} else {
-			p.colA = randomPillCollider();
-			p.colB = randomCircleCollider();
+		const double rx = (double)pos.x - pts[i].x;
+		const double ry = (double)pos.y - pts[i].y;
+		const double b = vel.x*rx + vel.y*ry;
+		const double h = b*b - velSq*(rx*rx + ry*ry - rad*rad);
+		if (h > 0.0)
+		{
+			t = fmin(t, (-b - sqrt(h)) / velSq);
+			hit = true;
 		}
-		p.velA = randomDir() * randf(0.1f, 2.5f);
-		p.velB = randomDir() * randf(0.1f, 2.5f);
 	}
 
-	for (int i = 0; i < numPairs; i++)
+	for (int i = 0; i < numPts-1; i++)
 	{
-		TestPair& p = pillPairs[i];
-		p.colA = randomPillCollider();
-		p.colB = randomPillCollider();
-		p.velA = randomDir() * randf(0.1f, 2.5f);
-		p.velB = randomDir() * randf(0.1f, 2.5f);
+		const double dx = (double)pts[i+1].x - pts[i].x;
+		const double dy = (double)pts[i+1].y - pts[i].y;
+		const double lenSq = dx*dx + dy*dy;
+		if (lenSq <= 0.0)
+			continue;
+		// The signed distance to the line of the segment changes linearly along the path.
+		const double len = sqrt(lenSq);
+		const double rx = (double)pos.x - pts[i].x;
+		const double ry = (double)pos.y - pts[i].y;
+		const double d0 = (dy*rx - dx*ry) / len;
+		const double dv = (dy*vel.x - dx*vel.y) / len;
+		if (dv == 0.0)
+			continue;
+		for (int side = -1; side <= 1; side += 2)
+		{
+			const double te = (side*rad - d0) / dv;
+			const double s = ((rx + vel.x*te)*dx + (ry + vel.y*te)*dy) / lenSq;
+			if (s >= 0.0 && s <= 1.0)
+			{
+				t = fmin(t, te);
+				hit = true;
+			}
+		}
 	}
 
-	for (int i = 0; i < numPairs; i++)
+	return hit;
+}
+
+// Distance from pos to the segments between the points, in double precision.
+double accuracyChainDist(const Vec2 pos, const Vec2* pts, const int numPts)
+{
+	double distSq = DBL_MAX;
+	for (int i = 0; i < numPts; i++)
 	{
-		TestPair& p = rectPairs[i];
-		p.colA = randomRectCollider();
-		p.colB = randomRectCollider();
-		p.velA = randomDir() * randf(0.1f, 2.5f);
-		p.velB = randomDir() * randf(0.1f, 2.5f);
+		const double dx = numPts > 1 ? (double)pts[mini(i+1, numPts-1)].x - pts[i].x : 0.0;
+		const double dy = numPts > 1 ? (double)pts[mini(i+1, numPts-1)].y - pts[i].y : 0.0;
+		const double rx = (double)pos.x - pts[i].x;
+		const double ry = (double)pos.y - pts[i].y;
+		const double lenSq = dx*dx + dy*dy;
+		const double s = lenSq > 0.0 ? fmax(0.0, fmin(1.0, (rx*dx + ry*dy) / lenSq)) : 0.0;
+		const double ex = rx - dx*s;
+		const double ey = ry - dy*s;
+		distSq = fmin(distSq, ex*ex + ey*ey);
 	}
+	return sqrt(distSq);
+}
 
-	for (int i = 0; i < numPairs; i++)
+// True when pos is inside the sum of the unrounded shapes. The shapes are symmetric boxes, with zero extents for
+// circles and pills, so the sum is separated from pos along one of their axes if it is outside.
+bool accuracyCoresOverlap(const Collider& colA, const Collider& colB, const Vec2 pos)
+{
+	const Vec2 axes[4] = { colA.up, left(colA.up), colB.up, left(colB.up) };
+	for (int i = 0; i < 4; i++)
 	{
-		TestPair& p = mixedPairs[i];
-		p.colA = randomCollider();
-		p.colB = randomCollider();
-		p.velA = randomDir() * randf(0.1f, 2.5f);
-		p.velB = randomDir() * randf(0.1f, 2.5f);
+		const Vec2 n = axes[i];
+		const float extA = fabsf(dot(n, left(colA.up))) * colA.ext.x + fabsf(dot(n, colA.up)) * colA.ext.y;
+		const float extB = fabsf(dot(n, left(colB.up))) * colB.ext.x + fabsf(dot(n, colB.up)) * colB.ext.y;
+		if (fabsf(dot(n, pos)) >= extA + extB)
+			return false;
 	}
+	return true;
+}
 
+// Minkowski chain merge unrolled for fixed chain lengths. The merge always takes NumA+NumB-2 steps,
+// each step selects the next edge without branching. Produces the same result as minkowskiChain()
+// when maxRes >= NumA+NumB-1. Feature indices are only written when Features is true.
+template <int NumA, int NumB, bool Features>
+int minkowskiChainN(const Vec2* chainA, const Vec2* chainB, Vec2* res, uint8_t* resColIdx, uint8_t* resSegIdx)
+{
+	static_assert(NumA >= 1 && NumA <= 3 && NumB >= 1 && NumB <= 3, "Chains have 1-3 points.");
+	constexpr int numRes = NumA + NumB - 1;
 
-	double t0, t1;
-	printf("Circle-Circle\n");
-	t0 = glfwGetTime();
-	for (int i = 0; i < 10; i++)
-		testPairsCPA(circlePairs, numPairs);
-	t1 = glfwGetTime();
-	printf(" - %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	int ia = 0;
+	int ib = 0;
 
-	t0 = glfwGetTime();
-	for (int i = 0; i < 10; i++)
-		testPairsCPACute(circlePairs, numPairs);
-	t1 = glfwGetTime();
-	printf(" - Cute: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	res[0] = chainA[0] + chainB[0];
+	if (Features)
+	{
+		resColIdx[0] = 0;
+		resSegIdx[0] = 0;
+	}
 
+	for (int n = 1; n < numRes; n++)
+	{
+		const int ian = ia + 1 < NumA ? ia + 1 : NumA - 1;
+		const int ibn = ib + 1 < NumB ? ib + 1 : NumB - 1;
+		const Vec2 ea = chainA[ian] - chainA[ia];
+		const Vec2 eb = chainB[ibn] - chainB[ib];
+		const bool takeA = (ia + 1 < NumA) && ((ib + 1 >= NumB) || perp(ea, eb) >= 0.0f);
 
-	printf("Circle-Pill\n");
-	t0 = glfwGetTime();
-	for (int i = 0; i < 10; i++)
-		testPairsCPA(circlePillPairs, numPairs);
-	t1 = glfwGetTime();
-	printf(" - %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+		if (Features)
+		{
+			resColIdx[n] = takeA ? 0 : 1;
+			resSegIdx[n] = (uint8_t)(takeA ? ian : ibn);
+		}
+		ia += takeA ? 1 : 0;
+		ib += takeA ? 0 : 1;
+		res[n] = chainA[ia] + chainB[ib];
+	}
 
-	t0 = glfwGetTime();
-	for (int i = 0; i < 10; i++)
-		testPairsCPACute(circlePillPairs, numPairs);
-	t1 = glfwGetTime();
-	printf(" - Cute: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	return numRes;
+}
 
+// Dispatches to minkowskiChainN() based on the chain lengths, res must hold numA+numB-1 points.
+int minkowskiChainFixed(const Vec2* chainA, const int numA, const Vec2* chainB, const int numB,
+						Vec2* res, uint8_t* resColIdx, uint8_t* resSegIdx)
+{
+	switch ((numA-1)*3 + (numB-1))
+	{
+	case 0: return minkowskiChainN<1,1,true>(chainA, chainB, res, resColIdx, resSegIdx);
+	case 1: return minkowskiChainN<1,2,true>(chainA, chainB, res, resColIdx, resSegIdx);
+	case 2: return minkowskiChainN<1,3,true>(chainA, chainB, res, resColIdx, resSegIdx);
+	case 3: return minkowskiChainN<2,1,true>(chainA, chainB, res, resColIdx, resSegIdx);
+	case 4: return minkowskiChainN<2,2,true>(chainA, chainB, res, resColIdx, resSegIdx);
+	case 5: return minkowskiChainN<2,3,true>(chainA, chainB, res, resColIdx, resSegIdx);
+	case 6: return minkowskiChainN<3,1,true>(chainA, chainB, res, resColIdx, resSegIdx);
+	case 7: return minkowskiChainN<3,2,true>(chainA, chainB, res, resColIdx, resSegIdx);
+	default: return minkowskiChainN<3,3,true>(chainA, chainB, res, resColIdx, resSegIdx);
+	}
+}
 
-	printf("Pill-Pill\n");
-	t0 = glfwGetTime();
-	for (int i = 0; i < 10; i++)
-		testPairsCPA(pillPairs, numPairs);
-	t1 = glfwGetTime();
-	printf(" - %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+// Same as above, but does not record feature indices.
+int minkowskiChainFixed(const Vec2* chainA, const int numA, const Vec2* chainB, const int numB, Vec2* res)
+{
+	switch ((numA-1)*3 + (numB-1))
+	{
+	case 0: return minkowskiChainN<1,1,false>(chainA, chainB, res, nullptr, nullptr);
+	case 1: return minkowskiChainN<1,2,false>(chainA, chainB, res, nullptr, nullptr);
+	case 2: return minkowskiChainN<1,3,false>(chainA, chainB, res, nullptr, nullptr);
+	case 3: return minkowskiChainN<2,1,false>(chainA, chainB, res, nullptr, nullptr);
+	case 4: return minkowskiChainN<2,2,false>(chainA, chainB, res, nullptr, nullptr);
+	case 5: return minkowskiChainN<2,3,false>(chainA, chainB, res, nullptr, nullptr);
+	case 6: return minkowskiChainN<3,1,false>(chainA, chainB, res, nullptr, nullptr);
+	case 7: return minkowskiChainN<3,2,false>(chainA, chainB, res, nullptr, nullptr);
+	default: return minkowskiChainN<3,3,false>(chainA, chainB, res, nullptr, nullptr);
+	}
+}
 
-	t0 = glfwGetTime();
-	for (int i = 0; i < 10; i++)
-		testPairsCPACute(pillPairs, numPairs);
-	t1 = glfwGetTime();
-	printf(" - Cute: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+// CPA and distance against the chains merged by minkowskiChain(), or minkowskiChainFixed() when fixedMerge
+// is set, for all shape types. Only the chains come from the library, the sum is tested in double precision.
+// The path hits when it comes within the rounding of the sum, t is the first contact, or the closest approach
+// to the nearest vertex on a miss, clamped to maxTime.
+void accuracyChain(const TestPair& p, const float maxTime, const bool fixedMerge, AccuracyResult& res)
+{
+	const Vec2 relPos = p.colA.pos - p.colB.pos;
+	const Vec2 relVel = p.velA - p.velB;
+	const double totalRad = (double)p.colA.rad + p.colB.rad;
 
+	Vec2 chainA[3];
+	Vec2 chainB[3];
+	Vec2 sum[5];
+	uint8_t sumColIdx[5];
+	uint8_t sumSegIdx[5];
+	int numA = makeChain(p.colA, -relPos, chainA);
+	int numB = makeChain(p.colB, -relPos, chainB);
+	int numSum = fixedMerge ? minkowskiChainFixed(chainA, numA, chainB, numB, sum)
+							: minkowskiChain(chainA, numA, chainB, numB, sum, sumColIdx, sumSegIdx, 5);
+	res.dist = (float)(accuracyChainDist(relPos, sum, numSum) - totalRad);
+	// Inside the sum the distance to the chain is not signed, like in the scalar queries, only separated pairs are compared.
+	res.validDist = res.dist > 0.0f && !accuracyCoresOverlap(p.colA, p.colB, relPos);
+
+	const double velSq = (double)relVel.x*relVel.x + (double)relVel.y*relVel.y;
+	if (velSq < 1e-12)
+	{
+		res.t = 0.0f;
+		res.hit = res.dist <= 0.0f || accuracyCoresOverlap(p.colA, p.colB, relPos);
+		return;
+	}
 
-	printf("Rect-Rect\n");
-	t0 = glfwGetTime();
-	for (int i = 0; i < 10; i++)
-		testPairsCPA(rectPairs, numPairs);
-	t1 = glfwGetTime();
-	printf(" - %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	numA = makeChain(p.colA, relVel, chainA);
+	numB = makeChain(p.colB, relVel, chainB);
+	numSum = fixedMerge ? minkowskiChainFixed(chainA, numA, chainB, numB, sum)
+						: minkowskiChain(chainA, numA, chainB, numB, sum, sumColIdx, sumSegIdx, 5);
 
-	t0 = glfwGetTime();
-	for (int i = 0; i < 10; i++)
-		testPairsCPACute(rectPairs, numPairs);
-	t1 = glfwGetTime();
-	printf(" - Cute: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	double t = 0.0;
+	res.hit = accuracyChainEntry(relPos, relVel, totalRad, sum, numSum, t);
+	if (!res.hit)
+	{
+		// The path is closest to the sum at the vertex nearest to it.
+		double nearestSq = DBL_MAX;
+		for (int i = 0; i < numSum; i++)
+		{
+			const double rx = (double)relPos.x - sum[i].x;
+			const double ry = (double)relPos.y - sum[i].y;
+			const double ti = -(rx*relVel.x + ry*relVel.y) / velSq;
+			const double ex = rx + relVel.x*ti;
+			const double ey = ry + relVel.y*ti;
+			const double dSq = ex*ex + ey*ey;
+			if (dSq < nearestSq)
+			{
+				nearestSq = dSq;
+				t = ti;
+			}
+		}
+	}
+	res.t = (float)fmax(0.0, fmin((double)maxTime, t));
+}
 
+void accuracyGenericChain(const TestPair& p, const float maxTime, AccuracyResult& res)
+{
+	accuracyChain(p, maxTime, false, res);
+}
 
-	printf("Mixed\n");
-	t0 = glfwGetTime();
+void accuracyFixedChain(const TestPair& p, const float maxTime, AccuracyResult& res)
+{
+	accuracyChain(p, maxTime, true, res);
+}
+
+// The batched candidate kernels only report the cost, it is compared against candidatePenalty() at the scalar CPA.
+template<KernelVariant Variant>
+void accuracyKernel(const TestPair& p, const float maxTime, AccuracyResult& res)
+{
+	const KernelVariant prevVariant = currentKernelVariant();
+	setKernelVariant(Variant);
+	const PreparedCollider colA = prepareCollider(p.colA, p.velA, maxTime);
+	const PreparedCollider colB = prepareCollider(p.colB, p.velB, maxTime);
+	evaluateVelocityCandidates(colA, &p.velA, 1, &colB, &p.velB, 1, maxTime, AccuracySeparation, &res.cost);
+	setKernelVariant(prevVariant);
+	res.validT = false;
+	res.validDist = false;
+	res.validCost = true;
+}
+
+// Shape in world space with identity transform, rects become polygons without the rounding.
+c2Col colliderToCuteWorld(const Collider& col, C2_TYPE& type)
+{
+	c2Col c;
+	if (col.type == ColliderType::Circle)
+	{
+		c.circle.p = c2V(col.pos.x, col.pos.y);
+		c.circle.r = col.rad;
+		type = C2_TYPE_CIRCLE;
+	}
+	else if (col.type == ColliderType::Pill)
+	{
+		const Vec2 a = col.pos - col.up * col.ext.y;
+		const Vec2 b = col.pos + col.up * col.ext.y;
+		c.capsule.a = c2V(a.x, a.y);
+		c.capsule.b = c2V(b.x, b.y);
+		c.capsule.r = col.rad;
+		type = C2_TYPE_CAPSULE;
+	}
+	else
+	{
+		const Vec2 axisX = left(col.up) * col.ext.x;
+		const Vec2 axisY = col.up * col.ext.y;
+		const Vec2 verts[4] = { col.pos - axisX - axisY, col.pos + axisX - axisY, col.pos + axisX + axisY, col.pos - axisX + axisY };
+		c.poly.count = 4;
+		for (int i = 0; i < 4; i++)
+			c.poly.verts[i] = c2V(verts[i].x, verts[i].y);
+		c2MakePoly(&c.poly);
+		type = C2_TYPE_POLY;
+	}
+	return c;
+}
+
+// cute_c2 has no rounded polygons, the distance is corrected by the rounding, but time of impact
+// can only be compared when the rects are sharp. TOI is over unit time, so the velocities are scaled.
+void accuracyCute(const TestPair& p, const float maxTime, AccuracyResult& res)
+{
+	C2_TYPE typeA, typeB;
+	const c2Col ca = colliderToCuteWorld(p.colA, typeA);
+	const c2Col cb = colliderToCuteWorld(p.colB, typeB);
+	const float roundA = p.colA.type == ColliderType::Rect ? p.colA.rad : 0.0f;
+	const float roundB = p.colB.type == ColliderType::Rect ? p.colB.rad : 0.0f;
+
+	const float toi = c2TOI(&ca, typeA, NULL, c2V(p.velA.x * maxTime, p.velA.y * maxTime),
+							&cb, typeB, NULL, c2V(p.velB.x * maxTime, p.velB.y * maxTime), 1, NULL);
+	res.t = toi * maxTime;
+	res.hit = toi < 1.0f;
+	res.validT = roundA == 0.0f && roundB == 0.0f;
+
+	c2v outA, outB;
+	const float d = c2GJK(&ca, typeA, NULL, &cb, typeB, NULL, &outA, &outB, 1, NULL, NULL);
+	res.dist = d - roundA - roundB;
+	// GJK does not report penetration, and cannot see overlap of the rounding.
+	res.validDist = d > roundA + roundB;
+}
+
+struct AccuracyCase
+{
+	TestPair pair;
+	float errT = 0.0f;
+	float errDist = 0.0f;
+	float errCost = 0.0f;
+};
+
+static const int AccuracyWorstCases = 8;
+
+inline float accuracyCaseError(const AccuracyCase& c)
+{
+	return maxf(c.errT, maxf(c.errDist, c.errCost));
+}
+
+struct AccuracyStats
+{
+	const char* name = "";
+	AccuracyFunc func = nullptr;
+	AccuracyFunc reference = accuracyScalar;
+	double sumErrT = 0.0;
+	double sumErrDist = 0.0;
+	double sumErrCost = 0.0;
+	float maxErrT = 0.0f;
+	float maxErrDist = 0.0f;
+	float maxErrCost = 0.0f;
+	int numT = 0;
+	int numDist = 0;
+	int numCost = 0;
+	int numHitMismatch = 0;
+	AccuracyCase worst[AccuracyWorstCases];   // sorted by descending error.
+	int numWorst = 0;
+};
+
+// Rects are sharp half of the time, so that cute_c2 time of impact can be compared.
+TestPair randomAccuracyPair()
+{
+	TestPair p;
+	p.colA = randomCollider();
+	p.colB = randomCollider();
+	if (p.colA.type == ColliderType::Rect && randf() < 0.5f)
+		p.colA.rad = 0.0f;
+	if (p.colB.type == ColliderType::Rect && randf() < 0.5f)
+		p.colB.rad = 0.0f;
+	p.velA = randomDir() * randf(0.1f, 2.5f);
+	p.velB = randomDir() * randf(0.1f, 2.5f);
+	return p;
+}
+
+bool compareAccuracy(AccuracyStats& stats, const TestPair& p, AccuracyCase* testCase = nullptr)
+{
+	AccuracyResult ref;
+	stats.reference(p, AccuracyMaxTime, ref);
+	AccuracyResult res;
+	stats.func(p, AccuracyMaxTime, res);
+
+	float errT = 0.0f;
+	float errDist = 0.0f;
+	float errCost = 0.0f;
+	if (res.validT)
+	{
+		if (res.hit != ref.hit)
+		{
+			stats.numHitMismatch++;
+		}
+		else if (ref.hit)
+		{
+			errT = fabsf(res.t - ref.t);
+			stats.sumErrT += errT;
+			stats.maxErrT = maxf(stats.maxErrT, errT);
+			stats.numT++;
+		}
+	}
+	if (res.validDist && ref.dist > 0.0f)
+	{
+		errDist = fabsf(res.dist - ref.dist);
+		stats.sumErrDist += errDist;
+		stats.maxErrDist = maxf(stats.maxErrDist, errDist);
+		stats.numDist++;
+	}
+	if (res.validCost && ref.validCost)
+	{
+		errCost = fabsf(res.cost - ref.cost);
+		stats.sumErrCost += errCost;
+		stats.maxErrCost = maxf(stats.maxErrCost, errCost);
+		stats.numCost++;
+	}
+
+	if (testCase)
+	{
+		testCase->pair = p;
+		testCase->errT = errT;
+		testCase->errDist = errDist;
+		testCase->errCost = errCost;
+	}
+
+	// Keep the worst cases, hit mismatches count as the largest error.
+	const float err = (res.validT && res.hit != ref.hit) ? FLT_MAX : maxf(errT, maxf(errDist, errCost));
+	if (err <= 0.0f || (stats.numWorst == AccuracyWorstCases && err <= accuracyCaseError(stats.worst[AccuracyWorstCases-1])))
+		return false;
+	int k = mini(stats.numWorst, AccuracyWorstCases-1);
+	for (; k > 0 && accuracyCaseError(stats.worst[k-1]) < err; k--)
+		stats.worst[k] = stats.worst[k-1];
+	stats.worst[k].pair = p;
+	stats.worst[k].errT = err == FLT_MAX ? FLT_MAX : errT;
+	stats.worst[k].errDist = errDist;
+	stats.worst[k].errCost = errCost;
+	stats.numWorst = mini(stats.numWorst+1, AccuracyWorstCases);
+	return true;
+}
+
+void writeAccuracyCollider(FILE* fp, const Collider& col)
+{
+	fprintf(fp, " %d %.9g %.9g %.9g %.9g %.9g %.9g %.9g", (int)col.type, col.pos.x, col.pos.y, col.up.x, col.up.y, col.ext.x, col.ext.y, col.rad);
+}
+
+bool readAccuracyCollider(FILE* fp, Collider& col)
+{
+	int type = 0;
+	if (fscanf(fp, " %d %f %f %f %f %f %f %f", &type, &col.pos.x, &col.pos.y, &col.up.x, &col.up.y, &col.ext.x, &col.ext.y, &col.rad) != 8)
+		return false;
+	col.type = (ColliderType)type;
+	return true;
+}
+
+// One case per line: variant name, colliders A and B (type, pos, up, ext, rad) and velocities A and B.
+bool writeAccuracyCorpus(const char* path, const AccuracyStats* stats, const int numStats)
+{
+	FILE* fp = fopen(path, "w");
+	if (!fp)
+		return false;
+	for (int i = 0; i < numStats; i++)
+	{
+		for (int j = 0; j < stats[i].numWorst; j++)
+		{
+			const TestPair& p = stats[i].worst[j].pair;
+			fprintf(fp, "%s", stats[i].name);
+			writeAccuracyCollider(fp, p.colA);
+			writeAccuracyCollider(fp, p.colB);
+			fprintf(fp, " %.9g %.9g %.9g %.9g\n", p.velA.x, p.velA.y, p.velB.x, p.velB.y);
+		}
+	}
+	return fclose(fp) == 0;
+}
+
+// Runs the cases of the corpus again through the variant that produced them and its reference.
+void replayAccuracyCorpus(const char* path, AccuracyStats* stats, const int numStats)
+{
+	FILE* fp = fopen(path, "r");
+	if (!fp)
+	{
+		printf("Could not open %s\n", path);
+		return;
+	}
+
+	printf("Replay %s\n", path);
+	char name[64];
+	TestPair p;
+	while (fscanf(fp, " %63s", name) == 1)
+	{
+		if (!readAccuracyCollider(fp, p.colA) || !readAccuracyCollider(fp, p.colB) ||
+			fscanf(fp, " %f %f %f %f", &p.velA.x, &p.velA.y, &p.velB.x, &p.velB.y) != 4)
+			break;
+
+		for (int i = 0; i < numStats; i++)
+		{
+			if (strcmp(stats[i].name, name) != 0)
+				continue;
+			AccuracyResult ref;
+			stats[i].reference(p, AccuracyMaxTime, ref);
+			AccuracyResult res;
+			stats[i].func(p, AccuracyMaxTime, res);
+			printf(" - %s: ref t %.5f hit %d dist %.5f cost %.5f, got t %.5f hit %d dist %.5f cost %.5f\n", name,
+				   ref.t, (int)ref.hit, ref.dist, ref.cost, res.t, (int)res.hit, res.dist, res.cost);
+		}
+	}
+	fclose(fp);
+}
+
+static const int MaxAccuracyVariants = 12;
+
+// Variants and the references they are compared against, returns the number of variants.
+// The generic chain checks the scalar queries against a sum that does not go through their CPA code,
+// and the fixed chain merge is checked against the generic one. Unsupported kernel variants are skipped.
+int initAccuracyVariants(AccuracyStats* stats)
+{
+	int num = 0;
+	stats[num].name = "Prepared";
+	stats[num++].func = accuracyPrepared;
+	stats[num].name = "Warm";
+	stats[num++].func = accuracyWarm;
+	stats[num].name = "GenericChain";
+	stats[num++].func = accuracyGenericChain;
+	stats[num].name = "FixedChain";
+	stats[num].reference = accuracyGenericChain;
+	stats[num++].func = accuracyFixedChain;
+	stats[num].name = "Cute";
+	stats[num].reference = accuracyScalarHorizon;
+	stats[num++].func = accuracyCute;
+
+	static const char* kernelNames[NumKernelVariants] = { "KernelScalar", "KernelSSE", "KernelAVX2", "KernelAVX512" };
+	static const AccuracyFunc kernelFuncs[NumKernelVariants] = {
+		accuracyKernel<KernelVariant::Scalar>, accuracyKernel<KernelVariant::SSE>,
+		accuracyKernel<KernelVariant::AVX2>, accuracyKernel<KernelVariant::AVX512>,
+	};
+	for (int i = 0; i < NumKernelVariants; i++)
+	{
+		if (!kernelVariantSupported((KernelVariant)i))
+			continue;
+		stats[num].name = kernelNames[i];
+		stats[num++].func = kernelFuncs[i];
+	}
+	return num;
+}
+
+// Runs random pairs through the variants and their references, and reports the differences.
+// The worst cases of each variant are saved as a corpus that can be replayed.
+void runAccuracyHarness(const int numPairs, const char* corpusPath)
+{
+	static AccuracyStats stats[MaxAccuracyVariants];
+	const int numStats = initAccuracyVariants(stats);
+
+	int numHits = 0;
+	for (int i = 0; i < numPairs; i++)
+	{
+		const TestPair p = randomAccuracyPair();
+		AccuracyResult ref;
+		accuracyScalar(p, AccuracyMaxTime, ref);
+		numHits += ref.hit ? 1 : 0;
+		for (int j = 0; j < numStats; j++)
+			compareAccuracy(stats[j], p);
+	}
+
+	printf("Accuracy (%d pairs, %.1f%% hits)\n", numPairs, numHits * 100.0f / numPairs);
+	for (int i = 0; i < numStats; i++)
+	{
+		const AccuracyStats& st = stats[i];
+		printf(" - %s: t max %g mean %g (%d), dist max %g mean %g (%d), cost max %g mean %g (%d), hit disagreements %d\n", st.name,
+			   st.maxErrT, st.numT > 0 ? st.sumErrT / st.numT : 0.0, st.numT,
+			   st.maxErrDist, st.numDist > 0 ? st.sumErrDist / st.numDist : 0.0, st.numDist,
+			   st.maxErrCost, st.numCost > 0 ? st.sumErrCost / st.numCost : 0.0, st.numCost, st.numHitMismatch);
+	}
+
+	if (corpusPath && writeAccuracyCorpus(corpusPath, stats, numStats))
+		printf(" - worst cases written to %s\n", corpusPath);
+}
+
+struct ChainPair
+{
+	Vec2 chainA[3];
+	Vec2 chainB[3];
+	int numA;
+	int numB;
+};
+
+int makeChainPairs(const TestPair* pairs, const int numPairs, ChainPair* chains, const int maxChains)
+{
+	const int numChains = mini(numPairs, maxChains);
+	for (int i = 0; i < numChains; i++)
+	{
+		const TestPair& p = pairs[i];
+		const Vec2 relVel = p.velA - p.velB;
+		chains[i].numA = makeChain(p.colA, relVel, chains[i].chainA);
+		chains[i].numB = makeChain(p.colB, relVel, chains[i].chainB);
+	}
+	return numChains;
+}
+
+void benchMinkowskiChain(const char* name, const TestPair* pairs, const int numPairs)
+{
+	static const int maxChainPairs = 1000;
+	ChainPair chains[maxChainPairs];
+	const int numChains = makeChainPairs(pairs, numPairs, chains, maxChainPairs);
+
+	const int iters = 100;
+	Vec2 sum[5];
+	uint8_t sumColIdx[5];
+	uint8_t sumSegIdx[5];
+	float acc = 0.0f;
+	double t0, t1;
+
+	printf("%s Minkowski Chain\n", name);
+
+	t0 = glfwGetTime();
+	for (int j = 0; j < iters; j++)
+	{
+		for (int i = 0; i < numChains; i++)
+		{
+			const ChainPair& c = chains[i];
+			const int n = minkowskiChain(c.chainA, c.numA, c.chainB, c.numB, sum, sumColIdx, sumSegIdx, 5);
+			acc += sum[n-1].x;
+		}
+	}
+	t1 = glfwGetTime();
+	printf(" - Generic: %.3f ms\n", (t1-t0) * 1000.0 / iters);
+
+	t0 = glfwGetTime();
+	for (int j = 0; j < iters; j++)
+	{
+		for (int i = 0; i < numChains; i++)
+		{
+			const ChainPair& c = chains[i];
+			const int n = minkowskiChainFixed(c.chainA, c.numA, c.chainB, c.numB, sum, sumColIdx, sumSegIdx);
+			acc += sum[n-1].x;
+		}
+	}
+	t1 = glfwGetTime();
+	printf(" - Fixed: %.3f ms\n", (t1-t0) * 1000.0 / iters);
+
+	t0 = glfwGetTime();
+	for (int j = 0; j < iters; j++)
+	{
+		for (int i = 0; i < numChains; i++)
+		{
+			const ChainPair& c = chains[i];
+			const int n = minkowskiChainFixed(c.chainA, c.numA, c.chainB, c.numB, sum);
+			acc += sum[n-1].x;
+		}
+	}
+	t1 = glfwGetTime();
+	printf(" - Fixed, no features: %.3f ms\n", (t1-t0) * 1000.0 / iters);
+
+	benchSink = acc;
+}
+
+// cute_c2 set up the way a GJK engine keeps its pairs: shapes in local space with rects as polygons,
+// a transform per shape, and GJK caches that persist from tick to tick. cute_c2 has no rounded
+// polygons, the rect rounding is ignored.
+struct CutePair
+{
+	c2Col ca;
+	c2Col cb;
+	c2x xa;
+	c2x xb;
+	c2GJKCache toiCache;
+	c2GJKCache distCache;
+};
+
+c2Col colliderToCuteLocal(const Collider& col)
+{
+	c2Col c;
+	if (col.type == ColliderType::Circle)
+	{
+		c.circle.p = c2V(0, 0);
+		c.circle.r = col.rad;
+		c.type = C2_TYPE_CIRCLE;
+	}
+	else if (col.type == ColliderType::Pill)
+	{
+		c.capsule.a = c2V(0, -col.ext.y);
+		c.capsule.b = c2V(0, col.ext.y);
+		c.capsule.r = col.rad;
+		c.type = C2_TYPE_CAPSULE;
+	}
+	else
+	{
+		c.poly.count = 4;
+		c.poly.verts[0] = c2V(-col.ext.x, -col.ext.y);
+		c.poly.verts[1] = c2V(col.ext.x, -col.ext.y);
+		c.poly.verts[2] = c2V(col.ext.x, col.ext.y);
+		c.poly.verts[3] = c2V(-col.ext.x, col.ext.y);
+		c2MakePoly(&c.poly);
+		c.type = C2_TYPE_POLY;
+	}
+	return c;
+}
+
+static c2x colliderTransform(const Collider& col)
+{
+	c2x x;
+	x.p = c2V(col.pos.x, col.pos.y);
+	// Local y is along up, so the rotation is the one taking (0,1) to up.
+	x.r.c = col.up.y;
+	x.r.s = -col.up.x;
+	return x;
+}
+
+void prepareCutePairs(const TestPair* pairs, CutePair* cute, const int numPairs)
+{
+	for (int i = 0; i < numPairs; i++)
+	{
+		cute[i].ca = colliderToCuteLocal(pairs[i].colA);
+		cute[i].cb = colliderToCuteLocal(pairs[i].colB);
+		cute[i].toiCache.count = 0;
+		cute[i].distCache.count = 0;
+	}
+}
+
+// c2TOI() with the GJK cache kept by the caller, so that the next call starts from the last simplex.
+float cuteTOICached(CutePair& cp, const c2v vA, const c2v vB)
+{
+	float t = 0;
+	c2v a, b;
+	float d = c2Step(t, &cp.ca, cp.ca.type, &cp.xa, vA, &a, &cp.cb, cp.cb.type, &cp.xb, vB, &b, 1, &cp.toiCache);
+	const c2v v = c2Sub(vB, vA);
+	while (d > 1.0e-4f && t < 1)
+	{
+		const float velocityBound = c2Abs(c2Dot(c2Norm(c2Sub(b, a)), v));
+		if (!velocityBound)
+			return 1;
+		const float t1 = t + d / velocityBound;
+		if (t == t1)
+			break;
+		t = t1;
+		d = c2Step(t, &cp.ca, cp.ca.type, &cp.xa, vA, &a, &cp.cb, cp.cb.type, &cp.xb, vB, &b, 1, &cp.toiCache);
+	}
+	return t >= 1 ? 1 : t;
+}
+
+// Same query as testCute(), TOI and distance at TOI. With 'cached' the pair's GJK caches are used and updated.
+// The TOIs are stored in 'tois' when given.
+void testPairsCPACuteCoherent(const TestPair* pairs, CutePair* cute, const int numPairs, const bool cached, float* tois = nullptr)
+{
+	for (int i = 0; i < numPairs; i++)
+	{
+		const TestPair& p = pairs[i];
+		CutePair& cp = cute[i];
+		cp.xa = colliderTransform(p.colA);
+		cp.xb = colliderTransform(p.colB);
+		const c2v va = c2V(p.velA.x * 10.0f, p.velA.y * 10.0f);
+		const c2v vb = c2V(p.velB.x * 10.0f, p.velB.y * 10.0f);
+
+		const float toi = cached ? cuteTOICached(cp, va, vb)
+								 : c2TOI(&cp.ca, cp.ca.type, &cp.xa, va, &cp.cb, cp.cb.type, &cp.xb, vb, 1, NULL);
+
+		if (tois)
+			tois[i] = toi;
+
+		c2x xa = cp.xa;
+		c2x xb = cp.xb;
+		xa.p = c2Add(xa.p, c2Mulvs(va, toi));
+		xb.p = c2Add(xb.p, c2Mulvs(vb, toi));
+		c2v outA, outB;
+		benchSink = c2GJK(&cp.ca, cp.ca.type, &xa, &cp.cb, cp.cb.type, &xb, &outA, &outB, 1, NULL, cached ? &cp.distCache : NULL);
+	}
+}
+
+void movePairs(TestPair* pairs, const int numPairs, const float dt)
+{
+	for (int i = 0; i < numPairs; i++)
+	{
+		TestPair& p = pairs[i];
+		p.colA.pos += p.velA * dt;
+		p.colB.pos += p.velB * dt;
+	}
+}
+
+void benchWarmStart(const char* name, const TestPair* pairs, const int numPairs)
+{
+	static const int maxWarmPairs = 1000;
+	TestPair movingPairs[maxWarmPairs];
+	PreparedPair prepared[maxWarmPairs];
+	const int num = mini(numPairs, maxWarmPairs);
+	memcpy(movingPairs, pairs, sizeof(TestPair) * num);
+
+	ContactCache cache(num * 2);
+
+	CutePair cute[maxWarmPairs];
+	float coldTois[maxWarmPairs];
+	float warmTois[maxWarmPairs];
+	prepareCutePairs(movingPairs, cute, num);
+	double cuteColdTime = 0.0;
+	double cuteWarmTime = 0.0;
+	float maxToiDiff = 0.0f;
+
+	const int numTicks = 30;
+	const float dt = 1.0f / 30.0f;
+	double coldTime = 0.0;
+	double warmTime = 0.0;
+	double t0, t1;
+
+	for (int tick = 0; tick < numTicks; tick++)
+	{
+		preparePairs(movingPairs, prepared, num);
+
+		t0 = glfwGetTime();
+		testPairsCPAPrepared(prepared, num);
+		t1 = glfwGetTime();
+		coldTime += t1 - t0;
+
+		t0 = glfwGetTime();
+		testPairsCPAWarm(prepared, num, cache);
+		t1 = glfwGetTime();
+		warmTime += t1 - t0;
+
+		t0 = glfwGetTime();
+		testPairsCPACuteCoherent(movingPairs, cute, num, false, coldTois);
+		t1 = glfwGetTime();
+		cuteColdTime += t1 - t0;
+
+		t0 = glfwGetTime();
+		testPairsCPACuteCoherent(movingPairs, cute, num, true, warmTois);
+		t1 = glfwGetTime();
+		cuteWarmTime += t1 - t0;
+
+		for (int i = 0; i < num; i++)
+			maxToiDiff = maxf(maxToiDiff, fabsf(coldTois[i] - warmTois[i]) * 10.0f);
+
+		movePairs(movingPairs, num, dt);
+	}
+
+	printf("%s Warm Start (%d ticks)\n", name, numTicks);
+	printf(" - Cold: %.3f ms\n", coldTime * 1000.0 / numTicks);
+	printf(" - Warm: %.3f ms\n", warmTime * 1000.0 / numTicks);
+	printf(" - Cute cold: %.3f ms\n", cuteColdTime * 1000.0 / numTicks);
+	printf(" - Cute GJK cache: %.3f ms (max TOI difference to cold %g)\n", cuteWarmTime * 1000.0 / numTicks, maxToiDiff);
+}
+
+
+void benchVelocityCandidates(const char* name, const TestPair* pairs, const int numPairs)
+{
+	static const int numNeighbours = 8;
+	static const int numCandidates = 128;
+	static const int numDirs = 32;
+	const float maxTime = 10.0f;
+	const float separation = 1.0f;
+	const int numAgents = numPairs / numNeighbours;
+
+	Vec2 candidates[numCandidates];
+	for (int i = 0; i < numCandidates; i++)
+	{
+		const float a = (float)(i % numDirs) / (float)numDirs * M_PI * 2.0f;
+		const float speed = 2.5f * (float)(1 + i / numDirs) / (float)(numCandidates / numDirs);
+		candidates[i] = Vec2(cosf(a), sinf(a)) * speed;
+	}
+
+	float costs[numCandidates];
+	float refCosts[numCandidates];
+	PreparedCollider neighbours[numNeighbours];
+	Vec2 neighbourVels[numNeighbours];
+	double scalarTime = 0.0;
+	double batchTime[NumKernelVariants] = {};
+	float maxDiff[NumKernelVariants] = {};
+	double gradTime = 0.0;
+	const KernelVariant selected = currentKernelVariant();
+	double t0, t1;
+
+	for (int i = 0; i < numAgents; i++)
+	{
+		const TestPair* group = &pairs[i * numNeighbours];
+		const PreparedCollider agent = prepareCollider(group[0].colA, group[0].velA, maxTime);
+		for (int j = 0; j < numNeighbours; j++)
+		{
+			neighbours[j] = prepareCollider(group[j].colB, group[j].velB, maxTime);
+			neighbourVels[j] = group[j].velB;
+		}
+
+		t0 = glfwGetTime();
+		for (int k = 0; k < numCandidates; k++)
+		{
+			refCosts[k] = 0.0f;
+			for (int j = 0; j < numNeighbours; j++)
+			{
+				ApproachRes cpa = closestPointOfApproach(agent, candidates[k], neighbours[j], neighbourVels[j], maxTime);
+				DistanceRes dist = nearestDistance(agent, candidates[k] * cpa.t, neighbours[j], neighbourVels[j] * cpa.t);
+				refCosts[k] = maxf(refCosts[k], candidatePenalty(cpa.t, dist.dist, maxTime, separation));
+			}
+		}
+		t1 = glfwGetTime();
+		scalarTime += t1 - t0;
+
+		for (int v = 0; v < NumKernelVariants; v++)
+		{
+			if (!setKernelVariant((KernelVariant)v))
+				continue;
+			t0 = glfwGetTime();
+			evaluateVelocityCandidates(agent, candidates, numCandidates, neighbours, neighbourVels, numNeighbours, maxTime, separation, costs);
+			t1 = glfwGetTime();
+			batchTime[v] += t1 - t0;
+
+			for (int k = 0; k < numCandidates; k++)
+				maxDiff[v] = maxf(maxDiff[v], fabsf(costs[k] - refCosts[k]));
+		}
+		setKernelVariant(selected);
+
+		t0 = glfwGetTime();
+		benchSink += optimizeVelocity(agent, group[0].velA, 2.5f, neighbours, neighbourVels, numNeighbours, maxTime, separation, 16).x;
+		t1 = glfwGetTime();
+		gradTime += t1 - t0;
+	}
+
+	printf("%s Velocity Candidates (%d agents, %d candidates, %d neighbours)\n", name, numAgents, numCandidates, numNeighbours);
+	printf(" - Scalar: %.3f ms\n", scalarTime * 1000.0);
+	for (int v = 0; v < NumKernelVariants; v++)
+	{
+		if (!kernelVariantSupported((KernelVariant)v))
+			continue;
+		printf(" - Batched %s%s: %.3f ms (max diff %g)\n", kernelVariantName((KernelVariant)v),
+			   (KernelVariant)v == selected ? " (selected)" : "", batchTime[v] * 1000.0, maxDiff[v]);
+	}
+	printf(" - Gradient (16 iterations): %.3f ms\n", gradTime * 1000.0);
+}
+
+
+static float velocitySearchCost(const PreparedCollider& agent, const Vec2 vel, const Vec2 prefVel, const float maxSpeed,
+								const PreparedCollider* neighbours, const Vec2* neighbourVels, const int numNeighbours,
+								const float maxTime, const float separation)
+{
+	float penalty = 0.0f;
+	for (int j = 0; j < numNeighbours; j++)
+	{
+		ApproachRes cpa = closestPointOfApproach(agent, vel, neighbours[j], neighbourVels[j], maxTime);
+		DistanceRes dist = nearestDistance(agent, vel * cpa.t, neighbours[j], neighbourVels[j] * cpa.t);
+		if (cpa.hit && cpa.t <= 0.0f)
+		{
+			const float approach = -dot(vel - neighbourVels[j], dist.norm) / maxSpeed;
+			penalty = maxf(penalty, 0.5f + 0.5f * clampf(approach, -1.0f, 1.0f));
+			continue;
+		}
+		penalty = maxf(penalty, candidatePenalty(cpa.t, dist.dist, maxTime, separation));
+	}
+	return lenSq(vel - prefVel) / sqrf(maxSpeed) + CandidatePenaltyWeight * penalty;
+}
+
+// The grid and the adaptive search at a few evaluation budgets run on the same scenes, so that the cost
+// reached with a given number of evaluations can be compared. Grid velocities above maxSpeed are skipped,
+// the search does not go there either.
+void benchVelocitySearch(const char* name, const TestPair* pairs, const int numPairs)
+{
+	static const int numNeighbours = 8;
+	static const int gridSize = 10;
+	static const int numBudgets = 4;
+	static const int budgets[numBudgets] = { 32, 64, 128, 256 };
+	const float maxTime = 10.0f;
+	const float separation = 1.0f;
+	const float maxSpeed = 2.5f;
+	const int numAgents = numPairs / numNeighbours;
+
+	PreparedCollider neighbours[numNeighbours];
+	Vec2 neighbourVels[numNeighbours];
+	double gridTime = 0.0;
+	double gridCost = 0.0;
+	int gridEvals = 0;
+	double searchTime[numBudgets] = {};
+	double searchCost[numBudgets] = {};
+	int searchEvals[numBudgets] = {};
+	double t0, t1;
+
+	for (int i = 0; i < numAgents; i++)
+	{
+		const TestPair* group = &pairs[i * numNeighbours];
+		const PreparedCollider agent = prepareCollider(group[0].colA, group[0].velA, maxTime);
+		const Vec2 prefVel = group[0].velA;
+		const Vec2 prefDir = norm(prefVel);
+
+		// Neighbours spread ahead of the agent, coming towards it.
+		for (int j = 0; j < numNeighbours; j++)
+		{
+			const float a = randf(-1.0f, 1.0f);
+			const Vec2 dir = prefDir * cosf(a) + left(prefDir) * sinf(a);
+			Collider col = group[j].colB;
+			col.pos = group[0].colA.pos + dir * randf(3.0f, 8.0f);
+			neighbourVels[j] = -dir * len(group[j].velB);
+			neighbours[j] = prepareCollider(col, neighbourVels[j], maxTime);
+		}
+
+		// Uniform grid like in the CPA field sketch.
+		t0 = glfwGetTime();
+		Vec2 gridVel = prefVel;
+		float bestCost = FLT_MAX;
+		for (int y = -gridSize; y <= gridSize; y++)
+		{
+			for (int x = -gridSize; x <= gridSize; x++)
+			{
+				if (x*x + y*y > gridSize*gridSize)
+					continue;
+				const Vec2 vel = Vec2((float)x, (float)y) * (maxSpeed / (float)gridSize);
+				const float cost = velocitySearchCost(agent, vel, prefVel, maxSpeed, neighbours, neighbourVels, numNeighbours, maxTime, separation);
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					gridVel = vel;
+				}
+				gridEvals++;
+			}
+		}
+		t1 = glfwGetTime();
+		gridTime += t1 - t0;
+		gridCost += velocitySearchCost(agent, gridVel, prefVel, maxSpeed, neighbours, neighbourVels, numNeighbours, maxTime, separation);
+
+		for (int b = 0; b < numBudgets; b++)
+		{
+			t0 = glfwGetTime();
+			int numEvaluations = 0;
+			const Vec2 searchVel = searchVelocity(agent, prefVel, maxSpeed, neighbours, neighbourVels, numNeighbours, maxTime, separation, budgets[b], numEvaluations);
+			t1 = glfwGetTime();
+			searchTime[b] += t1 - t0;
+			searchEvals[b] += numEvaluations;
+			searchCost[b] += velocitySearchCost(agent, searchVel, prefVel, maxSpeed, neighbours, neighbourVels, numNeighbours, maxTime, separation);
+		}
+	}
+
+	printf("%s Velocity Search (%d agents, %d neighbours)\n", name, numAgents, numNeighbours);
+	printf(" - Grid: %.3f ms, %.1f evaluations, mean cost %.4f\n", gridTime * 1000.0, (float)gridEvals / (float)numAgents, gridCost / numAgents);
+	for (int b = 0; b < numBudgets; b++)
+		printf(" - Adaptive (max %d): %.3f ms, %.1f evaluations, mean cost %.4f\n", budgets[b], searchTime[b] * 1000.0,
+			   (float)searchEvals[b] / (float)numAgents, searchCost[b] / numAgents);
+}
+
+
+// Latency of batches of CPA and distance queries, the tail shows up in the percentiles.
+void benchQueryLatency(const char* name, TestPair* pairs, const int numPairs)
+{
+	static const int batchSize = 50;
+	static const int numPasses = 500;
+	static Histogram hist;
+	resetHistogram(hist);
+
+	for (int pass = 0; pass < numPasses; pass++)
+	{
+		for (int i = 0; i + batchSize <= numPairs; i += batchSize)
+		{
+			const double t0 = glfwGetTime();
+			testPairsCPA(&pairs[i], batchSize);
+			const double t1 = glfwGetTime();
+			recordHistogram(hist, (uint64_t)((t1 - t0) * 1e9));
+		}
+	}
+
+	printf("%s Query Latency (%d pairs per batch)\n", name, batchSize);
+	printHistogram(hist, "Batch", "us", 1000.0);
+}
+
+
+void benchWorkload(const WorkloadParams& params)
+{
+	static const int numPairs = 1000;
+	static TestPair pairs[numPairs];
+	static PreparedPair preparedPairs[numPairs];
+
+	const int numFailed = generateWorkload(params, pairs, numPairs);
+	printWorkloadParams(params, pairs, numPairs, numFailed);
+
+	double t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPA(pairs, numPairs);
+	double t1 = glfwGetTime();
+	printf(" - %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+
+	preparePairs(pairs, preparedPairs, numPairs);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPAPrepared(preparedPairs, numPairs);
+	t1 = glfwGetTime();
+	printf(" - Prepared: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPACute(pairs, numPairs);
+	t1 = glfwGetTime();
+	printf(" - Cute: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+
+	benchQueryLatency(params.name, pairs, numPairs);
+}
+
+
+// A/B comparison of two kernel variants. Runs of A and B are interleaved in random order, so that
+// frequency changes and noisy neighbours hit both alike, and the speedup B over A is reported with
+// a bootstrap confidence interval of the ratio of the medians.
+typedef void (*AbKernel)(void* data);
+
+struct AbResult
+{
+	const char* name;
+	const char* nameA;
+	const char* nameB;
+	int numSamples;
+	double medianA;
+	double medianB;
+	double speedup;
+	double speedupLow;
+	double speedupHigh;
+};
+
+static const int MaxAbSamples = 512;
+static const int AbResamples = 2000;
+
+static int compareDouble(const void* a, const void* b)
+{
+	const double da = *(const double*)a;
+	const double db = *(const double*)b;
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+static double sortedMedian(double* vals, const int num)
+{
+	qsort(vals, num, sizeof(double), compareDouble);
+	return (num & 1) ? vals[num/2] : (vals[num/2 - 1] + vals[num/2]) * 0.5;
+}
+
+AbResult benchAB(const char* name, const char* nameA, AbKernel kernelA, void* dataA,
+				 const char* nameB, AbKernel kernelB, void* dataB, const int numSamples, const int runsPerSample)
+{
+	static double samplesA[MaxAbSamples];
+	static double samplesB[MaxAbSamples];
+	static double resampled[MaxAbSamples];
+	static double ratios[AbResamples];
+
+	AbResult res;
+	res.name = name;
+	res.nameA = nameA;
+	res.nameB = nameB;
+	res.numSamples = mini(numSamples, MaxAbSamples);
+
+	// Own stream, so that the comparison does not change the test data generated after it.
+	Rng rng;
+	seedRng(rng, 0xab);
+
+	for (int i = 0; i < runsPerSample; i++)
+	{
+		kernelA(dataA);
+		kernelB(dataB);
+	}
+
+	for (int i = 0; i < res.numSamples; i++)
+	{
+		const bool aFirst = rngInt(rng, 2) == 0;
+		for (int j = 0; j < 2; j++)
+		{
+			const bool runA = (j == 0) == aFirst;
+			const double t0 = glfwGetTime();
+			for (int k = 0; k < runsPerSample; k++)
+			{
+				if (runA)
+					kernelA(dataA);
+				else
+					kernelB(dataB);
+			}
+			const double t1 = glfwGetTime();
+			(runA ? samplesA : samplesB)[i] = (t1 - t0) * 1e6 / runsPerSample;
+		}
+	}
+
+	const int n = res.numSamples;
+	for (int r = 0; r < AbResamples; r++)
+	{
+		for (int i = 0; i < n; i++)
+			resampled[i] = samplesA[rngInt(rng, n)];
+		const double medA = sortedMedian(resampled, n);
+		for (int i = 0; i < n; i++)
+			resampled[i] = samplesB[rngInt(rng, n)];
+		const double medB = sortedMedian(resampled, n);
+		ratios[r] = medB > 0.0 ? medA / medB : 0.0;
+	}
+	qsort(ratios, AbResamples, sizeof(double), compareDouble);
+
+	res.medianA = sortedMedian(samplesA, n);
+	res.medianB = sortedMedian(samplesB, n);
+	res.speedup = res.medianB > 0.0 ? res.medianA / res.medianB : 0.0;
+	res.speedupLow = ratios[(int)(AbResamples * 0.025)];
+	res.speedupHigh = ratios[(int)(AbResamples * 0.975)];
+
+	const bool significant = res.speedupLow > 1.0 || res.speedupHigh < 1.0;
+	printf("%s A/B (%d samples)\n", name, n);
+	printf(" - A %s: %.3f us, B %s: %.3f us\n", nameA, res.medianA, nameB, res.medianB);
+	printf(" - Speedup B/A: %.3fx, 95%% CI [%.3fx, %.3fx]%s\n", res.speedup, res.speedupLow, res.speedupHigh,
+		   significant ? "" : ", not significant");
+	return res;
+}
+
+// One result per line, so that readAbBaseline() can scan the file without a JSON parser.
+bool writeAbResults(const char* path, const AbResult* results, const int numResults)
+{
+	FILE* fp = fopen(path, "w");
+	if (!fp)
+		return false;
+	fprintf(fp, "{\n\"results\": [\n");
+	for (int i = 0; i < numResults; i++)
+	{
+		const AbResult& r = results[i];
+		fprintf(fp, "{\"name\": \"%s\", \"a\": \"%s\", \"b\": \"%s\", \"samples\": %d, \"median_a_us\": %.4f, \"median_b_us\": %.4f, "
+				"\"speedup\": %.4f, \"ci_low\": %.4f, \"ci_high\": %.4f}%s\n",
+				r.name, r.nameA, r.nameB, r.numSamples, r.medianA, r.medianB, r.speedup, r.speedupLow, r.speedupHigh,
+				i + 1 < numResults ? "," : "");
+	}
+	fprintf(fp, "]\n}\n");
+	fclose(fp);
+	return true;
+}
+
+// Compares the results against a file written earlier by writeAbResults(). A change is flagged when
+// the baseline speedup falls outside the confidence interval of the current run.
+void compareAbBaseline(const char* path, const AbResult* results, const int numResults)
+{
+	FILE* fp = fopen(path, "r");
+	if (!fp)
+		return;
+	printf("A/B against baseline %s\n", path);
+	char line[512];
+	while (fgets(line, sizeof(line), fp))
+	{
+		char name[128];
+		double medianA, medianB, speedup;
+		if (sscanf(line, "{\"name\": \"%127[^\"]\", %*[^,], %*[^,], %*[^,], \"median_a_us\": %lf, \"median_b_us\": %lf, \"speedup\": %lf",
+				   name, &medianA, &medianB, &speedup) != 4)
+			continue;
+		for (int i = 0; i < numResults; i++)
+		{
+			const AbResult& r = results[i];
+			if (strcmp(r.name, name) != 0)
+				continue;
+			const bool changed = speedup < r.speedupLow || speedup > r.speedupHigh;
+			printf(" - %s: speedup %.3fx, baseline %.3fx, B %.3f us, baseline %.3f us%s\n", name, r.speedup, speedup,
+				   r.medianB, medianB, changed ? ", changed" : "");
+		}
+	}
+	fclose(fp);
+}
+
+struct AbChainData
+{
+	const ChainPair* chains;
+	int numChains;
+};
+
+void abChainGeneric(void* data)
+{
+	const AbChainData& d = *(const AbChainData*)data;
+	Vec2 sum[5];
+	uint8_t sumColIdx[5];
+	uint8_t sumSegIdx[5];
+	float acc = 0.0f;
+	for (int i = 0; i < d.numChains; i++)
+	{
+		const ChainPair& c = d.chains[i];
+		const int n = minkowskiChain(c.chainA, c.numA, c.chainB, c.numB, sum, sumColIdx, sumSegIdx, 5);
+		acc += sum[n-1].x;
+	}
+	benchSink = acc;
+}
+
+void abChainFixed(void* data)
+{
+	const AbChainData& d = *(const AbChainData*)data;
+	Vec2 sum[5];
+	uint8_t sumColIdx[5];
+	uint8_t sumSegIdx[5];
+	float acc = 0.0f;
+	for (int i = 0; i < d.numChains; i++)
+	{
+		const ChainPair& c = d.chains[i];
+		const int n = minkowskiChainFixed(c.chainA, c.numA, c.chainB, c.numB, sum, sumColIdx, sumSegIdx);
+		acc += sum[n-1].x;
+	}
+	benchSink = acc;
+}
+
+struct AbPairData
+{
+	TestPair* pairs;
+	PreparedPair* preparedPairs;
+	int numPairs;
+};
+
+void abPairsCPA(void* data)
+{
+	const AbPairData& d = *(const AbPairData*)data;
+	testPairsCPA(d.pairs, d.numPairs);
+}
+
+void abPairsCPAPrepared(void* data)
+{
+	const AbPairData& d = *(const AbPairData*)data;
+	testPairsCPAPrepared(d.preparedPairs, d.numPairs);
+}
+
+// The pairs moved over numTicks ticks, each run queries the next tick, so that the warm start sees
+// the same coherence as in benchWarmStart().
+struct AbWarmData
+{
+	PreparedPair* ticks;
+	int numPairs;
+	int numTicks;
+	int tick;
+	ContactCache* cache;
+};
+
+void abWarmCold(void* data)
+{
+	AbWarmData& d = *(AbWarmData*)data;
+	testPairsCPAPrepared(&d.ticks[d.tick * d.numPairs], d.numPairs);
+	d.tick = (d.tick + 1) % d.numTicks;
+}
+
+void abWarmCached(void* data)
+{
+	AbWarmData& d = *(AbWarmData*)data;
+	testPairsCPAWarm(&d.ticks[d.tick * d.numPairs], d.numPairs, *d.cache);
+	d.tick = (d.tick + 1) % d.numTicks;
+}
+
+void runABTests(TestPair* rectPairs, TestPair* mixedPairs, const int numPairs, const char* resultPath, const char* baselinePath)
+{
+	static const int maxChainPairs = 1000;
+	static ChainPair chains[maxChainPairs];
+	static PreparedPair preparedPairs[maxChainPairs];
+	static const int numWarmTicks = 30;
+	static const int numResults = 3;
+	AbResult results[numResults];
+
+	AbChainData chainData;
+	chainData.chains = chains;
+	chainData.numChains = makeChainPairs(rectPairs, numPairs, chains, maxChainPairs);
+	results[0] = benchAB("Rect-Rect Chain", "Generic", abChainGeneric, &chainData, "Fixed", abChainFixed, &chainData, 200, 10);
+
+	AbPairData pairData;
+	pairData.pairs = mixedPairs;
+	pairData.preparedPairs = preparedPairs;
+	pairData.numPairs = mini(numPairs, maxChainPairs);
+	preparePairs(mixedPairs, preparedPairs, pairData.numPairs);
+	results[1] = benchAB("Mixed CPA", "Collider", abPairsCPA, &pairData, "Prepared", abPairsCPAPrepared, &pairData, 200, 2);
+
+	const int numWarmPairs = mini(numPairs, maxChainPairs);
+	TestPair* movingPairs = new TestPair[numWarmPairs];
+	PreparedPair* warmTicks = new PreparedPair[numWarmTicks * numWarmPairs];
+	memcpy(movingPairs, mixedPairs, sizeof(TestPair) * numWarmPairs);
+	for (int tick = 0; tick < numWarmTicks; tick++)
+	{
+		preparePairs(movingPairs, &warmTicks[tick * numWarmPairs], numWarmPairs);
+		movePairs(movingPairs, numWarmPairs, 1.0f / 30.0f);
+	}
+	ContactCache cache(numWarmPairs * 2);
+	AbWarmData coldData = { warmTicks, numWarmPairs, numWarmTicks, 0, nullptr };
+	AbWarmData warmData = { warmTicks, numWarmPairs, numWarmTicks, 0, &cache };
+	results[2] = benchAB("Mixed Warm Start", "Cold", abWarmCold, &coldData, "Warm", abWarmCached, &warmData, 300, 1);
+	delete [] warmTicks;
+	delete [] movingPairs;
+
+	if (resultPath && writeAbResults(resultPath, results, numResults))
+		printf("Wrote A/B results to %s\n", resultPath);
+	if (baselinePath)
+		compareAbBaseline(baselinePath, results, numResults);
+}
+
+
+// Searches for inputs where the queries are slow or produce non-finite results. Pairs from the corpus
+// are mutated towards the known trouble spots: no relative motion, nearly parallel segments, degenerate
+// segments, tiny radii that make denormals, and far away positions. The corpus keeps the slowest cases,
+// non-finite ones first.
+static const int FuzzCorpusSize = 16;
+
+struct FuzzCase
+{
+	TestPair pair;
+	uint64_t ticks;
+	bool nonFinite;
+};
+
+static bool fuzzNonFinite(const TestPair& p)
+{
+	const ApproachRes cpa = closestPointOfApproach(p.colA, p.velA, p.colB, p.velB, WorkloadMaxTime);
+	const DistanceRes nd = nearestDistance(p.colA, p.velA * cpa.t, p.colB, p.velB * cpa.t);
+	return !isfinite(cpa.t) || !isfinite(nd.dist) || !isfinite(nd.norm.x) || !isfinite(nd.norm.y);
+}
+
+// Fastest of a few runs of the query in trace ticks, the minimum filters out interrupts.
+static uint64_t fuzzTicks(const TestPair& p)
+{
+	static const int numRuns = 8;
+	uint64_t best = UINT64_MAX;
+	float acc = 0.0f;
+	for (int i = 0; i < numRuns; i++)
+	{
+		const uint64_t t0 = traceNow();
+		const ApproachRes cpa = closestPointOfApproach(p.colA, p.velA, p.colB, p.velB, WorkloadMaxTime);
+		const DistanceRes nd = nearestDistance(p.colA, p.velA * cpa.t, p.colB, p.velB * cpa.t);
+		const uint64_t t1 = traceNow();
+		acc += nd.dist;
+		best = t1 - t0 < best ? t1 - t0 : best;
+	}
+	benchSink = acc;
+	return best;
+}
+
+static float fuzzTiny(Rng& rng, const int minExp, const int maxExp)
+{
+	return powf(10.0f, -(float)(minExp + rngInt(rng, maxExp - minExp + 1)));
+}
+
+TestPair mutateFuzzPair(const TestPair& src, Rng& rng)
+{
+	TestPair p = src;
+	Collider& col = rngInt(rng, 2) == 0 ? p.colA : p.colB;
+	const Vec2 relVel = p.velA - p.velB;
+	switch (rngInt(rng, 9))
+	{
+	case 0:	// No relative motion.
+		p.velA = p.velB;
+		break;
+	case 1:	// Nearly no relative motion.
+		p.velA = p.velB + relVel * fuzzTiny(rng, 3, 20);
+		break;
+	case 2:	// Tiny radius, down to the denormal range.
+		col.rad = fuzzTiny(rng, 20, 40);
+		break;
+	case 3:	// Shape axis nearly parallel to the relative velocity.
+		if (lenSq(relVel) > 0.0f)
+			col.up = norm(norm(relVel) + left(norm(relVel)) * fuzzTiny(rng, 3, 9));
+		break;
+	case 4:	// Degenerate segment.
+		col.ext.y = fuzzTiny(rng, 6, 40);
+		if (rngInt(rng, 2) == 0)
+			col.ext.x = col.ext.y;
+		break;
+	case 5:	// Far from the origin.
+		{
+			const Vec2 offset = Vec2(1, 1) * powf(10.0f, (float)(1 + rngInt(rng, 5)));
+			p.colA.pos += offset;
+			p.colB.pos += offset;
+		}
+		break;
+	case 6:	// Nearly coincident.
+		p.colB.pos = p.colA.pos + randomDir(rng) * fuzzTiny(rng, 3, 30);
+		break;
+	case 7:	// Small jitter.
+		col.pos += Vec2(rngRange(rng, -0.1f, 0.1f), rngRange(rng, -0.1f, 0.1f));
+		p.velA += Vec2(rngRange(rng, -0.1f, 0.1f), rngRange(rng, -0.1f, 0.1f));
+		break;
+	default:	// Fresh pair.
+		p.colA = randomCollider(rng);
+		p.colB = randomCollider(rng);
+		p.velA = randomDir(rng) * rngRange(rng, 0.1f, 2.5f);
+		p.velB = randomDir(rng) * rngRange(rng, 0.1f, 2.5f);
+		break;
+	}
+	return p;
+}
+
+static bool fuzzWorse(const FuzzCase& a, const FuzzCase& b)
+{
+	if (a.nonFinite != b.nonFinite)
+		return a.nonFinite;
+	return a.ticks > b.ticks;
+}
+
+// Keeps the corpus sorted, worst first. Returns true if the case was added.
+static bool addFuzzCase(FuzzCase* corpus, int& numCorpus, const FuzzCase& fc)
+{
+	if (numCorpus == FuzzCorpusSize && !fuzzWorse(fc, corpus[numCorpus-1]))
+		return false;
+	int i = mini(numCorpus, FuzzCorpusSize-1);
+	for (; i > 0 && fuzzWorse(fc, corpus[i-1]); i--)
+		corpus[i] = corpus[i-1];
+	corpus[i] = fc;
+	numCorpus = mini(numCorpus+1, FuzzCorpusSize);
+	return true;
+}
+
+// One case per line: ticks, non-finite flag, colliders A and B and velocities A and B, as in the accuracy corpus.
+bool writeFuzzCorpus(const char* path, const FuzzCase* corpus, const int numCorpus)
+{
+	FILE* fp = fopen(path, "w");
+	if (!fp)
+		return false;
+	for (int i = 0; i < numCorpus; i++)
+	{
+		const TestPair& p = corpus[i].pair;
+		fprintf(fp, "%llu %d", (unsigned long long)corpus[i].ticks, corpus[i].nonFinite ? 1 : 0);
+		writeAccuracyCollider(fp, p.colA);
+		writeAccuracyCollider(fp, p.colB);
+		fprintf(fp, " %.9g %.9g %.9g %.9g\n", p.velA.x, p.velA.y, p.velB.x, p.velB.y);
+	}
+	return fclose(fp) == 0;
+}
+
+void runFuzzer(const int numIterations, const char* corpusPath)
+{
+	static const int numBaseline = 2000;
+	static FuzzCase corpus[FuzzCorpusSize];
+	static Histogram hist;
+	int numCorpus = 0;
+
+	// Everything is drawn from an own stream, so that the fuzzer does not change the test data generated after it.
+	Rng rng;
+	seedRng(rng, 47);
+
+	resetHistogram(hist);
+	for (int i = 0; i < numBaseline; i++)
+	{
+		FuzzCase fc;
+		fc.pair.colA = randomCollider(rng);
+		fc.pair.colB = randomCollider(rng);
+		fc.pair.velA = randomDir(rng) * rngRange(rng, 0.1f, 2.5f);
+		fc.pair.velB = randomDir(rng) * rngRange(rng, 0.1f, 2.5f);
+		fc.ticks = fuzzTicks(fc.pair);
+		fc.nonFinite = fuzzNonFinite(fc.pair);
+		recordHistogram(hist, fc.ticks);
+		addFuzzCase(corpus, numCorpus, fc);
+	}
+	const uint64_t median = histogramPercentile(hist, 50.0);
+
+	int numNonFinite = 0;
+	for (int i = 0; i < numIterations; i++)
+	{
+		FuzzCase fc;
+		fc.pair = corpus[rngInt(rng, numCorpus)].pair;
+		const int numMutations = 1 + rngInt(rng, 3);
+		for (int j = 0; j < numMutations; j++)
+			fc.pair = mutateFuzzPair(fc.pair, rng);
+		fc.ticks = fuzzTicks(fc.pair);
+		fc.nonFinite = fuzzNonFinite(fc.pair);
+		numNonFinite += fc.nonFinite ? 1 : 0;
+		addFuzzCase(corpus, numCorpus, fc);
+	}
+
+	printf("Fuzzer (%d iterations)\n", numIterations);
+	printf(" - median %llu ticks, worst %llu ticks (%.1fx), %d non-finite results\n", (unsigned long long)median,
+		   (unsigned long long)corpus[0].ticks, median > 0 ? (double)corpus[0].ticks / median : 0.0, numNonFinite);
+
+	// The worst cases again with denormals flushed, to tell the denormal stalls from slow paths.
+	{
+		ScopedFlushDenormals ftz;
+		uint64_t worst = 0;
+		for (int i = 0; i < numCorpus; i++)
+		{
+			const uint64_t ticks = fuzzTicks(corpus[i].pair);
+			worst = ticks > worst ? ticks : worst;
+		}
+		printf(" - worst of the corpus with denormals flushed %llu ticks (%.1fx)\n", (unsigned long long)worst,
+			   median > 0 ? (double)worst / median : 0.0);
+	}
+
+	if (corpusPath && writeFuzzCorpus(corpusPath, corpus, numCorpus))
+		printf(" - %d worst cases written to %s\n", numCorpus, corpusPath);
+}
+
+
+void benchRng()
+{
+	static const int num = 1 << 20;
+	static const int numPasses = 10;
+	static Vec2 dirs[num];
+	static float vals[num];
+	RngBatch batch;
+	seedRngBatch(batch, 0);
+
+	double t0 = glfwGetTime();
+	for (int pass = 0; pass < numPasses; pass++)
+		for (int i = 0; i < num; i++)
+			vals[i] = randf(0.1f, 2.5f);
+	double t1 = glfwGetTime();
+	printf("Random Numbers (%d)\n", num);
+	printf(" - Floats: %.3f ms\n", (t1-t0) * 1000.0 / numPasses);
+
+	t0 = glfwGetTime();
+	for (int pass = 0; pass < numPasses; pass++)
+		rngFillFloats(batch, vals, num, 0.1f, 2.5f);
+	t1 = glfwGetTime();
+	printf(" - Floats, batch: %.3f ms\n", (t1-t0) * 1000.0 / numPasses);
+
+	t0 = glfwGetTime();
+	for (int pass = 0; pass < numPasses; pass++)
+		for (int i = 0; i < num; i++)
+			dirs[i] = randomDir();
+	t1 = glfwGetTime();
+	printf(" - Dirs: %.3f ms\n", (t1-t0) * 1000.0 / numPasses);
+
+	t0 = glfwGetTime();
+	for (int pass = 0; pass < numPasses; pass++)
+		rngFillDirs(batch, dirs, num);
+	t1 = glfwGetTime();
+	float maxErr = 0.0f;
+	for (int i = 0; i < num; i++)
+		maxErr = maxf(maxErr, fabsf(len(dirs[i]) - 1.0f));
+	printf(" - Dirs, batch: %.3f ms (max length error %g)\n", (t1-t0) * 1000.0 / numPasses, maxErr);
+}
+
+
+void benchCpaContour(const char* name, const TestPair* pairs, const int numPairs)
+{
+	static const int numSamples = 400;
+	static const int maxPieces = 64;
+	const float maxTime = 3.0f;
+
+	ContourPiece pieces[maxPieces];
+	double sampleTime = 0.0;
+	double contourTime = 0.0;
+	int totalPieces = 0;
+	double t0, t1;
+
+	for (int i = 0; i < numPairs; i++)
+	{
+		const TestPair& p = pairs[i];
+		const float speed = len(p.velA);
+
+		t0 = glfwGetTime();
+		for (int k = 0; k < numSamples; k++)
+		{
+			const float a = (float)k / (float)numSamples * M_PI * 2.0f;
+			const ApproachRes cpa = closestPointOfApproach(p.colA, Vec2(cosf(a), sinf(a)) * speed, p.colB, p.velB, maxTime);
+			benchSink += cpa.t;
+		}
+		t1 = glfwGetTime();
+		sampleTime += t1 - t0;
+
+		t0 = glfwGetTime();
+		totalPieces += cpaContour(p.colA, p.colB, p.velB, speed, maxTime, pieces, maxPieces);
+		t1 = glfwGetTime();
+		contourTime += t1 - t0;
+	}
+
+	printf("%s CPA Contour (%d pairs)\n", name, numPairs);
+	printf(" - Sampled (%d headings): %.3f ms\n", numSamples, sampleTime * 1000.0);
+	printf(" - Contour: %.3f ms (%.1f pieces)\n", contourTime * 1000.0, (float)totalPieces / (float)numPairs);
+}
+
+
+struct CrowdAgent
+{
+	Collider col;
+	Vec2 vel;
+	Vec2 goal;
+};
+
+// Agents on a circle, each heading to the opposite side.
+void initCrowd(CrowdAgent* agents, const int numAgents, const float radius)
+{
+	for (int i = 0; i < numAgents; i++)
+	{
+		const float a = (float)i / (float)numAgents * M_PI * 2.0f;
+		const Vec2 pos = Vec2(cosf(a), sinf(a)) * radius;
+		const Vec2 dir = norm(-pos);
+		const int type = i % 3;
+		CrowdAgent& ag = agents[i];
+		if (type == 0)
+			ag.col = Collider::MakeCircle(pos, 0.4f);
+		else if (type == 1)
+			ag.col = Collider::MakePill(pos, dir, 0.3f, 0.25f);
+		else
+			ag.col = Collider::MakeRect(pos, dir, 0.3f, 0.4f, 0.1f);
+		ag.vel = Vec2(0,0);
+		ag.goal = -pos;
+	}
+}
+
+void crowdPreferredVelocities(const CrowdAgent* agents, const int numAgents, const float maxSpeed, Rng& rng, Vec2* prefVels)
+{
+	for (int i = 0; i < numAgents; i++)
+	{
+		// Perturb a little to avoid deadlocks due to perfect symmetry.
+		prefVels[i] = clamp(agents[i].goal - agents[i].col.pos, maxSpeed) + randomDir(rng) * 0.01f;
+	}
+}
+
+// Brute force neighbour lists in compressed rows, as expected by orcaVelocities().
+// Keeps the MaxOrcaNeighbours nearest agents within range.
+int crowdNeighbours(const CrowdAgent* agents, const int numAgents, const float range, int* neighbourStart, int* neighbourIds)
+{
+	int num = 0;
+	float distances[MaxOrcaNeighbours];
+	for (int i = 0; i < numAgents; i++)
+	{
+		neighbourStart[i] = num;
+		int* ids = &neighbourIds[num];
+		int numIds = 0;
+		for (int j = 0; j < numAgents; j++)
+		{
+			const float d = distSq(agents[i].col.pos, agents[j].col.pos);
+			if (i == j || d >= sqrf(range))
+				continue;
+			if (numIds == MaxOrcaNeighbours && d >= distances[numIds-1])
+				continue;
+			// Insertion sort by distance.
+			int k = mini(numIds, MaxOrcaNeighbours-1);
+			for (; k > 0 && distances[k-1] > d; k--)
+			{
+				distances[k] = distances[k-1];
+				ids[k] = ids[k-1];
+			}
+			distances[k] = d;
+			ids[k] = j;
+			numIds = mini(numIds+1, MaxOrcaNeighbours);
+		}
+		num += numIds;
+	}
+	neighbourStart[numAgents] = num;
+	return num;
+}
+
+void moveCrowd(CrowdAgent* agents, const int numAgents, const Vec2* vels, const float dt)
+{
+	for (int i = 0; i < numAgents; i++)
+	{
+		CrowdAgent& ag = agents[i];
+		ag.vel = vels[i];
+		ag.col.pos += ag.vel * dt;
+		if (lenSq(ag.vel) > 0.01f)
+			ag.col.up = norm(ag.vel);
+	}
+}
+
+int countCrowdOverlaps(const CrowdAgent* agents, const int numAgents)
+{
+	int num = 0;
+	for (int i = 0; i < numAgents; i++)
+		for (int j = i+1; j < numAgents; j++)
+			if (nearestDistance(agents[i].col, Vec2(0,0), agents[j].col, Vec2(0,0)).dist < -0.01f)
+				num++;
+	return num;
+}
+
+// Number of runs of each crowd benchmark. A jammed crowd is chaotic, the overlaps of a single run change by tens of
+// percent with the perturbation of the preferred velocities, so the runs are summed. Run r is seeded with r in
+// both benchmarks, so that ORCA and anytime see the same perturbations.
+static const int NumCrowdRuns = 4;
+
+// Returns the number of overlapping pairs summed over the ticks and runs, the anytime benchmark compares against it.
+int benchOrca(const int numAgents)
+{
+	static const int maxAgents = 256;
+	CrowdAgent agents[maxAgents];
+	PreparedCollider prepared[maxAgents];
+	Vec2 vels[maxAgents];
+	Vec2 prefVels[maxAgents];
+	Vec2 newVels[maxAgents];
+	int neighbourStart[maxAgents+1];
+	int neighbourIds[maxAgents * MaxOrcaNeighbours];
+
+	const int num = mini(numAgents, maxAgents);
+	const float maxSpeed = 2.0f;
+	const float timeHorizon = 2.0f;
+	const float dt = 1.0f / 20.0f;
+	const int numTicks = 600;
+
+	static Histogram tickHist;
+	resetHistogram(tickHist);
+
+	double orcaTime = 0.0;
+	int numOverlaps = 0;
+	int numNeighbourTotal = 0;
+	float goalDist = 0.0f;
+	double t0, t1;
+
+	for (int run = 0; run < NumCrowdRuns; run++)
+	{
+		Rng rng;
+		seedRng(rng, run);
+		initCrowd(agents, num, maxf(8.0f, num * 1.1f / (M_PI * 2.0f)));
+
+		for (int tick = 0; tick < numTicks; tick++)
+		{
+			crowdPreferredVelocities(agents, num, maxSpeed, rng, prefVels);
+			numNeighbourTotal += crowdNeighbours(agents, num, 4.0f, neighbourStart, neighbourIds);
+			for (int i = 0; i < num; i++)
+			{
+				prepared[i] = prepareCollider(agents[i].col, agents[i].vel, timeHorizon);
+				vels[i] = agents[i].vel;
+			}
+
+			t0 = glfwGetTime();
+			orcaVelocities(prepared, vels, prefVels, num, neighbourStart, neighbourIds, maxSpeed, timeHorizon, dt, newVels);
+			t1 = glfwGetTime();
+			orcaTime += t1 - t0;
+			recordHistogram(tickHist, (uint64_t)((t1 - t0) * 1e9));
+
+			moveCrowd(agents, num, newVels, dt);
+			numOverlaps += countCrowdOverlaps(agents, num);
+		}
+
+		for (int i = 0; i < num; i++)
+			goalDist += dist(agents[i].col.pos, agents[i].goal);
+	}
+
+	const int numRunTicks = numTicks * NumCrowdRuns;
+	printf("ORCA Crowd (%d agents, %d ticks, %d runs)\n", num, numTicks, NumCrowdRuns);
+	printf(" - %.3f ms per tick, %.1f neighbours per agent\n", orcaTime * 1000.0 / numRunTicks, (float)numNeighbourTotal / (float)(num * numRunTicks));
+	printf(" - overlapping pairs %d, mean distance to goal %.2f\n", numOverlaps, goalDist / (num * NumCrowdRuns));
+	printHistogram(tickHist, "Tick", "ms", 1e6);
+
+	return numOverlaps;
+}
+
+
+// Reports the overlaps against orcaOverlaps from benchOrca() on the same crowd.
+void benchAnytime(const int numAgents, const int budget, const int orcaOverlaps)
+{
+	static const int maxAgents = 256;
+	CrowdAgent agents[maxAgents];
+	PreparedCollider prepared[maxAgents];
+	Vec2 vels[maxAgents];
+	Vec2 prefVels[maxAgents];
+	Vec2 newVels[maxAgents];
+	AgentRisk risks[maxAgents*2];
+	int neighbourStart[maxAgents+1];
+	int neighbourIds[maxAgents * MaxOrcaNeighbours];
+
+	const int num = mini(numAgents, maxAgents);
+	const float maxSpeed = 2.0f;
+	const float maxTime = 2.0f;
+	const float separation = 0.5f;
+	const float dt = 1.0f / 20.0f;
+	const int numTicks = 600;
+	// The crowd avoids as well with 24 as with 64, and more than twice as many agents are searched within a budget.
+	const int maxAgentEvaluations = 24;
+
+	static Histogram tickHist;
+	resetHistogram(tickHist);
+
+	double totalTime = 0.0;
+	double searchEvaluations = 0.0;
+	int maxSearchEvaluations = 0;
+	int numFallback = 0;
+	int fallbackQueries = 0;
+	int numOverlaps = 0;
+	float goalDist = 0.0f;
+	double t0, t1;
+
+	for (int run = 0; run < NumCrowdRuns; run++)
+	{
+		Rng rng;
+		seedRng(rng, run);
+		initCrowd(agents, num, maxf(8.0f, num * 1.1f / (M_PI * 2.0f)));
+
+		for (int tick = 0; tick < numTicks; tick++)
+		{
+			TRACE_SCOPE("tick");
+			crowdPreferredVelocities(agents, num, maxSpeed, rng, prefVels);
+			crowdNeighbours(agents, num, 4.0f, neighbourStart, neighbourIds);
+			for (int i = 0; i < num; i++)
+			{
+				prepared[i] = prepareCollider(agents[i].col, agents[i].vel, maxTime);
+				vels[i] = agents[i].vel;
+			}
+
+			t0 = glfwGetTime();
+			const AnytimeStats stats = anytimeVelocities(prepared, vels, prefVels, num, neighbourStart, neighbourIds, maxSpeed,
+														 maxTime, separation, dt, budget, maxAgentEvaluations, risks, newVels);
+			t1 = glfwGetTime();
+			totalTime += t1 - t0;
+			recordHistogram(tickHist, (uint64_t)((t1 - t0) * 1e9));
+			searchEvaluations += stats.searchEvaluations;
+			maxSearchEvaluations = maxi(maxSearchEvaluations, stats.searchEvaluations);
+			numFallback += stats.numFallback;
+			fallbackQueries += stats.fallbackQueries;
+
+			moveCrowd(agents, num, newVels, dt);
+			numOverlaps += countCrowdOverlaps(agents, num);
+		}
+
+		for (int i = 0; i < num; i++)
+			goalDist += dist(agents[i].col.pos, agents[i].goal);
+	}
+
+	const int numRunTicks = numTicks * NumCrowdRuns;
+	printf("Anytime Crowd (%d agents, %d ticks, %d runs, budget %d)\n", num, numTicks, NumCrowdRuns, budget);
+	printf(" - %.3f ms per tick\n", totalTime * 1000.0 / numRunTicks);
+	printf(" - budget used %.0f per tick, max %d, %.1f agents fell back to ORCA per tick, %.0f fallback queries\n", searchEvaluations / numRunTicks,
+		   maxSearchEvaluations, (float)numFallback / (float)numRunTicks, (float)fallbackQueries / (float)numRunTicks);
+	printf(" - overlapping pairs %d, %.2fx ORCA, mean distance to goal %.2f\n", numOverlaps, (float)numOverlaps / (float)maxi(1, orcaOverlaps),
+		   goalDist / (num * NumCrowdRuns));
+	printHistogram(tickHist, "Tick", "ms", 1e6);
+}
+
+
+// Thread scaling of a crowd tick built on the queries: grid build, pair finding, narrowphase and steer.
+// Each stage ends in a barrier, so the stage times include load imbalance and synchronization.
+
+static const int MaxScalingThreads = 64;
+static const int ScalingNeighbours = 8;
+static const int ScalingStages = 4;
+static const char* scalingStageNames[ScalingStages] = { "grid", "pairs", "narrowphase", "steer" };
+
+struct ThreadBarrier
+{
+	std::mutex mutex;
+	std::condition_variable cond;
+	int numThreads = 0;
+	int waiting = 0;
+	int generation = 0;
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		const int gen = generation;
+		if (++waiting == numThreads)
+		{
+			waiting = 0;
+			generation++;
+			cond.notify_all();
+			return;
+		}
+		cond.wait(lock, [&] { return gen != generation; });
+	}
+};
+
+struct ScalingCrowd
+{
+	int numAgents;
+	Collider* cols;
+	Vec2* vels;
+	Vec2* goals;
+	Collider* nextCols;
+	Vec2* nextVels;
+	int* neighbours;
+	int* numNeighbours;
+	ApproachRes* threatCpa;
+	DistanceRes* threatDist;
+	// Uniform grid, agents sorted by cell.
+	float cellSize;
+	int gridSize;
+	int* cellStart;
+	int* cellAgents;
+	int* agentCell;
+};
+
+void initScalingCrowd(ScalingCrowd& crowd, const int numAgents)
+{
+	// About 4 units^2 per agent, dense enough for every agent to have a few neighbours.
+	const float side = sqrtf(numAgents * 4.0f);
+	crowd.numAgents = numAgents;
+	crowd.cols = new Collider[numAgents];
+	crowd.vels = new Vec2[numAgents];
+	crowd.goals = new Vec2[numAgents];
+	crowd.nextCols = new Collider[numAgents];
+	crowd.nextVels = new Vec2[numAgents];
+	crowd.neighbours = new int[numAgents * ScalingNeighbours];
+	crowd.numNeighbours = new int[numAgents];
+	crowd.threatCpa = new ApproachRes[numAgents];
+	crowd.threatDist = new DistanceRes[numAgents];
+	crowd.cellSize = 3.0f;
+	crowd.gridSize = (int)ceilf(side / crowd.cellSize) + 1;
+	crowd.cellStart = new int[crowd.gridSize * crowd.gridSize + 1];
+	crowd.cellAgents = new int[numAgents];
+	crowd.agentCell = new int[numAgents];
+
+	Vec2* pos = new Vec2[numAgents];
+	Vec2* dirs = new Vec2[numAgents];
+	RngBatch rng;
+	seedRngBatch(rng, 46);
+	rngFillPositions(rng, pos, numAgents, Vec2(0, 0), Vec2(side, side));
+	rngFillPositions(rng, crowd.goals, numAgents, Vec2(0, 0), Vec2(side, side));
+	rngFillDirs(rng, dirs, numAgents);
+	for (int i = 0; i < numAgents; i++)
+	{
+		const int type = i % 3;
+		if (type == 0)
+			crowd.cols[i] = Collider::MakeCircle(pos[i], 0.4f);
+		else if (type == 1)
+			crowd.cols[i] = Collider::MakePill(pos[i], dirs[i], 0.3f, 0.25f);
+		else
+			crowd.cols[i] = Collider::MakeRect(pos[i], dirs[i], 0.3f, 0.4f, 0.1f);
+		crowd.vels[i] = dirs[i];
+	}
+	delete [] pos;
+	delete [] dirs;
+}
+
+void freeScalingCrowd(ScalingCrowd& crowd)
+{
+	delete [] crowd.cols;
+	delete [] crowd.vels;
+	delete [] crowd.goals;
+	delete [] crowd.nextCols;
+	delete [] crowd.nextVels;
+	delete [] crowd.neighbours;
+	delete [] crowd.numNeighbours;
+	delete [] crowd.threatCpa;
+	delete [] crowd.threatDist;
+	delete [] crowd.cellStart;
+	delete [] crowd.cellAgents;
+	delete [] crowd.agentCell;
+}
+
+static int scalingCell(const ScalingCrowd& crowd, const int x, const int y)
+{
+	return mini(maxi(y, 0), crowd.gridSize - 1) * crowd.gridSize + mini(maxi(x, 0), crowd.gridSize - 1);
+}
+
+// Counting sort of the agents into the grid. Serial, it is part of what limits the scaling.
+void buildScalingGrid(ScalingCrowd& crowd)
+{
+	const int numCells = crowd.gridSize * crowd.gridSize;
+	memset(crowd.cellStart, 0, sizeof(int) * (numCells + 1));
+	for (int i = 0; i < crowd.numAgents; i++)
+	{
+		const Vec2 p = crowd.cols[i].pos;
+		const int cell = scalingCell(crowd, (int)floorf(p.x / crowd.cellSize), (int)floorf(p.y / crowd.cellSize));
+		crowd.agentCell[i] = cell;
+		crowd.cellStart[cell + 1]++;
+	}
+	for (int i = 0; i < numCells; i++)
+		crowd.cellStart[i + 1] += crowd.cellStart[i];
+	for (int i = 0; i < crowd.numAgents; i++)
+		crowd.cellAgents[crowd.cellStart[crowd.agentCell[i]]++] = i;
+	// The fill advanced each start to the next cell, shift back.
+	for (int i = numCells; i > 0; i--)
+		crowd.cellStart[i] = crowd.cellStart[i - 1];
+	crowd.cellStart[0] = 0;
+}
+
+// Keeps the ScalingNeighbours nearest agents within a cell.
+void findScalingNeighbours(ScalingCrowd& crowd, const int start, const int end)
+{
+	const float rangeSq = sqrf(crowd.cellSize);
+	for (int i = start; i < end; i++)
+	{
+		const Vec2 p = crowd.cols[i].pos;
+		const int cx = (int)floorf(p.x / crowd.cellSize);
+		const int cy = (int)floorf(p.y / crowd.cellSize);
+		int* ids = &crowd.neighbours[i * ScalingNeighbours];
+		float distances[ScalingNeighbours];
+		int numIds = 0;
+		for (int y = cy - 1; y <= cy + 1; y++)
+		{
+			if (y < 0 || y >= crowd.gridSize)
+				continue;
+			for (int x = cx - 1; x <= cx + 1; x++)
+			{
+				if (x < 0 || x >= crowd.gridSize)
+					continue;
+				const int cell = y * crowd.gridSize + x;
+				for (int k = crowd.cellStart[cell]; k < crowd.cellStart[cell + 1]; k++)
+				{
+					const int j = crowd.cellAgents[k];
+					const float d = distSq(p, crowd.cols[j].pos);
+					if (i == j || d >= rangeSq)
+						continue;
+					if (numIds == ScalingNeighbours && d >= distances[numIds-1])
+						continue;
+					int n = mini(numIds, ScalingNeighbours-1);
+					for (; n > 0 && distances[n-1] > d; n--)
+					{
+						distances[n] = distances[n-1];
+						ids[n] = ids[n-1];
+					}
+					distances[n] = d;
+					ids[n] = j;
+					numIds = mini(numIds+1, ScalingNeighbours);
+				}
+			}
+		}
+		crowd.numNeighbours[i] = numIds;
+	}
+}
+
+// CPA and distance against each neighbour, keeps the closest approach as the threat to steer from.
+// The time spent on each agent is recorded into hist.
+void scalingNarrowphase(ScalingCrowd& crowd, const int start, const int end, Histogram& hist)
+{
+	for (int i = start; i < end; i++)
+	{
+		const double t0 = glfwGetTime();
+		ApproachRes bestCpa;
+		DistanceRes bestDist;
+		bestDist.dist = FLT_MAX;
+		const int* ids = &crowd.neighbours[i * ScalingNeighbours];
+		for (int k = 0; k < crowd.numNeighbours[i]; k++)
+		{
+			const int j = ids[k];
+			const ApproachRes cpa = closestPointOfApproach(crowd.cols[i], crowd.vels[i], crowd.cols[j], crowd.vels[j], 2.5f);
+			const DistanceRes nd = nearestDistance(crowd.cols[i], crowd.vels[i] * cpa.t, crowd.cols[j], crowd.vels[j] * cpa.t);
+			if (nd.dist < bestDist.dist)
+			{
+				bestCpa = cpa;
+				bestDist = nd;
+			}
+		}
+		crowd.threatCpa[i] = bestCpa;
+		crowd.threatDist[i] = bestDist;
+		recordHistogram(hist, (uint64_t)((glfwGetTime() - t0) * 1e9));
+	}
+}
+
+void scalingSteer(ScalingCrowd& crowd, const int start, const int end, const float dt)
+{
+	for (int i = start; i < end; i++)
+	{
+		Collider col = crowd.cols[i];
+		Vec2 vel = crowd.vels[i];
+		DistanceRes nd = crowd.threatDist[i];
+		if (crowd.numNeighbours[i] == 0)
+			nd.dist = FLT_MAX;
+		steer(col, vel, 1.5f, crowd.goals[i], crowd.threatCpa[i], nd, dt);
+		crowd.nextCols[i] = col;
+		crowd.nextVels[i] = clamp(vel, 1.5f);
+	}
+}
+
+struct ScalingTiming
+{
+	double total;
+	double stages[ScalingStages];
+};
+
+// Runs numTicks ticks of the crowd on numThreads threads, returns the mean time per tick.
+// The narrowphase time per agent is recorded per thread, and merged into agentHist at the end.
+ScalingTiming runScalingTicks(ScalingCrowd& crowd, const int numThreads, const int numTicks, Histogram& agentHist)
+{
+	static Histogram threadHists[MaxScalingThreads];
+	ThreadBarrier barrier;
+	barrier.numThreads = numThreads;
+	ScalingTiming timing = {};
+	const float dt = 1.0f / 30.0f;
+
+	auto worker = [&](const int thread)
+	{
+		setTraceThreadName("Scaling");
+		ScopedFlushDenormals ftz;
+		Histogram& hist = threadHists[thread];
+		resetHistogram(hist);
+		const int chunk = (crowd.numAgents + numThreads - 1) / numThreads;
+		const int start = mini(thread * chunk, crowd.numAgents);
+		const int end = mini(start + chunk, crowd.numAgents);
+		for (int tick = 0; tick < numTicks; tick++)
+		{
+			double times[ScalingStages + 1];
+			times[0] = glfwGetTime();
+			if (thread == 0)
+				buildScalingGrid(crowd);
+			barrier.wait();
+			times[1] = glfwGetTime();
+			findScalingNeighbours(crowd, start, end);
+			barrier.wait();
+			times[2] = glfwGetTime();
+			scalingNarrowphase(crowd, start, end, hist);
+			barrier.wait();
+			times[3] = glfwGetTime();
+			scalingSteer(crowd, start, end, dt);
+			barrier.wait();
+			times[4] = glfwGetTime();
+			if (thread == 0)
+			{
+				for (int s = 0; s < ScalingStages; s++)
+					timing.stages[s] += times[s + 1] - times[s];
+				timing.total += times[ScalingStages] - times[0];
+				Collider* cols = crowd.cols;
+				crowd.cols = crowd.nextCols;
+				crowd.nextCols = cols;
+				Vec2* vels = crowd.vels;
+				crowd.vels = crowd.nextVels;
+				crowd.nextVels = vels;
+			}
+			barrier.wait();
+		}
+	};
+
+	std::thread threads[MaxScalingThreads];
+	for (int i = 1; i < numThreads; i++)
+		threads[i] = std::thread(worker, i);
+	worker(0);
+	for (int i = 1; i < numThreads; i++)
+		threads[i].join();
+
+	resetHistogram(agentHist);
+	for (int i = 0; i < numThreads; i++)
+		mergeHistogram(agentHist, threadHists[i]);
+
+	timing.total /= numTicks;
+	for (int s = 0; s < ScalingStages; s++)
+		timing.stages[s] /= numTicks;
+	return timing;
+}
+
+// Pure narrowphase over a fixed pair list, split evenly over the threads.
+double runScalingPairs(TestPair* pairs, const int numPairs, const int numThreads, const int numPasses)
+{
+	const double t0 = glfwGetTime();
+	auto worker = [&](const int thread)
+	{
+		const int chunk = (numPairs + numThreads - 1) / numThreads;
+		const int start = mini(thread * chunk, numPairs);
+		const int end = mini(start + chunk, numPairs);
+		for (int pass = 0; pass < numPasses; pass++)
+			testPairsCPA(&pairs[start], end - start);
+	};
+	std::thread threads[MaxScalingThreads];
+	for (int i = 1; i < numThreads; i++)
+		threads[i] = std::thread(worker, i);
+	worker(0);
+	for (int i = 1; i < numThreads; i++)
+		threads[i].join();
+	return (glfwGetTime() - t0) / numPasses;
+}
+
+void printScalingRow(const int numThreads, const int numAgents, const ScalingTiming& timing, const double speedup)
+{
+	printf(" - %2d threads, %7d agents: %8.3f ms, speedup %5.2fx, efficiency %3.0f%% (", numThreads, numAgents,
+		   timing.total * 1000.0, speedup, speedup / numThreads * 100.0);
+	for (int s = 0; s < ScalingStages; s++)
+		printf("%s%s %.3f", s > 0 ? ", " : "", scalingStageNames[s], timing.stages[s] * 1000.0);
+	printf(" ms)\n");
+}
+
+// Strong scaling keeps the work fixed, weak scaling grows it with the threads, so there the speedup
+// is the work done per unit of time relative to one thread.
+// Thread counts of the scaling runs are powers of two, and then threadLimit if it is not one.
+static int nextScalingThreads(const int n, const int threadLimit)
+{
+	return (n < threadLimit && n * 2 > threadLimit) ? threadLimit : n * 2;
+}
+
+void benchThreadScaling(const int maxThreads, const int strongAgents, const int weakAgentsPerThread, const int numPairs)
+{
+	static const int numTicks = 5;
+	static Histogram agentHist;
+	const int threadLimit = mini(maxThreads, MaxScalingThreads);
+
+	// The ticks move the crowd, each thread count starts from the same initial state.
+	printf("Thread Scaling, strong (%d agents)\n", strongAgents);
+	{
+		double base = 0.0;
+		for (int n = 1; n <= threadLimit; n = nextScalingThreads(n, threadLimit))
+		{
+			ScalingCrowd crowd;
+			initScalingCrowd(crowd, strongAgents);
+			const ScalingTiming timing = runScalingTicks(crowd, n, numTicks, agentHist);
+			if (n == 1)
+				base = timing.total;
+			printScalingRow(n, strongAgents, timing, base / timing.total);
+			printHistogram(agentHist, "Narrowphase per agent", "us", 1000.0);
+			freeScalingCrowd(crowd);
+		}
+	}
+
+	printf("Thread Scaling, weak (%d agents per thread)\n", weakAgentsPerThread);
+	{
+		double base = 0.0;
+		for (int n = 1; n <= threadLimit; n = nextScalingThreads(n, threadLimit))
+		{
+			ScalingCrowd crowd;
+			initScalingCrowd(crowd, weakAgentsPerThread * n);
+			const ScalingTiming timing = runScalingTicks(crowd, n, numTicks, agentHist);
+			if (n == 1)
+				base = timing.total;
+			printScalingRow(n, crowd.numAgents, timing, base / timing.total * n);
+			printHistogram(agentHist, "Narrowphase per agent", "us", 1000.0);
+			freeScalingCrowd(crowd);
+		}
+	}
+
+	printf("Thread Scaling, narrowphase (%d pairs)\n", numPairs);
+	{
+		TestPair* pairs = new TestPair[numPairs];
+		const int numFailed = generateWorkload(workloadPresets[0], pairs, numPairs);
+		if (numFailed > 0)
+			printf(" - %d pairs not placed in %d tries\n", numFailed, WorkloadMaxTries);
+		double base = 0.0;
+		for (int n = 1; n <= threadLimit; n = nextScalingThreads(n, threadLimit))
+		{
+			const double t = runScalingPairs(pairs, numPairs, n, 3);
+			if (n == 1)
+				base = t;
+			printf(" - %2d threads: %8.3f ms, %.2f Mpairs/s, speedup %5.2fx, efficiency %3.0f%%\n", n, t * 1000.0,
+				   numPairs / t * 1e-6, base / t, base / t / n * 100.0);
+		}
+		delete [] pairs;
+	}
+}
+
+void runTests()
+{
+	setRngSeed(0);
+	resetDistanceCounters();
+
+	printf("Batched kernels: %s (supported:", kernelVariantName(currentKernelVariant()));
+	for (int v = 0; v < NumKernelVariants; v++)
+	{
+		if (kernelVariantSupported((KernelVariant)v))
+			printf(" %s", kernelVariantName((KernelVariant)v));
+	}
+	printf(", override with CPA_KERNELS)\n\n");
+
+	// Ballpark test against a GJK/CA
+
+	const int numPairs = 1000;
+	TestPair circlePairs[numPairs];
+	TestPair circlePillPairs[numPairs];
+	TestPair pillPairs[numPairs];
+	TestPair rectPairs[numPairs];
+	TestPair mixedPairs[numPairs];
+	PreparedPair preparedPairs[numPairs];
+
+	for (int i = 0; i < numPairs; i++)
+	{
+		TestPair& p = circlePairs[i];
+		p.colA = randomCircleCollider();
+		p.colB = randomCircleCollider();
+		p.velA = randomDir() * randf(0.1f, 2.5f);
+		p.velB = randomDir() * randf(0.1f, 2.5f);
+	}
+
+	for (int i = 0; i < numPairs; i++)
+	{
+		TestPair& p = circlePillPairs[i];
+		if (randf(0, 1) > 0.5f) {
+			p.colA = randomCircleCollider();
+			p.colB = randomPillCollider();
+		} else {
+			p.colA = randomPillCollider();
+			p.colB = randomCircleCollider();
+		}
+		p.velA = randomDir() * randf(0.1f, 2.5f);
+		p.velB = randomDir() * randf(0.1f, 2.5f);
+	}
+
+	for (int i = 0; i < numPairs; i++)
+	{
+		TestPair& p = pillPairs[i];
+		p.colA = randomPillCollider();
+		p.colB = randomPillCollider();
+		p.velA = randomDir() * randf(0.1f, 2.5f);
+		p.velB = randomDir() * randf(0.1f, 2.5f);
+	}
+
+	for (int i = 0; i < numPairs; i++)
+	{
+		TestPair& p = rectPairs[i];
+		p.colA = randomRectCollider();
+		p.colB = randomRectCollider();
+		p.velA = randomDir() * randf(0.1f, 2.5f);
+		p.velB = randomDir() * randf(0.1f, 2.5f);
+	}
+
+	for (int i = 0; i < numPairs; i++)
+	{
+		TestPair& p = mixedPairs[i];
+		p.colA = randomCollider();
+		p.colB = randomCollider();
+		p.velA = randomDir() * randf(0.1f, 2.5f);
+		p.velB = randomDir() * randf(0.1f, 2.5f);
+	}
+
+
+	PerfCounters perf;
+	if (!openPerfCounters(perf))
+		printf("Hardware performance counters are not available, reporting time only.\n");
+
+	double t0, t1;
+	printf("Circle-Circle\n");
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPA(circlePairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+	preparePairs(circlePairs, preparedPairs, numPairs);
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPAPrepared(preparedPairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - Prepared: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPACute(circlePairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - Cute: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+
+	printf("Circle-Pill\n");
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPA(circlePillPairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+	preparePairs(circlePillPairs, preparedPairs, numPairs);
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPAPrepared(preparedPairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - Prepared: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPACute(circlePillPairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - Cute: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+
+	printf("Pill-Pill\n");
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPA(pillPairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+	preparePairs(pillPairs, preparedPairs, numPairs);
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPAPrepared(preparedPairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - Prepared: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPACute(pillPairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - Cute: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+
+	printf("Rect-Rect\n");
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPA(rectPairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+	preparePairs(rectPairs, preparedPairs, numPairs);
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPAPrepared(preparedPairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - Prepared: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPACute(rectPairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - Cute: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+
+	printf("Mixed\n");
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
 	for (int i = 0; i < 10; i++)
 		testPairsCPA(mixedPairs, numPairs);
 	t1 = glfwGetTime();
+	stopPerfCounters(perf);
 	printf(" - %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+	preparePairs(mixedPairs, preparedPairs, numPairs);
+	startPerfCounters(perf);
+	t0 = glfwGetTime();
+	for (int i = 0; i < 10; i++)
+		testPairsCPAPrepared(preparedPairs, numPairs);
+	t1 = glfwGetTime();
+	stopPerfCounters(perf);
+	printf(" - Prepared: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
 
+	startPerfCounters(perf);
 	t0 = glfwGetTime();
 	for (int i = 0; i < 10; i++)
 		testPairsCPACute(mixedPairs, numPairs);
 	t1 = glfwGetTime();
+	stopPerfCounters(perf);
 	printf(" - Cute: %.3f ms\n", (t1-t0) * 1000.0 / 10.0);
+	printPerfCounters(perf, numPairs * 10);
+
+
+	closePerfCounters(perf);
+
+	benchQueryLatency("Circle-Circle", circlePairs, numPairs);
+	benchQueryLatency("Circle-Pill", circlePillPairs, numPairs);
+	benchQueryLatency("Pill-Pill", pillPairs, numPairs);
+	benchQueryLatency("Rect-Rect", rectPairs, numPairs);
+	benchQueryLatency("Mixed", mixedPairs, numPairs);
 
+	for (int i = 0; i < numWorkloadPresets; i++)
+		benchWorkload(workloadPresets[i]);
+
+	benchRng();
+
+	// Copy ab_results.json to ab_baseline.json to compare later runs against it.
+	runABTests(rectPairs, mixedPairs, numPairs, "ab_results.json", "ab_baseline.json");
+
+	benchMinkowskiChain("Pill-Pill", pillPairs, numPairs);
+	benchMinkowskiChain("Rect-Rect", rectPairs, numPairs);
+	benchMinkowskiChain("Mixed", mixedPairs, numPairs);
+
+	benchWarmStart("Pill-Pill", pillPairs, numPairs);
+	benchWarmStart("Rect-Rect", rectPairs, numPairs);
+	benchWarmStart("Mixed", mixedPairs, numPairs);
+
+	benchVelocityCandidates("Circle-Circle", circlePairs, numPairs);
+	benchVelocityCandidates("Circle-Pill", circlePillPairs, numPairs);
+	benchVelocityCandidates("Mixed", mixedPairs, numPairs);
+
+	benchVelocitySearch("Circle-Circle", circlePairs, numPairs);
+	benchVelocitySearch("Mixed", mixedPairs, numPairs);
+
+	benchCpaContour("Circle-Circle", circlePairs, numPairs);
+	benchCpaContour("Mixed", mixedPairs, numPairs);
+
+	const int orcaOverlaps64 = benchOrca(64);
+	const int orcaOverlaps256 = benchOrca(256);
+
+	benchAnytime(64, 1 << 30, orcaOverlaps64);
+	benchAnytime(256, 1 << 30, orcaOverlaps256);
+	benchAnytime(256, 20000, orcaOverlaps256);
+	resetTrace();
+	benchAnytime(256, 60000, orcaOverlaps256);
+	if (writeChromeTrace("trace.json"))
+		printf("Wrote the last %d events of each thread to trace.json\n", TraceRingSize);
+
+	runAccuracyHarness(1000000, "accuracy_corpus.txt");
+
+	runFuzzer(20000, "fuzz_corpus.txt");
+
+	benchThreadScaling(maxi(1, (int)std::thread::hardware_concurrency()), 100000, 25000, 1000000);
+
+	dumpDistanceCounters();
 }
 
 
@@ -1017,6 +3772,15 @@ int main(int argc, char** argv)
 	NOTUSED(argc);
 	NOTUSED(argv);
 
+	// Replay the cases saved by the accuracy harness, e.g. test --replay accuracy_corpus.txt
+	if (argc >= 3 && strcmp(argv[1], "--replay") == 0)
+	{
+		static AccuracyStats stats[MaxAccuracyVariants];
+		const int numStats = initAccuracyVariants(stats);
+		replayAccuracyCorpus(argv[2], stats, numStats);
+		return 0;
+	}
+
 	if (!glfwInit()) {
 		printf("Failed to init GLFW.");
 		return -1;
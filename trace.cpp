@@ -0,0 +1,173 @@
+#include "trace.h"
+#include <stdio.h>
+#include <chrono>
+
+#if defined(TRACE_MARKERS) || (!defined(__x86_64__) && !defined(__i386__))
+static uint64_t clockNanoseconds()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+#if !defined(__x86_64__) && !defined(__i386__)
+uint64_t traceNow()
+{
+    return clockNanoseconds();
+}
+#endif
+
+#ifdef TRACE_MARKERS
+#include <atomic>
+
+struct TraceEvent
+{
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// Written only by the owning thread, head is published with release so that the exporter sees whole events.
+struct TraceRing
+{
+    TraceEvent events[TraceRingSize];
+    std::atomic<uint64_t> head;
+    const char* threadName;
+};
+
+static std::atomic<TraceRing*> traceRings[MaxTraceThreads];
+static std::atomic<int> numTraceRings(0);
+
+// Trace time and clock time when the first ring was created, used to convert trace time to microseconds.
+static uint64_t calibrationTrace = 0;
+static uint64_t calibrationClock = 0;
+
+static TraceRing* threadTraceRing()
+{
+    static thread_local TraceRing* ring = nullptr;
+    static thread_local bool full = false;
+    if (!ring && !full)
+    {
+        const int idx = numTraceRings.fetch_add(1);
+        if (idx == 0)
+        {
+            calibrationClock = clockNanoseconds();
+            calibrationTrace = traceNow();
+        }
+        if (idx >= MaxTraceThreads)
+        {
+            // Out of rings, this thread is not traced.
+            full = true;
+            return nullptr;
+        }
+        ring = new TraceRing();
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->threadName = nullptr;
+        traceRings[idx].store(ring, std::memory_order_release);
+    }
+    return ring;
+}
+
+void traceRecord(const char* name, const uint64_t start, const uint64_t end)
+{
+    TraceRing* ring = threadTraceRing();
+    if (!ring)
+        return;
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    TraceEvent& ev = ring->events[head & (TraceRingSize - 1)];
+    ev.name = name;
+    ev.start = start;
+    ev.end = end;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void setTraceThreadName(const char* name)
+{
+    TraceRing* ring = threadTraceRing();
+    if (ring)
+        ring->threadName = name;
+}
+
+void resetTrace()
+{
+    const int numRings = numTraceRings.load() < MaxTraceThreads ? numTraceRings.load() : MaxTraceThreads;
+    for (int i = 0; i < numRings; i++)
+    {
+        TraceRing* ring = traceRings[i].load(std::memory_order_acquire);
+        if (ring)
+            ring->head.store(0, std::memory_order_release);
+    }
+}
+
+bool writeChromeTrace(const char* path)
+{
+    FILE* fp = fopen(path, "w");
+    if (!fp)
+        return false;
+
+    // Timestamps are relative to the earliest event, in microseconds.
+    const uint64_t elapsedTrace = traceNow() - calibrationTrace;
+    const uint64_t elapsedClock = clockNanoseconds() - calibrationClock;
+    const double toMicroseconds = elapsedTrace > 0 ? (double)elapsedClock / (double)elapsedTrace / 1000.0 : 0.001;
+
+    const int numRings = numTraceRings.load() < MaxTraceThreads ? numTraceRings.load() : MaxTraceThreads;
+    uint64_t origin = ~0ull;
+    for (int i = 0; i < numRings; i++)
+    {
+        TraceRing* ring = traceRings[i].load(std::memory_order_acquire);
+        if (!ring)
+            continue;
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        const uint64_t first = head > TraceRingSize ? head - TraceRingSize : 0;
+        for (uint64_t j = first; j < head; j++)
+        {
+            const uint64_t start = ring->events[j & (TraceRingSize - 1)].start;
+            origin = start < origin ? start : origin;
+        }
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (int i = 0; i < numRings; i++)
+    {
+        TraceRing* ring = traceRings[i].load(std::memory_order_acquire);
+        if (!ring)
+            continue;
+
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", i, ring->threadName ? ring->threadName : "worker");
+        first = false;
+
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        const uint64_t start = head > TraceRingSize ? head - TraceRingSize : 0;
+        for (uint64_t j = start; j < head; j++)
+        {
+            const TraceEvent& ev = ring->events[j & (TraceRingSize - 1)];
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    ev.name, i, (ev.start - origin) * toMicroseconds, (ev.end - ev.start) * toMicroseconds);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+
+    return fclose(fp) == 0;
+}
+
+#else
+
+void traceRecord(const char*, const uint64_t, const uint64_t)
+{
+}
+
+void setTraceThreadName(const char*)
+{
+}
+
+void resetTrace()
+{
+}
+
+bool writeChromeTrace(const char*)
+{
+    return false;
+}
+
+#endif
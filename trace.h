@@ -0,0 +1,79 @@
+//
+// Copyright (c) 2021 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Scoped trace markers, compiled in when TRACE_MARKERS is defined and to nothing otherwise.
+// Each thread records into its own ring buffer of TraceRingSize events, the oldest events are overwritten.
+// The name must be a string that outlives the trace, e.g. a literal.
+//
+//   void tick()
+//   {
+//       TRACE_SCOPE("tick");
+//       ...
+//   }
+
+static const int TraceRingSize = 1 << 16;
+static const int MaxTraceThreads = 64;
+
+// Trace timestamp, the time stamp counter on x86 and nanoseconds elsewhere. The exporter converts it to time.
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline uint64_t traceNow() { return __rdtsc(); }
+#else
+uint64_t traceNow();
+#endif
+
+// Records a complete event on the calling thread's ring buffer, lock-free.
+void traceRecord(const char* name, const uint64_t start, const uint64_t end);
+
+// Names the calling thread in the exported trace.
+void setTraceThreadName(const char* name);
+
+// Clears all recorded events. Should not be called while other threads are recording.
+void resetTrace();
+
+// Writes the recorded events of all threads as Chrome trace JSON, which can be opened in chrome://tracing
+// or Perfetto. Events being recorded while writing may be missing or torn. Returns false if the file
+// cannot be written, or if compiled without TRACE_MARKERS.
+bool writeChromeTrace(const char* path);
+
+#ifdef TRACE_MARKERS
+
+struct TraceScope
+{
+    TraceScope(const char* name) : name(name), start(traceNow()) {}
+    ~TraceScope() { traceRecord(name, start, traceNow()); }
+    const char* name;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+
+#endif
+
+#endif // TRACE_H